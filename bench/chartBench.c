@@ -0,0 +1,244 @@
+// Renders a report of days of one second readings the way -report_dir
+// does (pyramid, envelope, PNG) on 1 thread and on every core, and checks
+// each file decodes: chunk CRCs, the IDAT zlib stream inflated back to
+// every row of the full chart size, and its Adler-32.
+// Build with "make bench" and run ./build/bench/chartBench [days]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include "seriesPyramid.h"
+#include "chartRender.h"
+#include "workerPool.h"
+
+#define WIDTH 1000
+#define HEIGHT 600
+#define DAY_ROWS 86400
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct benchDay {
+    unsigned int day;
+    char directory[64];
+    int ok;
+};
+typedef struct benchDay BenchDay;
+
+void fillDay(DataSeries *series, unsigned int day) {
+    reserveDataSeries(series, DAY_ROWS);
+    DataValue data;
+    memset(&data, 0, sizeof(data));
+    unsigned int seed = day;
+    for (size_t i = 0; i < DAY_ROWS; i++) {
+        data.time.year = 2025;
+        data.time.month = 1 + day / 28 % 12;
+        data.time.day = 1 + day % 28;
+        data.time.hour = i / 3600;
+        data.time.minute = i / 60 % 60;
+        data.time.second = i % 60;
+        data.temperature = 20 + 5 * sin(i * 2 * M_PI / DAY_ROWS) + (rand_r(&seed) % 100) / 100.0;
+        data.humidity = 50 + 10 * cos(i * 2 * M_PI / DAY_ROWS) + (rand_r(&seed) % 100) / 50.0;
+        data.f_temperature = celsiusToFahrenheit(data.temperature);
+        appendDataValue(series, &data);
+    }
+}
+
+void renderDay(void *job) {
+    BenchDay *day = (BenchDay*)job;
+    DataSeries rows, view;
+    initDataSeries(&rows);
+    fillDay(&rows, day->day);
+    MYSQL_TIME first = rows.time[0], last = rows.time[DAY_ROWS - 1];
+    uint64_t fromKey = timestampKey(&first), toKey = timestampKey(&last);
+    SeriesPyramid pyramid;
+    ChartData chart;
+    initSeriesPyramid(&pyramid);
+    initDataSeries(&view);
+    initChartData(&chart);
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%u.png", day->directory, day->day);
+    day->ok = buildSeriesPyramid(&pyramid, &rows, fromKey, toKey) &&
+        queryPyramid(&pyramid, fromKey, toKey, WIDTH, &view) &&
+        buildChartData(&view, plotSeconds(&first), plotSeconds(&last), BOTH, 0, &chart) &&
+        renderChartPng(&chart, WIDTH, HEIGHT, "bench", path);
+    freeChartData(&chart);
+    freeDataSeries(&view);
+    freeSeriesPyramid(&pyramid);
+}
+
+uint32_t readUint32(const unsigned char *bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+struct inflateInput {
+    const unsigned char *data;
+    size_t size;
+    size_t bit;
+};
+typedef struct inflateInput InflateInput;
+
+// -1 past the end of the stream
+int inflateBits(InflateInput *in, int count) {
+    int value = 0;
+    for (int i = 0; i < count; i++, in->bit++) {
+        if (in->bit / 8 >= in->size) return -1;
+        value |= ((in->data[in->bit / 8] >> (in->bit % 8)) & 1) << i;
+    }
+    return value;
+}
+
+// Fixed literal / length code (RFC 1951 3.2.6), read highest bit first
+int inflateFixedSymbol(InflateInput *in) {
+    int code = 0;
+    for (int length = 1; length <= 9; length++) {
+        int bit = inflateBits(in, 1);
+        if (bit < 0) return -1;
+        code = (code << 1) | bit;
+        if (length == 7 && code <= 0x17) return code + 256;
+        if (length == 8 && code >= 0x30 && code <= 0xBF) return code - 0x30;
+        if (length == 8 && code >= 0xC0 && code <= 0xC7) return code - 0xC0 + 280;
+        if (length == 9 && code >= 0x190) return code - 0x190 + 144;
+    }
+    return -1;
+}
+
+// Inflates a zlib stream of stored and fixed Huffman blocks (all writePng
+// makes) into out. Returns the size, or 0 when the stream is broken.
+size_t inflateZlib(const unsigned char *data, size_t size, unsigned char *out, size_t capacity) {
+    static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    if (size < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0) return 0;
+    InflateInput in = { data + 2, size - 6, 0 };
+    size_t used = 0;
+    int last = 0;
+    while (!last) {
+        last = inflateBits(&in, 1);
+        int type = inflateBits(&in, 2);
+        if (last < 0 || type < 0) return 0;
+        if (type == 0) {
+            in.bit = (in.bit + 7) / 8 * 8;
+            size_t at = in.bit / 8;
+            if (at + 4 > in.size) return 0;
+            size_t length = in.data[at] | (in.data[at + 1] << 8);
+            if (at + 4 + length > in.size || used + length > capacity) return 0;
+            memcpy(out + used, in.data + at + 4, length);
+            used += length;
+            in.bit = (at + 4 + length) * 8;
+            continue;
+        }
+        if (type != 1) return 0;
+        while (1) {
+            int symbol = inflateFixedSymbol(&in);
+            if (symbol < 0 || symbol > 285) return 0;
+            if (symbol < 256) {
+                if (used == capacity) return 0;
+                out[used++] = (unsigned char)symbol;
+                continue;
+            }
+            if (symbol == 256) break;
+            int extra = inflateBits(&in, lengthExtra[symbol - 257]);
+            int code = 0;
+            for (int i = 0; i < 5; i++) code = (code << 1) | inflateBits(&in, 1);
+            if (extra < 0 || code > 29) return 0;
+            int distanceExtra = (code < 4 ? 0 : code / 2 - 1);
+            int distance = distanceBase[code] + inflateBits(&in, distanceExtra);
+            size_t length = (size_t)(lengthBase[symbol - 257] + extra);
+            if ((size_t)distance > used || used + length > capacity) return 0;
+            for (size_t i = 0; i < length; i++, used++) out[used] = out[used - distance];
+        }
+    }
+    return (adler32(out, used) == readUint32(data + size - 4) ? used : 0);
+}
+
+int checkPng(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return 0;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    unsigned char *png = malloc(length > 0 ? (size_t)length : 1);
+    size_t size = (png != NULL ? fread(png, 1, (size_t)length, file) : 0);
+    fclose(file);
+    if (size < 33 || memcmp(png, "\x89PNG\r\n\x1A\n", 8) != 0) {
+        free(png);
+        return 0;
+    }
+
+    unsigned int width = 0, height = 0;
+    unsigned char *idat = malloc(size);
+    size_t idatSize = 0, at = 8;
+    int ok = (idat != NULL), ended = 0;
+    while (ok && !ended && at + 12 <= size) {
+        uint32_t chunk = readUint32(png + at);
+        const unsigned char *type = png + at + 4;
+        if (chunk > size - at - 12 || pngCrc(0, type, chunk + 4) != readUint32(type + 4 + chunk)) ok = 0;
+        else if (memcmp(type, "IHDR", 4) == 0) {
+            width = readUint32(type + 4);
+            height = readUint32(type + 8);
+        }
+        else if (memcmp(type, "IDAT", 4) == 0) {
+            memcpy(idat + idatSize, type + 4, chunk);
+            idatSize += chunk;
+        }
+        else if (memcmp(type, "IEND", 4) == 0) ended = 1;
+        at += 12 + chunk;
+    }
+    free(png);
+
+    // One filter byte (0, none) in front of every row of palette indexes
+    size_t stride = (size_t)width + 1, expected = stride * height;
+    ok = ok && ended && width == WIDTH && height == HEIGHT;
+    unsigned char *rows = (ok ? malloc(expected + 1) : NULL);
+    ok = ok && rows != NULL && inflateZlib(idat, idatSize, rows, expected + 1) == expected;
+    for (size_t y = 0; ok && y < height; y++) ok = (rows[y * stride] == 0);
+    free(rows);
+    free(idat);
+    return ok;
+}
+
+double renderReport(BenchDay *days, size_t count, size_t threads) {
+    WorkerPool pool;
+    if (!startWorkerPool(&pool, threads, renderDay)) exit(EXIT_FAILURE);
+    double begin = nowSeconds();
+    for (size_t i = 0; i < count; i++) submitWorkerJob(&pool, &days[i]);
+    finishWorkerPool(&pool);
+    return nowSeconds() - begin;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 100);
+    char directory[] = "/tmp/chartBenchXXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    BenchDay *days = calloc(count, sizeof(BenchDay));
+    for (size_t i = 0; i < count; i++) {
+        days[i].day = (unsigned int)i;
+        snprintf(days[i].directory, sizeof(days[i].directory), "%s", directory);
+    }
+
+    size_t cores = workerPoolDefaultThreads();
+    double single = renderReport(days, count, 1);
+    double parallel = renderReport(days, count, cores);
+    size_t good = 0;
+    char path[128];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/%zu.png", directory, i);
+        good += (days[i].ok && checkPng(path));
+        remove(path);
+    }
+    rmdir(directory);
+    printf("%zu days of %d rows: 1 thread %.3f s, %zu threads %.3f s (%.1f charts / s), %zu PNGs decoded\n",
+        count, DAY_ROWS, single, cores, parallel, count / parallel, good);
+    free(days);
+    return (good == count ? 0 : EXIT_FAILURE);
+}
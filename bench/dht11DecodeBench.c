@@ -0,0 +1,117 @@
+// Decodes synthetic DHT11 edge traces at increasing timing jitter, then any
+// traces recorded with -dht11_trace, and reports the decode success rate and
+// time per decode.
+// Build with "make bench" and run ./build/bench/dht11DecodeBench [trace files...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "dht11Decoder.h"
+
+#define SYNTHETIC_TRACES 100000
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Nominal width plus uniform jitter in [-jitter, +jitter] microseconds
+uint64_t jittered(unsigned int *seed, double nominalUs, double jitterUs) {
+    double offset = jitterUs * ((rand_r(seed) % 2001) / 1000.0 - 1.0);
+    return (uint64_t)((nominalUs + offset) * 1000.0);
+}
+
+size_t syntheticTrace(Dht11Edge *edges, const int data[5], unsigned int *seed, double jitterUs) {
+    size_t count = 0;
+    uint64_t t = 1000000;
+    // Response: falling, ~80us low, rising, ~80us high, then the first bit
+    edges[count++] = (Dht11Edge){ t, 0 };
+    t += jittered(seed, 80, jitterUs);
+    edges[count++] = (Dht11Edge){ t, 1 };
+    t += jittered(seed, 80, jitterUs);
+    for (int bit = 0; bit < 40; bit++) {
+        int value = (data[bit / 8] >> (7 - bit % 8)) & 1;
+        edges[count++] = (Dht11Edge){ t, 0 };
+        t += jittered(seed, 50, jitterUs);
+        edges[count++] = (Dht11Edge){ t, 1 };
+        t += jittered(seed, value ? DHT11_ONE_US : DHT11_ZERO_US, jitterUs);
+    }
+    // Sensor releases the line after a final low
+    edges[count++] = (Dht11Edge){ t, 0 };
+    t += jittered(seed, 50, jitterUs);
+    edges[count++] = (Dht11Edge){ t, 1 };
+    return count;
+}
+
+void runSynthetic(double jitterUs) {
+    static Dht11Edge traces[SYNTHETIC_TRACES][2 * 40 + 6];
+    static size_t counts[SYNTHETIC_TRACES];
+    static int expected[SYNTHETIC_TRACES][5];
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < SYNTHETIC_TRACES; i++) {
+        int *data = expected[i];
+        data[0] = 30 + rand_r(&seed) % 50;
+        data[1] = rand_r(&seed) % 10;
+        data[2] = 10 + rand_r(&seed) % 25;
+        data[3] = rand_r(&seed) % 10;
+        data[4] = (data[0] + data[1] + data[2] + data[3]) & 0xFF;
+        counts[i] = syntheticTrace(traces[i], data, &seed, jitterUs);
+    }
+
+    size_t results[DHT11_BAD_CHECKSUM + 1] = {0};
+    size_t wrong = 0;
+    double start = nowSeconds();
+    for (size_t i = 0; i < SYNTHETIC_TRACES; i++) {
+        int data[5];
+        enum Dht11DecodeResult result = decodeDHT11Edges(traces[i], counts[i], data);
+        results[result]++;
+        if (result == DHT11_OK && memcmp(data, expected[i], sizeof(data)) != 0) wrong++;
+    }
+    double elapsed = nowSeconds() - start;
+
+    printf("jitter %5.1lfus: %6.2lf%% ok, %zu wrong values, %.0lf ns/decode", jitterUs,
+        100.0 * results[DHT11_OK] / SYNTHETIC_TRACES, wrong, elapsed * 1e9 / SYNTHETIC_TRACES);
+    for (int r = DHT11_NO_RESPONSE; r <= DHT11_BAD_CHECKSUM; r++)
+        if (results[r]) printf(", %s %zu", dht11DecodeResultName(r), results[r]);
+    printf("\n");
+}
+
+int runRecorded(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Failed to open trace file");
+        return 0;
+    }
+    Dht11Edge edges[DHT11_MAX_EDGES];
+    size_t results[DHT11_BAD_CHECKSUM + 1] = {0};
+    size_t traces = 0, count;
+    double elapsed = 0;
+    while ((count = readDHT11Trace(file, edges, DHT11_MAX_EDGES)) > 0) {
+        int data[5];
+        double start = nowSeconds();
+        results[decodeDHT11Edges(edges, count, data)]++;
+        elapsed += nowSeconds() - start;
+        traces++;
+    }
+    fclose(file);
+    if (traces == 0) {
+        printf("%s: no traces\n", path);
+        return 1;
+    }
+    printf("%s: %zu traces, %6.2lf%% ok, %.0lf ns/decode", path, traces,
+        100.0 * results[DHT11_OK] / traces, elapsed * 1e9 / traces);
+    for (int r = DHT11_NO_RESPONSE; r <= DHT11_BAD_CHECKSUM; r++)
+        if (results[r]) printf(", %s %zu", dht11DecodeResultName(r), results[r]);
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    double jitters[] = { 0, 5, 10, 15, 20, 25 };
+    for (size_t i = 0; i < sizeof(jitters) / sizeof(jitters[0]); i++)
+        runSynthetic(jitters[i]);
+    int ok = 1;
+    for (int i = 1; i < argc; i++)
+        ok &= runRecorded(argv[i]);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+// Times LTTB and MINMAX on growing series to show they stay linear, and
+// checks that both keep the first and last row and MINMAX the extremes.
+// Build with "make bench" and run ./build/bench/downsampleBench [points]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "downsample.h"
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A daily cycle with noise and the odd spike, one row a minute
+void fillSeries(DataSeries *series, uint64_t *keys, size_t count) {
+    reserveDataSeries(series, count);
+    DataValue data;
+    memset(&data, 0, sizeof(data));
+    srand(1234);
+    for (size_t i = 0; i < count; i++) {
+        data.temperature = 20 + 5 * sin(i * 2 * M_PI / 1440) + (rand() % 100) / 100.0;
+        if (rand() % 100000 == 0) data.temperature += 15;
+        data.humidity = 50 + 10 * cos(i * 2 * M_PI / 1440) + (rand() % 100) / 50.0;
+        data.f_temperature = celsiusToFahrenheit(data.temperature);
+        appendDataValue(series, &data);
+        keys[i] = (uint64_t)i * 60;
+    }
+}
+
+void check(int ok, const char *what) {
+    if (ok) return;
+    fprintf(stderr, "Check failed: %s\n", what);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    size_t points = (argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 1000);
+    size_t sizes[] = {10000, 100000, 1000000, 10000000};
+    printf("%10s %12s %12s %10s\n", "rows", "lttb (s)", "minmax (s)", "points");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t count = sizes[s];
+        DataSeries series;
+        initDataSeries(&series);
+        uint64_t *keys = malloc(count * sizeof(uint64_t));
+        fillSeries(&series, keys, count);
+
+        DataSeries lttb, minMax;
+        double begin = nowSeconds();
+        downsampleRows(&series, keys, 0, count, LTTB_DOWNSAMPLE, 1, 1, points, &lttb);
+        double lttbTime = nowSeconds() - begin;
+        begin = nowSeconds();
+        downsampleRows(&series, keys, 0, count, MINMAX_DOWNSAMPLE, 1, 0, points, &minMax);
+        double minMaxTime = nowSeconds() - begin;
+
+        check(lttb.count <= 2 * points && lttb.temperature[0] == series.temperature[0] &&
+            lttb.temperature[lttb.count - 1] == series.temperature[count - 1], "LTTB keeps the end rows");
+        double low = INFINITY, high = -INFINITY, keptLow = INFINITY, keptHigh = -INFINITY;
+        for (size_t i = 0; i < count; i++) {
+            low = fmin(low, series.temperature[i]);
+            high = fmax(high, series.temperature[i]);
+        }
+        for (size_t i = 0; i < minMax.count; i++) {
+            keptLow = fmin(keptLow, minMax.temperature[i]);
+            keptHigh = fmax(keptHigh, minMax.temperature[i]);
+        }
+        check(minMax.count <= points && keptLow == low && keptHigh == high, "MINMAX keeps the extremes");
+
+        printf("%10zu %12.6f %12.6f %10zu\n", count, lttbTime, minMaxTime, lttb.count);
+        freeDataSeries(&lttb);
+        freeDataSeries(&minMax);
+        freeDataSeries(&series);
+        free(keys);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Compares the old pow/malloc based conversions with the fixed point
+// layer: DHT11 decoding, the LCD value strings and a listData row.
+// Build with "make bench" and run ./build/bench/formatBench [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "fixedFormat.h"
+
+int legacyDigits(int value) {
+    int i = 0;
+    if (value == 0) return 1;
+    while (value > 0) {
+        value /= 10;
+        i++;
+    }
+    return i;
+}
+
+void legacyConvertData(int data[5], double* value1, double* value2) {
+    *value1 = data[0];
+    *value1 += data[1] / pow(10, legacyDigits(data[1]));
+    *value2 = data[2];
+    *value2 += data[3] / pow(10, legacyDigits(data[3]));
+}
+
+char* legacyGetDoubleString(double input, unsigned int length) {
+    if (length == 0) return NULL;
+    unsigned int decimalPlace = length + 1;
+    int divisor = pow(10, length);
+    int outsideBounds = 0;
+
+    if (input < 1) {
+        decimalPlace = 1;
+        input *= divisor;
+    }
+    else if (input > divisor * 10) {
+        outsideBounds = 1;
+        while (input > divisor * 10) {
+            input /= 10;
+        }
+    }
+    else while (input < divisor) {
+        input *= 10; decimalPlace--;
+    }
+
+    char *output = (char*)malloc((length + 2) * sizeof(char));
+
+    int converted = (int)input;
+    unsigned int i = 0;
+    while (divisor > 0) {
+        if (i >= length) break;
+        if (i == decimalPlace) output[i++] = '.';
+
+        int digit = converted / divisor;
+        output[i++] = '0' + digit;
+
+        converted = converted % divisor;
+        divisor /= 10;
+    }
+    if (outsideBounds) output[i - 1] = 'E';
+    output[i] = '\0';
+
+    return output;
+}
+
+void convertData(int data[5], double* value1, double* value2) {
+    *value1 = (double)decodeFixedReading(data[0], data[1]) / FIXED_READING_SCALE;
+    *value2 = (double)decodeFixedReading(data[2], data[3]) / FIXED_READING_SCALE;
+}
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keeps the optimiser from dropping the work
+volatile double sinkValue;
+volatile char sinkChar;
+
+void report(const char *name, double legacy, double fixed, size_t iterations) {
+    printf("%-22s old %7.1lf ns   new %7.1lf ns   %5.1lfx\n", name,
+        legacy * 1e9 / iterations, fixed * 1e9 / iterations, legacy / fixed);
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = (argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000);
+    int (*frames)[5] = malloc(iterations * sizeof(*frames));
+    double *values = malloc(iterations * sizeof(double));
+    if (frames == NULL || values == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    unsigned int seed = 7;
+    for (size_t i = 0; i < iterations; i++) {
+        for (int j = 0; j < 4; j++) frames[i][j] = rand_r(&seed) % 256;
+        values[i] = (rand_r(&seed) % 1000000) / 1000.0;
+    }
+
+    // Every possible byte pair has to decode to the same value
+    size_t decodeMismatches = 0;
+    for (int whole = 0; whole < 256; whole++) {
+        for (int fraction = 0; fraction < 256; fraction++) {
+            int data[5] = { whole, fraction, whole, fraction, 0 };
+            double a, b, c, d;
+            legacyConvertData(data, &a, &b);
+            convertData(data, &c, &d);
+            if (fabs(a - c) > 1e-9 || fabs(b - d) > 1e-9) decodeMismatches++;
+        }
+    }
+    // List rows print printf's digits except on rounding ties (see appendDouble)
+    size_t printMismatches = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        char a[64], b[64];
+        snprintf(a, sizeof(a), "%.3lf", values[i] * 1.8 + 32);
+        *appendDouble(b, values[i] * 1.8 + 32, 3) = '\0';
+        if (strcmp(a, b) != 0) printMismatches++;
+    }
+    printf("decode mismatches %zu / 65536, %%.3lf mismatches %zu / %zu\n\n",
+        decodeMismatches, printMismatches, iterations);
+
+    double start = nowSeconds();
+    for (size_t i = 0; i < iterations; i++) {
+        double a, b;
+        legacyConvertData(frames[i], &a, &b);
+        sinkValue = a + b;
+    }
+    double legacy = nowSeconds() - start;
+    start = nowSeconds();
+    for (size_t i = 0; i < iterations; i++) {
+        double a, b;
+        convertData(frames[i], &a, &b);
+        sinkValue = a + b;
+    }
+    report("convertData", legacy, nowSeconds() - start, iterations);
+
+    // The old version leaks; free here so the benchmark does not swap
+    start = nowSeconds();
+    for (size_t i = 0; i < iterations; i++) {
+        char *text = legacyGetDoubleString(values[i] / 10000.0 * 100, 4);
+        sinkChar = text[0];
+        free(text);
+    }
+    legacy = nowSeconds() - start;
+    start = nowSeconds();
+    for (size_t i = 0; i < iterations; i++) {
+        char text[8];
+        formatFitted(text, values[i] / 10000.0 * 100, 4);
+        sinkChar = text[0];
+    }
+    report("LCD value string", legacy, nowSeconds() - start, iterations);
+
+    start = nowSeconds();
+    for (size_t i = 0; i < iterations; i++) {
+        char line[128];
+        snprintf(line, sizeof(line), "Temperature: %.3lf%c | Humidity: %.3lf | Time: %04d-%02d-%02d %02d:%02d:%02d\n",
+            values[i], 'C', values[iterations - 1 - i], 2024, 3, 14, 15, 9, (int)(i % 60));
+        sinkChar = line[20];
+    }
+    legacy = nowSeconds() - start;
+    start = nowSeconds();
+    for (size_t i = 0; i < iterations; i++) {
+        char line[128];
+        char *p = appendString(line, "Temperature: ");
+        p = appendDouble(p, values[i], 3);
+        *p++ = 'C';
+        p = appendString(p, " | Humidity: ");
+        p = appendDouble(p, values[iterations - 1 - i], 3);
+        p = appendString(p, " | Time: ");
+        p = appendDateTime(p, 2024, 3, 14, 15, 9, (unsigned int)(i % 60), " ");
+        *p++ = '\n';
+        *p = '\0';
+        sinkChar = line[20];
+    }
+    report("listData row", legacy, nowSeconds() - start, iterations);
+
+    free(frames);
+    free(values);
+    return (decodeMismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// Drives the LCD code against a mock I2C device that records every write
+// and replays it through a model of the HD44780 behind the PCF8574. Checks
+// that the modelled screen always matches the framebuffer and compares the
+// bus traffic of the old per-byte writes with the batched, diffed refresh.
+// Build with "make bench" and run ./build/bench/lcdBench [samples]
+#ifndef NO_WIRINGPI
+#define NO_WIRINGPI
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "LCDControl.h"
+
+// I2C cost of one write: start, address byte, data bytes, stop
+#define I2C_BITS(bytes) (((bytes) + 1) * 9 + 2)
+
+struct mockDevice {
+    LCDTransport transport;
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t busBits;
+    // HD44780 model
+    int fourBit;
+    int haveHigh;
+    int high;
+    int previous;
+    int address;
+    char ddram[0x80];
+    int protocolErrors;
+};
+typedef struct mockDevice MockDevice;
+
+void mockInstruction(MockDevice *mock, int value, int rs) {
+    if (rs) {
+        mock->ddram[mock->address] = (char)value;
+        // Two line mode: 0x00-0x27 and 0x40-0x67
+        mock->address++;
+        if (mock->address == 0x28) mock->address = 0x40;
+        else if (mock->address == 0x68) mock->address = 0x00;
+    } else if (value == 0x01) {
+        memset(mock->ddram, ' ', sizeof(mock->ddram));
+        mock->address = 0;
+    } else if (value & 0x80) {
+        mock->address = value & 0x7F;
+    } else if ((value & 0xE0) == 0x20) {
+        // Function set; DL (bit 4) picks the interface width
+        if (!(value & 0x10) && !mock->fourBit) {
+            mock->fourBit = 1;
+            mock->haveHigh = 0;
+        }
+    }
+}
+
+// The controller latches DB7-4 on the falling edge of EN
+void mockByte(MockDevice *mock, int byte) {
+    if ((mock->previous & 0x04) && !(byte & 0x04)) {
+        if ((mock->previous & 0xF3) != (byte & 0xF3)) mock->protocolErrors++;
+        int nibble = mock->previous & 0xF0;
+        int rs = mock->previous & 0x01;
+        if (!mock->fourBit) mockInstruction(mock, nibble, rs);
+        else if (!mock->haveHigh) {
+            mock->high = nibble;
+            mock->haveHigh = 1;
+        } else {
+            mockInstruction(mock, mock->high | (nibble >> 4), rs);
+            mock->haveHigh = 0;
+        }
+    }
+    mock->previous = byte;
+}
+
+int mockWrite(LCDTransport *transport, const unsigned char *bytes, size_t count) {
+    MockDevice *mock = (MockDevice*)transport->context;
+    mock->transfers++;
+    mock->bytes += count;
+    mock->busBits += I2C_BITS(count);
+    for (size_t i = 0; i < count; i++) mockByte(mock, bytes[i]);
+    return 1;
+}
+
+void initMock(MockDevice *mock) {
+    memset(mock, 0, sizeof(*mock));
+    memset(mock->ddram, ' ', sizeof(mock->ddram));
+    mock->transport.write = mockWrite;
+    mock->transport.context = mock;
+}
+
+int mockMatches(MockDevice *mock, LCDDisplay *display) {
+    for (int y = 0; y < LCD_ROWS; y++)
+        if (memcmp(mock->ddram + 0x40 * y, display->frame[y], LCD_COLUMNS) != 0) return 0;
+    return 1;
+}
+
+// Old path: four single byte writes and two 2ms delays per byte sent
+double legacyWriteMs(const char *text, int commands) {
+    size_t sent = strlen(text) + commands;
+    return sent * (4 * I2C_BITS(1) / 100.0 + 4.0);
+}
+
+int main(int argc, char **argv) {
+    size_t samples = (argc > 1 ? strtoul(argv[1], NULL, 10) : 8640);
+    MockDevice mock;
+    initMock(&mock);
+    LCDDisplay display;
+    if (!initDisplay(&display, &mock.transport)) {
+        fprintf(stderr, "Display init failed\n");
+        return 1;
+    }
+
+    unsigned int seed = 1;
+    time_t time = 1700000000;
+    double temperature = 21, humidity = 55;
+    size_t mismatches = 0;
+    uint64_t bitsBefore = mock.busBits, bytesBefore = mock.bytes, transfersBefore = mock.transfers;
+    uint64_t maxBits = 0;
+    for (size_t i = 0; i < samples; i++) {
+        temperature += (rand_r(&seed) % 3 - 1) * 0.1;
+        humidity += (rand_r(&seed) % 3 - 1) * 0.1;
+        time += 10;
+        uint64_t bits = mock.busBits;
+        writeDisplayData(&display, temperature, humidity, time);
+        if (mock.busBits - bits > maxBits) maxBits = mock.busBits - bits;
+        if (!mockMatches(&mock, &display)) mismatches++;
+    }
+
+    // A clear forces every non blank cell to be resent
+    clearDisplay(&display);
+    uint64_t bits = mock.busBits;
+    writeDisplayData(&display, temperature, humidity, time);
+    double fullMs = (mock.busBits - bits) / 100.0;
+    if (!mockMatches(&mock, &display)) mismatches++;
+
+    double meanBits = (double)(mock.busBits - bitsBefore) / (samples + 1);
+    printf("%zu refreshes, %zu screen mismatches, %d protocol errors\n", samples + 1, mismatches, mock.protocolErrors);
+    printf("batched: %.1lf bytes in %.2lf writes per refresh\n",
+        (double)(mock.bytes - bytesBefore) / (samples + 1), (double)(mock.transfers - transfersBefore) / (samples + 1));
+    printf("batched at 100kHz: mean %.2lfms, max %.2lfms, full redraw %.2lfms\n",
+        meanBits / 100.0, maxBits / 100.0, fullMs);
+    printf("batched at 400kHz: mean %.2lfms, max %.2lfms, full redraw %.2lfms\n",
+        meanBits / 400.0, maxBits / 400.0, fullMs / 4);
+    printf("old per-byte writes at 100kHz: %.2lfms per refresh\n",
+        legacyWriteMs("temp humi time" "21.0" "55.0" "12:00", 4));
+    return (mismatches == 0 && mock.protocolErrors == 0) ? 0 : 1;
+}
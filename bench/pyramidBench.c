@@ -0,0 +1,113 @@
+// Draws random zoom windows of a year of one minute readings from the
+// pyramid and checks every column against a plain pass over its rows.
+// Build with "make bench" and run ./build/bench/pyramidBench [windows]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "seriesPyramid.h"
+
+#define COLUMNS 1000
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void fillSeries(DataSeries *series, size_t count) {
+    reserveDataSeries(series, count);
+    struct tm base = {0};
+    base.tm_year = 125;
+    base.tm_mday = 1;
+    base.tm_isdst = -1;
+    time_t start = mktime(&base);
+    DataValue data;
+    memset(&data, 0, sizeof(data));
+    srand(1234);
+    for (size_t i = 0; i < count; i++) {
+        // A gap every so often, like the sensor being off
+        time_t t = start + (time_t)i * 60 + (time_t)(i / 50000) * 86400;
+        struct tm local;
+        localtime_r(&t, &local);
+        data.time.year = local.tm_year + 1900;
+        data.time.month = local.tm_mon + 1;
+        data.time.day = local.tm_mday;
+        data.time.hour = local.tm_hour;
+        data.time.minute = local.tm_min;
+        data.time.second = local.tm_sec;
+        data.temperature = 20 + (rand() % 1000) / 100.0;
+        data.humidity = 40 + (rand() % 2000) / 100.0;
+        data.f_temperature = celsiusToFahrenheit(data.temperature);
+        appendDataValue(series, &data);
+    }
+}
+
+// The pass queryPyramid replaces, for the same column bounds
+double checkWindow(const SeriesPyramid *pyramid, uint64_t fromKey, uint64_t toKey, const DataSeries *view) {
+    double begin = nowSeconds();
+    size_t first = pyramidLowerBound(pyramid, fromKey), last = pyramidLowerBound(pyramid, toKey + 1);
+    size_t bucket = 0;
+    for (size_t i = first; i < last; ) {
+        if (!view->aggregated) {
+            if (view->temperature[i - first] != pyramid->rows.temperature[i]) goto mismatch;
+            i++;
+            continue;
+        }
+        if (bucket >= view->count) goto mismatch;
+        size_t j = i + view->samples[bucket];
+        double minT = INFINITY, maxT = -INFINITY, sumT = 0, minH = INFINITY, maxH = -INFINITY;
+        for (size_t r = i; r < j; r++) {
+            minT = fmin(minT, pyramid->rows.temperature[r]);
+            maxT = fmax(maxT, pyramid->rows.temperature[r]);
+            sumT += pyramid->rows.temperature[r];
+            minH = fmin(minH, pyramid->rows.humidity[r]);
+            maxH = fmax(maxH, pyramid->rows.humidity[r]);
+        }
+        if (minT != view->temperatureMin[bucket] || maxT != view->temperatureMax[bucket] ||
+            minH != view->humidityMin[bucket] || maxH != view->humidityMax[bucket] ||
+            fabs(sumT / (j - i) - view->temperature[bucket]) > 1e-9 ||
+            compareTimestamps(pyramid->rows.time[i], view->time[bucket]) != 0)
+            goto mismatch;
+        bucket++;
+        i = j;
+    }
+    return nowSeconds() - begin;
+
+mismatch:
+    fprintf(stderr, "Pyramid window does not match the rows\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    size_t windows = (argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 1000);
+    size_t count = 525600;
+    DataSeries series;
+    initDataSeries(&series);
+    fillSeries(&series, count);
+    uint64_t fromKey = timestampKey(&series.time[0]), toKey = timestampKey(&series.time[count - 1]);
+
+    SeriesPyramid pyramid;
+    initSeriesPyramid(&pyramid);
+    double begin = nowSeconds();
+    if (!buildSeriesPyramid(&pyramid, &series, fromKey, toKey)) return EXIT_FAILURE;
+    printf("Built %d levels over %zu rows in %.6f s\n", pyramid.levels, count, nowSeconds() - begin);
+
+    double queryTime = 0, scanTime = 0;
+    size_t points = 0;
+    for (size_t w = 0; w < windows; w++) {
+        // Windows from an hour to the whole year
+        uint64_t span = 3600 + (uint64_t)rand() * (toKey - fromKey) / RAND_MAX;
+        uint64_t start = fromKey + (uint64_t)rand() * (toKey - fromKey - span + 1) / RAND_MAX;
+        DataSeries view;
+        begin = nowSeconds();
+        queryPyramid(&pyramid, start, start + span, COLUMNS, &view);
+        queryTime += nowSeconds() - begin;
+        points += view.count;
+        scanTime += checkWindow(&pyramid, start, start + span, &view);
+        freeDataSeries(&view);
+    }
+    printf("%zu windows, %zu points: pyramid %.6f s, scan %.6f s, all columns match\n",
+        windows, points, queryTime, scanTime);
+    freeSeriesPyramid(&pyramid);
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Compares the old linked list insertion sort against sortDataByTimestamp.
+// Build with "make bench" and run ./build/bench/sortBench [max legacy rows]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "dataList.h"
+
+typedef struct LegacyNode {
+    DataValue data;
+    struct LegacyNode *next;
+} LegacyNode;
+
+void legacySortedInsert(LegacyNode **sorted, LegacyNode *newNode) {
+    if (*sorted == NULL || compareTimestamps(newNode->data.time, (*sorted)->data.time) <= 0) {
+        newNode->next = *sorted;
+        *sorted = newNode;
+    } else {
+        LegacyNode *current = *sorted;
+        while (current->next != NULL && compareTimestamps(newNode->data.time, current->next->data.time) > 0) {
+            current = current->next;
+        }
+        newNode->next = current->next;
+        current->next = newNode;
+    }
+}
+
+LegacyNode *legacySort(LegacyNode *list) {
+    LegacyNode *sorted = NULL;
+    while (list != NULL) {
+        LegacyNode *next = list->next;
+        list->next = NULL;
+        legacySortedInsert(&sorted, list);
+        list = next;
+    }
+    return sorted;
+}
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 10 second samples starting 2025-01-01, optionally shuffled
+void fillSeries(DataSeries *series, size_t count, int shuffle) {
+    reserveDataSeries(series, count);
+    series->count = 0;
+    struct tm base = {0};
+    base.tm_year = 125;
+    base.tm_mday = 1;
+    base.tm_isdst = -1;
+    time_t start = mktime(&base);
+    DataValue data;
+    memset(&data, 0, sizeof(data));
+    for (size_t i = 0; i < count; i++) {
+        time_t t = start + (time_t)i * 10;
+        struct tm *tm = localtime(&t);
+        data.time.year = tm->tm_year + 1900;
+        data.time.month = tm->tm_mon + 1;
+        data.time.day = tm->tm_mday;
+        data.time.hour = tm->tm_hour;
+        data.time.minute = tm->tm_min;
+        data.time.second = tm->tm_sec;
+        data.temperature = 20 + (i % 100) / 10.0;
+        data.humidity = 40 + (i % 50) / 10.0;
+        data.f_temperature = data.temperature * 9.0 / 5.0 + 32;
+        appendDataValue(series, &data);
+    }
+    if (!shuffle) return;
+    srand(1234);
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = (((size_t)rand() << 16) ^ (size_t)rand()) % (i + 1);
+        DataValue a, b;
+        getDataValue(series, i, &a);
+        getDataValue(series, j, &b);
+        setDataValue(series, i, &b);
+        setDataValue(series, j, &a);
+    }
+}
+
+double timeLegacy(DataSeries *series) {
+    LegacyNode *nodes = malloc(series->count * sizeof(LegacyNode));
+    for (size_t i = 0; i < series->count; i++) {
+        getDataValue(series, i, &nodes[i].data);
+        nodes[i].next = (i + 1 < series->count ? &nodes[i + 1] : NULL);
+    }
+    double begin = nowSeconds();
+    legacySort(nodes);
+    double elapsed = nowSeconds() - begin;
+    free(nodes);
+    return elapsed;
+}
+
+double timeSeries(DataSeries *series) {
+    double begin = nowSeconds();
+    sortDataByTimestamp(series);
+    double elapsed = nowSeconds() - begin;
+    if (!isSortedByTimestamp(series)) {
+        fprintf(stderr, "sortDataByTimestamp produced unsorted output\n");
+        exit(EXIT_FAILURE);
+    }
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    // The old sort is quadratic: 100000 shuffled rows already take minutes,
+    // so bigger runs have to be asked for.
+    size_t maxLegacy = (argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 10000);
+    size_t sizes[] = {10000, 100000, 1000000};
+
+    printf("%10s %10s %14s %14s\n", "rows", "input", "legacy (s)", "series (s)");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int shuffle = 0; shuffle <= 1; shuffle++) {
+            DataSeries series;
+            initDataSeries(&series);
+            fillSeries(&series, sizes[s], shuffle);
+
+            char legacy[32] = "skipped";
+            if (sizes[s] <= maxLegacy)
+                snprintf(legacy, sizeof(legacy), "%.6f", timeLegacy(&series));
+            double seriesTime = timeSeries(&series);
+
+            printf("%10zu %10s %14s %14.6f\n", sizes[s], (shuffle ? "shuffled" : "sorted"), legacy, seriesTime);
+            freeDataSeries(&series);
+        }
+    }
+    return 0;
+}
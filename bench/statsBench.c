@@ -0,0 +1,113 @@
+// Summarises a year of 10 second readings with the old separate scalar
+// passes and with the fused kernel, single threaded and across cores.
+// Build with "make bench" and run ./build/bench/statsBench [rows]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "seriesStats.h"
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// What listData and the old getMinMax graph range helpers did between them
+void legacySummary(const double *temperature, const double *humidity, size_t count, double out[6]) {
+    double averageTemp = 0, averageHum = 0;
+    double maxTemp = -INFINITY, maxHum = -INFINITY, minTemp = INFINITY, minHum = INFINITY;
+    for (size_t i = 0; i < count; i++) {
+        averageTemp += temperature[i];
+        averageHum += humidity[i];
+        if (temperature[i] > maxTemp) maxTemp = temperature[i];
+        if (humidity[i] > maxHum) maxHum = humidity[i];
+        if (temperature[i] < minTemp) minTemp = temperature[i];
+        if (humidity[i] < minHum) minHum = humidity[i];
+    }
+    double min = INFINITY, max = -INFINITY;
+    for (size_t i = 0; i < count; i++) {
+        int temp = temperature[i];
+        if (temp < min) min = temp;
+        if (temp > max) max = temp;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (humidity[i] < min) min = humidity[i];
+        if (humidity[i] > max) max = humidity[i];
+    }
+    out[0] = averageTemp / count;
+    out[1] = averageHum / count;
+    out[2] = minTemp < min ? minTemp : min;
+    out[3] = maxTemp > max ? maxTemp : max;
+    out[4] = minHum;
+    out[5] = maxHum;
+}
+
+int checkStats(const char *name, const SeriesStats *stats, const double *values, size_t count) {
+    long double sum = 0, squares = 0;
+    double min = INFINITY, max = -INFINITY;
+    for (size_t i = 0; i < count; i++) sum += values[i];
+    long double mean = sum / count;
+    for (size_t i = 0; i < count; i++) {
+        squares += (values[i] - mean) * (values[i] - mean);
+        if (values[i] < min) min = values[i];
+        if (values[i] > max) max = values[i];
+    }
+    double variance = (double)(squares / count);
+    int ok = stats->count == count && stats->min == min && stats->max == max &&
+        fabs(stats->mean - (double)mean) < 1e-9 && fabs(stats->variance - variance) < 1e-9 * (1 + variance);
+    if (!ok) printf("%s mismatch: mean %.12lf vs %.12Lf, variance %.12lf vs %.12lf\n",
+        name, stats->mean, mean, stats->variance, variance);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    size_t count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 365UL * 24 * 360);
+    double *temperature = malloc(count * sizeof(double));
+    double *humidity = malloc(count * sizeof(double));
+    if (temperature == NULL || humidity == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    unsigned int seed = 3;
+    for (size_t i = 0; i < count; i++) {
+        double phase = 2 * M_PI * (i % 8640) / 8640.0;
+        temperature[i] = 21 + 4 * sin(phase) + (rand_r(&seed) % 10) / 10.0;
+        humidity[i] = 55 - 10 * sin(phase) + (rand_r(&seed) % 10) / 10.0;
+    }
+
+    int repeats = 10;
+    double legacy[6];
+    double start = nowSeconds();
+    for (int r = 0; r < repeats; r++) legacySummary(temperature, humidity, count, legacy);
+    double legacyTime = (nowSeconds() - start) / repeats;
+
+    SeriesStats statsT, statsH;
+    start = nowSeconds();
+    for (int r = 0; r < repeats; r++) summarizeColumns(temperature, humidity, count, 1, &statsT, &statsH);
+    double singleTime = (nowSeconds() - start) / repeats;
+    int ok = checkStats("temperature (1 thread)", &statsT, temperature, count) &
+        checkStats("humidity (1 thread)", &statsH, humidity, count);
+
+    int threads = statsThreadCount(count);
+    start = nowSeconds();
+    for (int r = 0; r < repeats; r++) summarizeColumns(temperature, humidity, count, 0, &statsT, &statsH);
+    double parallelTime = (nowSeconds() - start) / repeats;
+    ok &= checkStats("temperature", &statsT, temperature, count) &
+        checkStats("humidity", &statsH, humidity, count);
+
+    // Forced slicing has to agree even on a single core machine
+    summarizeColumns(temperature, humidity, count, STATS_MAX_THREADS, &statsT, &statsH);
+    ok &= checkStats("temperature (sliced)", &statsT, temperature, count) &
+        checkStats("humidity (sliced)", &statsH, humidity, count);
+
+    printf("%zu rows (mean temperature %.3lf / %.3lf, humidity %.3lf / %.3lf)\n", count,
+        legacy[0], statsT.mean, legacy[1], statsH.mean);
+    printf("old scalar passes        %7.2lf ms\n", legacyTime * 1e3);
+    printf("fused kernel, 1 thread   %7.2lf ms\n", singleTime * 1e3);
+    printf("fused kernel, %d thread(s)%7.2lf ms\n", threads, parallelTime * 1e3);
+    printf("results %s\n", ok ? "match" : "DO NOT match");
+
+    free(temperature);
+    free(humidity);
+    return ok ? 0 : 1;
+}
@@ -1,11 +1,15 @@
 #ifndef DHT11_CONTROL_H
 #define DHT11_CONTROL_H
 
+#ifdef NO_WIRINGPI
+#include "wiringPiStub.h"
+#else
 #include <wiringPi.h>
+#endif
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <math.h>
+#include "fixedFormat.h"
 
 #define DHT11_MAX_TIME 85
 int DHT11PIN;
@@ -48,20 +52,17 @@ bool read_dht11_dat(int data[5]) {
     return true;
 }
 
-int digits(int value) {
-    int i = 0;
-    if (value == 0) return 1;
-    while (value > 0) {
-        value /= 10;
-        i++;
-    }
-    return i;
+// Thousandths, see decodeFixedReading
+void convertDataFixed(int data[5], int32_t *value1, int32_t *value2) {
+    *value1 = decodeFixedReading(data[0], data[1]);
+    *value2 = decodeFixedReading(data[2], data[3]);
 }
+
 void convertData(int data[5], double* value1, double* value2) {
-    *value1 = data[0];
-    *value1 += data[1] / pow(10, digits(data[1]));
-    *value2 = data[2];
-    *value2 += data[3] / pow(10, digits(data[3]));
+    int32_t fixed1, fixed2;
+    convertDataFixed(data, &fixed1, &fixed2);
+    *value1 = (double)fixed1 / FIXED_READING_SCALE;
+    *value2 = (double)fixed2 / FIXED_READING_SCALE;
 }
 
 #endif
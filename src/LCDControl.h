@@ -1,60 +1,136 @@
 #ifndef LDC_CONTROL_H
 #define LDC_CONTROL_H
 
+#ifdef NO_WIRINGPI
+#include "wiringPiStub.h"
+#else
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
+#endif
 #include <string.h>
 #include <time.h>
-#include <math.h>
+#include "fixedFormat.h"
 #include <stdlib.h>
+#include <stdio.h>
+
+#include <stdint.h>
+#include <unistd.h>
+
+// The LCD sits behind a PCF8574 I2C expander: each byte written sets the
+// four data lines (bits 7-4), EN (bit 2), RW (bit 1), RS (bit 0) and the
+// backlight (bit 3). A character is two nibbles, each latched by an EN
+// high -> low pair, so four bytes per character.
+//
+// Those bytes are queued and sent as one multi-byte I2C write. At 100kHz
+// each byte takes ~90us on the wire, which already exceeds the EN pulse
+// width and the ~37us the controller needs per instruction, so no sleeps
+// are needed except after clear. The screen contents are kept in a shadow
+// framebuffer and only cells that changed since the last refresh are sent.
+
+#define LCD_COLUMNS 16
+#define LCD_ROWS 2
+#define LCD_BATCH_SIZE 256
+// Clear and home take 1.52ms to execute
+#define LCD_CLEAR_US 2000
+
+struct lcdTransport {
+    // Sends count bytes in one I2C write. Returns 1 on success.
+    int (*write)(struct lcdTransport *transport, const unsigned char *bytes, size_t count);
+    void *context;
+};
+typedef struct lcdTransport LCDTransport;
+
+struct lcdDisplay {
+    LCDTransport *transport;
+    // What callers want on screen and what the controller currently holds
+    char frame[LCD_ROWS][LCD_COLUMNS];
+    char shown[LCD_ROWS][LCD_COLUMNS];
+    // DDRAM address the next data write lands on, -1 if unknown
+    int cursor;
+    unsigned char batch[LCD_BATCH_SIZE];
+    size_t length;
+    uint64_t refreshes;
+    uint64_t cellsSent;
+    uint64_t bytesSent;
+    uint64_t transfers;
+    uint64_t lastRefreshUs;
+    uint64_t maxRefreshUs;
+};
+typedef struct lcdDisplay LCDDisplay;
 
 int LCDAddr;
 int BLEN = 1;
 int fd;
+LCDDisplay lcd;
+
+int i2cTransportWrite(LCDTransport *transport, const unsigned char *bytes, size_t count) {
+    return write(*(int*)transport->context, bytes, count) == (ssize_t)count;
+}
+
+LCDTransport i2cTransport = { i2cTransportWrite, &fd };
+
+int lcdFlush(LCDDisplay *display) {
+    if (display->length == 0) return 1;
+    int ok = display->transport->write(display->transport, display->batch, display->length);
+    display->transfers++;
+    display->bytesSent += display->length;
+    display->length = 0;
+    if (!ok) {
+        // The controller state is unknown now; redraw everything next time
+        memset(display->shown, 0, sizeof(display->shown));
+        display->cursor = -1;
+    }
+    return ok;
+}
 
-void write_word(int data) {
-    int temp = data;
-    if (BLEN == 1) temp |= 0x08;
-    else temp &= 0xF7;
-    wiringPiI2CWrite(fd, temp);
+// Queues one byte as two EN strobed nibbles. rs is 0 for a command, 1 for data.
+void lcdQueue(LCDDisplay *display, int value, int rs) {
+    if (display->length + 4 > LCD_BATCH_SIZE) lcdFlush(display);
+    int flags = rs | (BLEN == 1 ? 0x08 : 0);
+    int high = (value & 0xF0) | flags;
+    int low = ((value & 0x0F) << 4) | flags;
+    unsigned char *out = display->batch + display->length;
+    out[0] = high | 0x04; // EN = 1
+    out[1] = high;        // EN = 0 latches the nibble
+    out[2] = low | 0x04;
+    out[3] = low;
+    display->length += 4;
 }
 
 void send_command(int comm) {
-    int buf;
-    // Send bit7-4 firstly
-    buf = comm & 0xF0;
-    buf |= 0x04; // RS = 0, RW = 0, EN = 1
-    write_word(buf);
-    delay(2);
-    buf &= 0xFB; // Make EN = 0
-    write_word(buf);
-
-    // Send bit3-0 secondly
-    buf = (comm & 0x0F) << 4;
-    buf |= 0x04; // RS = 0, RW = 0, EN = 1
-    write_word(buf);
-    delay(2);
-    buf &= 0xFB; // Make EN = 0
-    write_word(buf);
+    lcdQueue(&lcd, comm, 0);
+    lcdFlush(&lcd);
 }
 
 void send_data(int data) {
-    int buf;
-    // Send bit7-4 firstly
-    buf = data & 0xF0;
-    buf |= 0x05; // RS = 1, RW = 0, EN = 1
-    write_word(buf);
-    delay(2);
-    buf &= 0xFB; // Make EN = 0
-    write_word(buf);
-
-    // Send bit3-0 secondly
-    buf = (data & 0x0F) << 4;
-    buf |= 0x05; // RS = 1, RW = 0, EN = 1
-    write_word(buf);
-    delay(2);
-    buf &= 0xFB; // Make EN = 0
-    write_word(buf);
+    lcdQueue(&lcd, data, 1);
+    lcdFlush(&lcd);
+}
+
+void clearDisplay(LCDDisplay *display) {
+    lcdQueue(display, 0x01, 0);
+    lcdFlush(display);
+    delayMicroseconds(LCD_CLEAR_US);
+    memset(display->frame, ' ', sizeof(display->frame));
+    memset(display->shown, ' ', sizeof(display->shown));
+    display->cursor = 0;
+}
+
+int initDisplay(LCDDisplay *display, LCDTransport *transport) {
+    memset(display, 0, sizeof(*display));
+    display->transport = transport;
+    display->cursor = -1;
+
+    // Must initialize to 8-line mode at first, then 4-line mode. Each step
+    // is sent on its own so the controller gets its 5ms between them.
+    int init[] = { 0x33, 0x32, 0x28, 0x0C };
+    for (size_t i = 0; i < sizeof(init) / sizeof(init[0]); i++) {
+        lcdQueue(display, init[i], 0);
+        if (!lcdFlush(display)) return 0;
+        delay(5);
+    }
+    clearDisplay(display);
+    return display->cursor == 0;
 }
 
 int lcd_init(int address) {
@@ -62,90 +138,80 @@ int lcd_init(int address) {
     fd = wiringPiI2CSetup(LCDAddr);
     if (fd == -1)
         return 0;
-    
-    send_command(0x33); // Must initialize to 8-line mode at first
-    delay(5);
-    send_command(0x32); // Then initialize to 4-line mode
-    delay(5);
-    send_command(0x28); // 2 Lines & 5*7 dots
-    delay(5);
-    send_command(0x0C); // Enable display without cursor
-    delay(5);
-    send_command(0x01); // Clear Screen
-    wiringPiI2CWrite(fd, 0x08);
-    return 1;
+    return initDisplay(&lcd, &i2cTransport);
 }
 
-void clear() { send_command(0x01); /*clear Screen*/ }
+void clear() { clearDisplay(&lcd); }
 
-void writeRegister(int x, int y, char data[]) {
-    int addr, i;
-    int tmp;
+// Places text in the framebuffer without sending anything
+void setDisplayText(LCDDisplay *display, int x, int y, const char *data) {
     if (x < 0) x = 0;
-    if (x > 15) x = 15;
+    if (x > LCD_COLUMNS - 1) x = LCD_COLUMNS - 1;
     if (y < 0) y = 0;
-    if (y > 1) y = 1;
+    if (y > LCD_ROWS - 1) y = LCD_ROWS - 1;
+    for (; *data != '\0' && x < LCD_COLUMNS; data++, x++)
+        display->frame[y][x] = *data;
+}
 
-    // Move cursor
-    addr = 0x80 + 0x40 * y + x;
-    send_command(addr);
+uint64_t displayClockUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
 
-    tmp = strlen(data);
-    for (i = 0; i < tmp; i++)
-        send_data(data[i]);
+// Sends the cells that differ from what the controller holds, moving the
+// cursor only where a run of changed cells starts.
+int refreshDisplay(LCDDisplay *display) {
+    uint64_t start = displayClockUs();
+    for (int y = 0; y < LCD_ROWS; y++) {
+        for (int x = 0; x < LCD_COLUMNS; x++) {
+            char cell = display->frame[y][x];
+            if (cell == display->shown[y][x]) continue;
+            int addr = 0x40 * y + x;
+            if (display->cursor != addr) lcdQueue(display, 0x80 | addr, 0);
+            lcdQueue(display, (unsigned char)cell, 1);
+            display->shown[y][x] = cell;
+            display->cursor = addr + 1;
+            display->cellsSent++;
+        }
+    }
+    int ok = lcdFlush(display);
+    display->refreshes++;
+    display->lastRefreshUs = displayClockUs() - start;
+    if (display->lastRefreshUs > display->maxRefreshUs) display->maxRefreshUs = display->lastRefreshUs;
+    return ok;
 }
 
-char* getDoubleString(double input, unsigned int length) {
-	if (length == 0) return NULL;
-	unsigned int decimalPlace = length + 1;
-	int divisor = pow(10, length);
-	int outsideBounds = 0;
-	
-	if (input < 1) {
-		decimalPlace = 1;
-		input *= divisor;
-	}
-	else if (input > divisor * 10) {
-		outsideBounds = 1;
-		while (input > divisor * 10) {
-			input /= 10;
-		}
-	}
-	else while (input < divisor) {
-		input *= 10; decimalPlace--;
-	}
-	
-	char *output = (char*)malloc((length + 2) * sizeof(char));
-	
-	int converted = (int)input;
-	unsigned int i = 0;
-	while (divisor > 0) {
-		if (i >= length) break;
-		if (i == decimalPlace) output[i++] = '.';
-		
-		int digit = converted / divisor;
-		output[i++] = '0' + digit;
-		
-		converted = converted % divisor;
-		divisor /= 10;
-	}
-	if (outsideBounds) output[i - 1] = 'E';
-	output[i] = '\0';
-	
-	return output;
+void printDisplayStats(LCDDisplay *display) {
+    printf("\tLCD: %llu refreshes, %llu cells, %llu bytes in %llu writes, last %lluus, max %lluus\n",
+        (unsigned long long)display->refreshes, (unsigned long long)display->cellsSent,
+        (unsigned long long)display->bytesSent, (unsigned long long)display->transfers,
+        (unsigned long long)display->lastRefreshUs, (unsigned long long)display->maxRefreshUs);
 }
 
-void writeData(double temperature, double humidity, time_t time) {
-    writeRegister(0, 0, "temp humi time");
-    
-    char* temp = getDoubleString(temperature, 4);
-    char* hum = getDoubleString(humidity, 4);
-    writeRegister(0, 1, temp);
-    writeRegister(5, 1, hum);
+void writeRegister(int x, int y, char data[]) {
+    setDisplayText(&lcd, x, y, data);
+    refreshDisplay(&lcd);
+}
+
+void writeDisplayData(LCDDisplay *display, double temperature, double humidity, time_t time) {
+    setDisplayText(display, 0, 0, "temp humi time");
+
+    char temp[8], hum[8];
+    formatFitted(temp, temperature, 4);
+    formatFitted(hum, humidity, 4);
+    setDisplayText(display, 0, 1, temp);
+    setDisplayText(display, 5, 1, hum);
 
 	char timeString[6];
-    strftime(timeString, sizeof(timeString), "%H:%M", localtime(&time));
-    writeRegister(10, 1, timeString);
+    struct tm local;
+    strftime(timeString, sizeof(timeString), "%H:%M", localtime_r(&time, &local));
+    setDisplayText(display, 10, 1, timeString);
+    refreshDisplay(display);
+}
+
+void writeData(double temperature, double humidity, time_t time) {
+    writeDisplayData(&lcd, temperature, humidity, time);
 }
 
 #endif
@@ -0,0 +1,650 @@
+#ifndef CHART_RENDER_H
+#define CHART_RENDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "dataList.h"
+#include "seriesStats.h"
+#include "pngWriter.h"
+
+// What a Graph draws, independent of how: the rows as records of doubles
+// (time, temperature, humidity and, for buckets, the temperature and
+// humidity min and max), the plot elements and the axis ranges. The
+// gnuplot session draws it on screen; renderChartPng and renderChartSvg
+// draw the same chart into files with no gnuplot and no display, each on
+// its own buffers so charts can be rendered on several threads at once.
+
+enum PlotType { BOTH = 0, TEMPERATURE = 1, HUMIDITY = 2 };
+
+// Record columns
+#define CHART_TIME 0
+#define CHART_TEMPERATURE 1
+#define CHART_HUMIDITY 2
+#define CHART_TEMPERATURE_MIN 3
+#define CHART_TEMPERATURE_MAX 4
+#define CHART_HUMIDITY_MIN 5
+#define CHART_HUMIDITY_MAX 6
+
+enum ChartColor {
+    BACKGROUND_COLOR = 0, INK_COLOR, GRID_COLOR, TEMPERATURE_COLOR, HUMIDITY_COLOR,
+    // The bands are their line colour at 25% over the background, and where
+    // they overlap, humidity at 25% over the temperature band
+    TEMPERATURE_BAND_COLOR, HUMIDITY_BAND_COLOR, BOTH_BANDS_COLOR, CHART_COLORS
+};
+
+const unsigned char chartPalette[CHART_COLORS * 3] = {
+    255, 255, 255,
+    0, 0, 0,
+    224, 224, 224,
+    148, 0, 211,
+    0, 158, 115,
+    228, 191, 244,
+    191, 231, 220,
+    171, 183, 212
+};
+
+struct chartData {
+    double *records;
+    size_t count;
+    // 3 for rows, 7 for buckets
+    size_t columns;
+    enum PlotType type;
+    int fahrenheit;
+    // Axis ranges: wall clock seconds (see plotSeconds) and readings
+    double fromSeconds;
+    double toSeconds;
+    double min;
+    double max;
+};
+typedef struct chartData ChartData;
+
+// A line of one column or, when highColumn is set, the band between two
+struct chartElement {
+    const char *title;
+    int column;
+    int lowColumn;
+    int highColumn;
+    enum ChartColor color;
+};
+typedef struct chartElement ChartElement;
+
+// Wall clock seconds since 1970-01-01 00:00:00 of the MYSQL_TIME. Drawn
+// as UTC they show the local time the row was taken.
+double plotSeconds(const MYSQL_TIME *time) {
+    MYSQL_TIME epoch;
+    memset(&epoch, 0, sizeof(epoch));
+    epoch.year = 1970;
+    epoch.month = 1;
+    epoch.day = 1;
+    return (double)timestampKey(time) - (double)timestampKey(&epoch);
+}
+
+void initChartData(ChartData *chart) {
+    memset(chart, 0, sizeof(*chart));
+}
+
+void freeChartData(ChartData *chart) {
+    free(chart->records);
+    initChartData(chart);
+}
+
+// The series must be in time order
+int buildChartData(const DataSeries *series, double fromSeconds, double toSeconds, enum PlotType type,
+    int fahrenheit, ChartData *chart) {
+    initChartData(chart);
+    chart->columns = (series->aggregated ? 7 : 3);
+    chart->records = malloc((series->count > 0 ? series->count : 1) * chart->columns * sizeof(double));
+    if (chart->records == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    chart->count = series->count;
+    chart->type = type;
+    chart->fahrenheit = fahrenheit;
+    chart->fromSeconds = fromSeconds;
+    chart->toSeconds = toSeconds;
+
+    const double *temperature = (fahrenheit ? series->f_temperature : series->temperature);
+    double min = INFINITY, max = -INFINITY;
+    for (size_t i = 0; i < series->count; i++) {
+        double *record = chart->records + i * chart->columns;
+        double temperatureMin = temperature[i], temperatureMax = temperature[i];
+        double humidityMin = series->humidity[i], humidityMax = series->humidity[i];
+        if (series->aggregated) {
+            temperatureMin = series->temperatureMin[i];
+            temperatureMax = series->temperatureMax[i];
+            if (fahrenheit) {
+                temperatureMin = celsiusToFahrenheit(temperatureMin);
+                temperatureMax = celsiusToFahrenheit(temperatureMax);
+            }
+            humidityMin = series->humidityMin[i];
+            humidityMax = series->humidityMax[i];
+            record[CHART_TEMPERATURE_MIN] = temperatureMin;
+            record[CHART_TEMPERATURE_MAX] = temperatureMax;
+            record[CHART_HUMIDITY_MIN] = humidityMin;
+            record[CHART_HUMIDITY_MAX] = humidityMax;
+        }
+        record[CHART_TIME] = plotSeconds(&series->time[i]);
+        record[CHART_TEMPERATURE] = temperature[i];
+        record[CHART_HUMIDITY] = series->humidity[i];
+        if (type != HUMIDITY) {
+            min = fmin(min, temperatureMin);
+            max = fmax(max, temperatureMax);
+        }
+        if (type != TEMPERATURE) {
+            min = fmin(min, humidityMin);
+            max = fmax(max, humidityMax);
+        }
+    }
+    if (series->count == 0) {
+        min = 0;
+        max = 100;
+    }
+    double buffer = 2.0;
+    padRange(&min, &max, buffer);
+    chart->min = min - buffer;
+    chart->max = max + buffer;
+    return 1;
+}
+
+// In drawing order, bands under their lines
+int chartElements(const ChartData *chart, ChartElement elements[4]) {
+    int count = 0;
+    int aggregated = (chart->columns == 7);
+    if (chart->type != HUMIDITY) {
+        if (aggregated)
+            elements[count++] = (ChartElement){ "Temperature min - max", 0, CHART_TEMPERATURE_MIN,
+                CHART_TEMPERATURE_MAX, TEMPERATURE_BAND_COLOR };
+        elements[count++] = (ChartElement){ "Temperature", CHART_TEMPERATURE, 0, 0, TEMPERATURE_COLOR };
+    }
+    if (chart->type != TEMPERATURE) {
+        if (aggregated)
+            elements[count++] = (ChartElement){ "Humidity min - max", 0, CHART_HUMIDITY_MIN,
+                CHART_HUMIDITY_MAX, HUMIDITY_BAND_COLOR };
+        elements[count++] = (ChartElement){ "Humidity", CHART_HUMIDITY, 0, 0, HUMIDITY_COLOR };
+    }
+    return count;
+}
+
+void chartYLabel(const ChartData *chart, char *out, size_t size) {
+    const char *unit = (chart->fahrenheit ? "F" : "C");
+    if (chart->type == HUMIDITY) snprintf(out, size, "Humidity");
+    else if (chart->type == TEMPERATURE) snprintf(out, size, "Temperature (%s)", unit);
+    else snprintf(out, size, "Temperature (%s) / Humidity", unit);
+}
+
+// Plot area inside the image, in pixels
+struct chartLayout {
+    double left;
+    double top;
+    double right;
+    double bottom;
+};
+typedef struct chartLayout ChartLayout;
+
+void layoutChart(unsigned int width, unsigned int height, ChartLayout *layout) {
+    layout->left = 80;
+    layout->top = 40;
+    layout->right = (width > 110 ? width - 30 : width);
+    layout->bottom = (height > 100 ? height - 60 : height);
+}
+
+double chartX(const ChartData *chart, const ChartLayout *layout, double seconds) {
+    double span = chart->toSeconds - chart->fromSeconds;
+    if (span <= 0) span = 1;
+    return layout->left + (seconds - chart->fromSeconds) / span * (layout->right - layout->left);
+}
+
+double chartY(const ChartData *chart, const ChartLayout *layout, double value) {
+    return layout->bottom - (value - chart->min) / (chart->max - chart->min) * (layout->bottom - layout->top);
+}
+
+// 1, 2 or 5 times a power of ten giving about `ticks` ticks
+double chartValueStep(double span, int ticks) {
+    double raw = span / ticks;
+    double magnitude = pow(10, floor(log10(raw)));
+    double ratio = raw / magnitude;
+    return (ratio < 1.5 ? 1 : ratio < 3.5 ? 2 : ratio < 7.5 ? 5 : 10) * magnitude;
+}
+
+double chartTimeStep(double span, int ticks) {
+    static const double steps[] = { 60, 120, 300, 600, 900, 1800, 3600, 7200, 10800, 21600, 43200,
+        86400, 172800, 604800, 1209600, 2592000, 7776000, 31536000 };
+    size_t count = sizeof(steps) / sizeof(steps[0]);
+    for (size_t i = 0; i < count; i++)
+        if (span / steps[i] <= ticks) return steps[i];
+    return steps[count - 1];
+}
+
+void formatTimeTick(double seconds, double step, char *out, size_t size) {
+    time_t t = (time_t)seconds;
+    struct tm civil;
+    gmtime_r(&t, &civil);
+    strftime(out, size, (step < 86400 ? "%H:%M" : "%m-%d"), &civil);
+}
+
+void formatValueTick(double value, double step, char *out, size_t size) {
+    int decimals = (step >= 1 ? 0 : (int)ceil(-log10(step)));
+    snprintf(out, size, "%.*f", decimals, (fabs(value) < step / 2 ? 0.0 : value));
+}
+
+// Points are drawn only while they stay apart, as with gnuplot's linespoints
+// they would merge into a thick line otherwise
+int chartDrawsPoints(const ChartData *chart, const ChartLayout *layout) {
+    return chart->columns == 3 && chart->count * 8 <= (size_t)(layout->right - layout->left);
+}
+
+// 5 x 7 glyphs for ' ' to '~', one byte per row, highest of 5 bits leftmost
+const unsigned char chartFont[95][7] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x06, 0x04, 0x08 }, // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+    { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // _
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F }, // a
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E }, // b
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E }, // c
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F }, // d
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E }, // e
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 }, // f
+    { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // g
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 }, // h
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E }, // i
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C }, // j
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 }, // k
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // l
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11 }, // m
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 }, // n
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E }, // o
+    { 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10 }, // p
+    { 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01 }, // q
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 }, // r
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E }, // s
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 }, // t
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D }, // u
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // v
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A }, // w
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 }, // x
+    { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // y
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F }, // z
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+struct chartCanvas {
+    unsigned int width;
+    unsigned int height;
+    unsigned char *pixels;
+    // Data is only drawn inside this box
+    int clipLeft;
+    int clipTop;
+    int clipRight;
+    int clipBottom;
+};
+typedef struct chartCanvas ChartCanvas;
+
+void setChartPixel(ChartCanvas *canvas, int x, int y, unsigned char color) {
+    if (x < canvas->clipLeft || x > canvas->clipRight || y < canvas->clipTop || y > canvas->clipBottom) return;
+    canvas->pixels[(size_t)y * canvas->width + x] = color;
+}
+
+void clipChartCanvas(ChartCanvas *canvas, int left, int top, int right, int bottom) {
+    canvas->clipLeft = (left > 0 ? left : 0);
+    canvas->clipTop = (top > 0 ? top : 0);
+    canvas->clipRight = (right < (int)canvas->width - 1 ? right : (int)canvas->width - 1);
+    canvas->clipBottom = (bottom < (int)canvas->height - 1 ? bottom : (int)canvas->height - 1);
+}
+
+void fillChartRect(ChartCanvas *canvas, int x0, int y0, int x1, int y1, unsigned char color) {
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++) setChartPixel(canvas, x, y, color);
+}
+
+// Bresenham, with a thickness by thickness pen
+void drawChartLine(ChartCanvas *canvas, double fx0, double fy0, double fx1, double fy1, int thickness,
+    unsigned char color) {
+    int x0 = (int)lround(fx0), y0 = (int)lround(fy0), x1 = (int)lround(fx1), y1 = (int)lround(fy1);
+    int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+    int sx = (x0 < x1 ? 1 : -1), sy = (y0 < y1 ? 1 : -1);
+    int error = dx + dy;
+    while (1) {
+        fillChartRect(canvas, x0, y0, x0 + thickness - 1, y0 + thickness - 1, color);
+        if (x0 == x1 && y0 == y1) break;
+        int twice = 2 * error;
+        if (twice >= dy) {
+            error += dy;
+            x0 += sx;
+        }
+        if (twice <= dx) {
+            error += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void fillChartDisc(ChartCanvas *canvas, double fx, double fy, int radius, unsigned char color) {
+    int cx = (int)lround(fx), cy = (int)lround(fy);
+    for (int y = -radius; y <= radius; y++)
+        for (int x = -radius; x <= radius; x++)
+            if (x * x + y * y <= radius * radius) setChartPixel(canvas, cx + x, cy + y, color);
+}
+
+// One pixel column of a band; a pixel already in the other band turns into
+// the colour of both
+void fillBandColumn(ChartCanvas *canvas, int x, double fy0, double fy1, unsigned char color) {
+    int y0 = (int)lround(fmin(fy0, fy1)), y1 = (int)lround(fmax(fy0, fy1));
+    if (x < canvas->clipLeft || x > canvas->clipRight) return;
+    if (y0 < canvas->clipTop) y0 = canvas->clipTop;
+    if (y1 > canvas->clipBottom) y1 = canvas->clipBottom;
+    for (int y = y0; y <= y1; y++) {
+        unsigned char *pixel = &canvas->pixels[(size_t)y * canvas->width + x];
+        if (*pixel == color || *pixel == BOTH_BANDS_COLOR) continue;
+        if (*pixel == TEMPERATURE_BAND_COLOR || *pixel == HUMIDITY_BAND_COLOR) *pixel = BOTH_BANDS_COLOR;
+        else *pixel = color;
+    }
+}
+
+int chartTextWidth(const char *text, int scale) {
+    int length = (int)strlen(text);
+    return (length > 0 ? (6 * length - 1) * scale : 0);
+}
+
+// x, y is the top left corner. With up set the text runs bottom to top
+// from x, y as its bottom left corner.
+void drawChartText(ChartCanvas *canvas, int x, int y, const char *text, int scale, int up, unsigned char color) {
+    for (int i = 0; text[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)text[i];
+        const unsigned char *glyph = chartFont[(c >= 32 && c < 127 ? c - 32 : 0)];
+        for (int row = 0; row < 7; row++)
+            for (int column = 0; column < 5; column++) {
+                if (!(glyph[row] & (0x10 >> column))) continue;
+                int gx = (i * 6 + column) * scale, gy = row * scale;
+                for (int a = 0; a < scale; a++)
+                    for (int b = 0; b < scale; b++) {
+                        if (up) setChartPixel(canvas, x + gy + b, y - gx - a, color);
+                        else setChartPixel(canvas, x + gx + a, y + gy + b, color);
+                    }
+            }
+    }
+}
+
+int renderChartPng(const ChartData *chart, unsigned int width, unsigned int height, const char *title,
+    const char *path) {
+    ChartCanvas canvas;
+    canvas.width = width;
+    canvas.height = height;
+    canvas.pixels = malloc((size_t)width * height);
+    if (canvas.pixels == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    memset(canvas.pixels, BACKGROUND_COLOR, (size_t)width * height);
+    ChartLayout layout;
+    layoutChart(width, height, &layout);
+    int left = (int)layout.left, top = (int)layout.top, right = (int)layout.right, bottom = (int)layout.bottom;
+    char label[64];
+
+    // Grid and ticks
+    clipChartCanvas(&canvas, 0, 0, width - 1, height - 1);
+    double valueStep = chartValueStep(chart->max - chart->min, 8);
+    for (double value = ceil(chart->min / valueStep) * valueStep; value <= chart->max; value += valueStep) {
+        int y = (int)lround(chartY(chart, &layout, value));
+        fillChartRect(&canvas, left, y, right, y, GRID_COLOR);
+        fillChartRect(&canvas, left - 5, y, left, y, INK_COLOR);
+        formatValueTick(value, valueStep, label, sizeof(label));
+        drawChartText(&canvas, left - 8 - chartTextWidth(label, 2), y - 7, label, 2, 0, INK_COLOR);
+    }
+    double timeStep = chartTimeStep(chart->toSeconds - chart->fromSeconds, 8);
+    for (double seconds = ceil(chart->fromSeconds / timeStep) * timeStep; seconds <= chart->toSeconds;
+        seconds += timeStep) {
+        int x = (int)lround(chartX(chart, &layout, seconds));
+        fillChartRect(&canvas, x, top, x, bottom, GRID_COLOR);
+        fillChartRect(&canvas, x, bottom, x, bottom + 5, INK_COLOR);
+        formatTimeTick(seconds, timeStep, label, sizeof(label));
+        drawChartText(&canvas, x - chartTextWidth(label, 2) / 2, bottom + 9, label, 2, 0, INK_COLOR);
+    }
+
+    // Data
+    clipChartCanvas(&canvas, left + 1, top + 1, right - 1, bottom - 1);
+    ChartElement elements[4];
+    int elementCount = chartElements(chart, elements);
+    int points = chartDrawsPoints(chart, &layout);
+    const size_t columns = chart->columns;
+    for (int e = 0; e < elementCount; e++) {
+        const ChartElement *element = &elements[e];
+        for (size_t i = 0; i + 1 < chart->count || (i == 0 && chart->count == 1); i++) {
+            const double *a = chart->records + i * columns;
+            const double *b = (i + 1 < chart->count ? a + columns : a);
+            double x0 = chartX(chart, &layout, a[CHART_TIME]), x1 = chartX(chart, &layout, b[CHART_TIME]);
+            if (element->highColumn == 0) {
+                drawChartLine(&canvas, x0, chartY(chart, &layout, a[element->column]),
+                    x1, chartY(chart, &layout, b[element->column]), 2, element->color);
+                continue;
+            }
+            // Rounded ends, so buckets closer than a pixel still cover every column
+            for (int x = (int)lround(x0); x <= (int)lround(x1); x++) {
+                double t = (x1 > x0 ? (x - x0) / (x1 - x0) : 0);
+                double low = a[element->lowColumn] + t * (b[element->lowColumn] - a[element->lowColumn]);
+                double high = a[element->highColumn] + t * (b[element->highColumn] - a[element->highColumn]);
+                fillBandColumn(&canvas, x, chartY(chart, &layout, low), chartY(chart, &layout, high), element->color);
+            }
+        }
+        if (points && element->highColumn == 0)
+            for (size_t i = 0; i < chart->count; i++) {
+                const double *record = chart->records + i * columns;
+                fillChartDisc(&canvas, chartX(chart, &layout, record[CHART_TIME]),
+                    chartY(chart, &layout, record[element->column]), 3, element->color);
+            }
+    }
+
+    // Frame, labels and key
+    clipChartCanvas(&canvas, 0, 0, width - 1, height - 1);
+    fillChartRect(&canvas, left, top, right, top, INK_COLOR);
+    fillChartRect(&canvas, left, bottom, right, bottom, INK_COLOR);
+    fillChartRect(&canvas, left, top, left, bottom, INK_COLOR);
+    fillChartRect(&canvas, right, top, right, bottom, INK_COLOR);
+    if (title != NULL)
+        drawChartText(&canvas, (int)(width - chartTextWidth(title, 2)) / 2, 12, title, 2, 0, INK_COLOR);
+    drawChartText(&canvas, (left + right - chartTextWidth("Time", 2)) / 2, bottom + 32, "Time", 2, 0, INK_COLOR);
+    chartYLabel(chart, label, sizeof(label));
+    drawChartText(&canvas, 8, (top + bottom + chartTextWidth(label, 2)) / 2, label, 2, 1, INK_COLOR);
+    int keyWidth = 0;
+    for (int e = 0; e < elementCount; e++)
+        if (chartTextWidth(elements[e].title, 2) > keyWidth) keyWidth = chartTextWidth(elements[e].title, 2);
+    if (elementCount > 0) {
+        int keyLeft = right - 12 - keyWidth - 46, keyBottom = top + 10 + elementCount * 18;
+        fillChartRect(&canvas, keyLeft, top + 4, right - 4, keyBottom, BACKGROUND_COLOR);
+        fillChartRect(&canvas, keyLeft, top + 4, right - 4, top + 4, INK_COLOR);
+        fillChartRect(&canvas, keyLeft, keyBottom, right - 4, keyBottom, INK_COLOR);
+        fillChartRect(&canvas, keyLeft, top + 4, keyLeft, keyBottom, INK_COLOR);
+        fillChartRect(&canvas, right - 4, top + 4, right - 4, keyBottom, INK_COLOR);
+    }
+    for (int e = 0; e < elementCount; e++) {
+        int y = top + 10 + e * 18;
+        int textX = right - 12 - chartTextWidth(elements[e].title, 2);
+        drawChartText(&canvas, textX, y, elements[e].title, 2, 0, INK_COLOR);
+        if (elements[e].highColumn == 0) fillChartRect(&canvas, textX - 38, y + 6, textX - 8, y + 7, elements[e].color);
+        else fillChartRect(&canvas, textX - 38, y + 1, textX - 8, y + 12, elements[e].color);
+    }
+
+    int result = writePng(path, width, height, canvas.pixels, chartPalette, CHART_COLORS);
+    free(canvas.pixels);
+    return result;
+}
+
+void svgColor(enum ChartColor color, char out[8]) {
+    snprintf(out, 8, "#%02x%02x%02x", chartPalette[color * 3], chartPalette[color * 3 + 1], chartPalette[color * 3 + 2]);
+}
+
+// Same layout as renderChartPng; bands are drawn in their line colour at
+// 25% opacity so they blend where they overlap
+int renderChartSvg(const ChartData *chart, unsigned int width, unsigned int height, const char *title,
+    const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to create \"%s\"\n", path);
+        return 0;
+    }
+    ChartLayout layout;
+    layoutChart(width, height, &layout);
+    double left = layout.left, top = layout.top, right = layout.right, bottom = layout.bottom;
+    char label[64], color[8], grid[8];
+    svgColor(GRID_COLOR, grid);
+
+    fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" height=\"%u\" viewBox=\"0 0 %u %u\" "
+        "font-family=\"sans-serif\" font-size=\"13\">\n", width, height, width, height);
+    fprintf(file, "<rect width=\"100%%\" height=\"100%%\" fill=\"#ffffff\"/>\n");
+    fprintf(file, "<clipPath id=\"plot\"><rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%.1f\"/></clipPath>\n",
+        left, top, right - left, bottom - top);
+
+    double valueStep = chartValueStep(chart->max - chart->min, 8);
+    for (double value = ceil(chart->min / valueStep) * valueStep; value <= chart->max; value += valueStep) {
+        double y = chartY(chart, &layout, value);
+        formatValueTick(value, valueStep, label, sizeof(label));
+        fprintf(file, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"%s\"/>\n", left, y, right, y, grid);
+        fprintf(file, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"end\">%s</text>\n", left - 8, y + 4, label);
+    }
+    double timeStep = chartTimeStep(chart->toSeconds - chart->fromSeconds, 8);
+    for (double seconds = ceil(chart->fromSeconds / timeStep) * timeStep; seconds <= chart->toSeconds;
+        seconds += timeStep) {
+        double x = chartX(chart, &layout, seconds);
+        formatTimeTick(seconds, timeStep, label, sizeof(label));
+        fprintf(file, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"%s\"/>\n", x, top, x, bottom, grid);
+        fprintf(file, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\">%s</text>\n", x, bottom + 20, label);
+    }
+
+    ChartElement elements[4];
+    int elementCount = chartElements(chart, elements);
+    int points = chartDrawsPoints(chart, &layout);
+    const size_t columns = chart->columns;
+    fprintf(file, "<g clip-path=\"url(#plot)\">\n");
+    for (int e = 0; e < elementCount; e++) {
+        const ChartElement *element = &elements[e];
+        if (element->highColumn != 0) {
+            // The band is a line drawn out along the highs and back along the lows
+            svgColor(element->color == TEMPERATURE_BAND_COLOR ? TEMPERATURE_COLOR : HUMIDITY_COLOR, color);
+            fprintf(file, "<polygon fill=\"%s\" fill-opacity=\"0.25\" points=\"", color);
+            for (size_t i = 0; i < chart->count; i++) {
+                const double *record = chart->records + i * columns;
+                fprintf(file, "%.1f,%.1f ", chartX(chart, &layout, record[CHART_TIME]),
+                    chartY(chart, &layout, record[element->highColumn]));
+            }
+            for (size_t i = chart->count; i-- > 0; ) {
+                const double *record = chart->records + i * columns;
+                fprintf(file, "%.1f,%.1f ", chartX(chart, &layout, record[CHART_TIME]),
+                    chartY(chart, &layout, record[element->lowColumn]));
+            }
+            fprintf(file, "\"/>\n");
+            continue;
+        }
+        svgColor(element->color, color);
+        fprintf(file, "<polyline fill=\"none\" stroke=\"%s\" stroke-width=\"2\" points=\"", color);
+        for (size_t i = 0; i < chart->count; i++) {
+            const double *record = chart->records + i * columns;
+            fprintf(file, "%.1f,%.1f ", chartX(chart, &layout, record[CHART_TIME]),
+                chartY(chart, &layout, record[element->column]));
+        }
+        fprintf(file, "\"/>\n");
+        if (points)
+            for (size_t i = 0; i < chart->count; i++) {
+                const double *record = chart->records + i * columns;
+                fprintf(file, "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"3.5\" fill=\"%s\"/>\n",
+                    chartX(chart, &layout, record[CHART_TIME]), chartY(chart, &layout, record[element->column]), color);
+            }
+    }
+    fprintf(file, "</g>\n");
+
+    fprintf(file, "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%.1f\" fill=\"none\" stroke=\"#000000\"/>\n",
+        left, top, right - left, bottom - top);
+    if (title != NULL)
+        fprintf(file, "<text x=\"%.1f\" y=\"24\" text-anchor=\"middle\" font-size=\"16\">%s</text>\n", width / 2.0, title);
+    fprintf(file, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\">Time</text>\n", (left + right) / 2, bottom + 44);
+    chartYLabel(chart, label, sizeof(label));
+    fprintf(file, "<text transform=\"translate(18 %.1f) rotate(-90)\" text-anchor=\"middle\">%s</text>\n",
+        (top + bottom) / 2, label);
+    for (int e = 0; e < elementCount; e++) {
+        double y = top + 20 + e * 18;
+        double keyX = right - 200;
+        svgColor(elements[e].color, color);
+        if (elements[e].highColumn == 0)
+            fprintf(file, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"%s\" stroke-width=\"2\"/>\n",
+                keyX, y - 4, keyX + 30, y - 4, color);
+        else
+            fprintf(file, "<rect x=\"%.1f\" y=\"%.1f\" width=\"30\" height=\"10\" fill=\"%s\"/>\n", keyX, y - 9, color);
+        fprintf(file, "<text x=\"%.1f\" y=\"%.1f\">%s</text>\n", keyX + 38, y, elements[e].title);
+    }
+    fprintf(file, "</svg>\n");
+    int result = !ferror(file);
+    if (fclose(file) != 0) result = 0;
+    if (!result) fprintf(stderr, "Failed to write \"%s\"\n", path);
+    return result;
+}
+
+#endif
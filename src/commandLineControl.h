@@ -83,7 +83,8 @@ Argument **getArgs(int argc, char *argv[]) {
     // 3 min values (execute, flag, flag arg) for argc or else 0 arguments
     if (argc < 3 || argc % 2 == 0) return NULL;
     int count = (argc - 1) / 2;
-    Argument **list = (Argument**)calloc(count, sizeof(Argument*));
+    // One extra slot for the NULL terminator
+    Argument **list = (Argument**)calloc(count + 1, sizeof(Argument*));
     if (list == NULL) return NULL;
     
     int argIndex = 0;
@@ -125,6 +126,29 @@ Argument *tryGetArg(Argument **args, const char *arg) {
     return NULL;
 }
 
+// "-flag 300" is seconds, "-flag 250ms" milliseconds and "-flag 50us"
+// microseconds. The result is in microseconds.
+int convertPeriodValue(Argument *arg, size_t *microseconds) {
+    if (arg == NULL || arg->value == NULL) return 0;
+    if (arg->isInt) {
+        if (arg->intValue < 0) return 0;
+        *microseconds = (size_t)arg->intValue * 1000000;
+        return 1;
+    }
+    size_t length = strlen(arg->value);
+    if (length < 3) return 0;
+    size_t scale;
+    if (strcmp(arg->value + length - 2, "ms") == 0) scale = 1000;
+    else if (strcmp(arg->value + length - 2, "us") == 0) scale = 1;
+    else return 0;
+    char *number = strndup(arg->value, length - 2);
+    if (number == NULL) return 0;
+    int valid = isInteger(number) && number[0] != '-';
+    if (valid) *microseconds = (size_t)strtoul(number, NULL, 10) * scale;
+    free(number);
+    return valid;
+}
+
 int setValue(Argument **args, const char *arg, int *value) {
     Argument *temp = tryGetArg(args, arg);
     if (temp == NULL) return 0;
@@ -0,0 +1,233 @@
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include "sqlControl.h"
+#include "rollup.h"
+#include "fixedFormat.h"
+
+// Retention for the raw table. Raw rows older than rawDays are folded into
+// the hourly rollup and deleted, hourly rollup rows older than hourlyDays
+// are dropped (the daily rollup already holds them). Deletes run one hour
+// at a time, at most batchRows rows per statement with pauseUs between
+// statements, so no single statement holds the table for long and the
+// storage thread can slip its inserts in between.
+
+#define COMPACTION_DEFAULT_BATCH 5000
+#define COMPACTION_DEFAULT_PAUSE_US 200000
+#define COMPACTION_INTERVAL_US 3600000000ULL
+#define SECONDS_PER_DAY 86400
+
+struct compaction {
+    // 0 keeps the rows forever
+    unsigned int rawDays;
+    unsigned int hourlyDays;
+    size_t batchRows;
+    size_t pauseUs;
+    // The background job and the menu command never run at the same time
+    pthread_mutex_t running;
+    volatile int stopping;
+    uint64_t runs;
+    uint64_t rebuiltHours;
+    uint64_t deletedRaw;
+    uint64_t deletedHourly;
+    time_t lastRun;
+};
+typedef struct compaction Compaction;
+
+int compactionEnabled(const Compaction *compaction) {
+    return compaction->rawDays > 0 || compaction->hourlyDays > 0;
+}
+
+// Hourly rows may only go once their raw rows are gone (or when the raw
+// rows are kept forever), otherwise the aggregated queries would have
+// nothing for those hours
+unsigned int hourlyRetentionDays(const Compaction *compaction) {
+    if (compaction->hourlyDays == 0) return 0;
+    if (compaction->rawDays > 0 && compaction->hourlyDays < compaction->rawDays) return compaction->rawDays;
+    return compaction->hourlyDays;
+}
+
+// Start of the local hour (or day) that is `days` days before now
+time_t retentionCutoff(time_t now, unsigned int days, int wholeDay) {
+    time_t cutoff = now - (time_t)days * SECONDS_PER_DAY;
+    struct tm local;
+    localtime_r(&cutoff, &local);
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    if (wholeDay) local.tm_hour = 0;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+// Smallest bucket width that still has data for a range starting at start:
+// a whole hour once the raw rows are compacted, a whole day once the hourly
+// rollup is thinned as well
+unsigned int compactedBucketSeconds(const Compaction *compaction, time_t start, time_t now) {
+    unsigned int hourlyDays = hourlyRetentionDays(compaction);
+    if (hourlyDays > 0 && start < retentionCutoff(now, hourlyDays, 1)) return SECONDS_PER_DAY;
+    if (compaction->rawDays > 0 && start < retentionCutoff(now, compaction->rawDays, 0)) return 3600;
+    return 1;
+}
+
+// 'YYYY-MM-DD HH:MM:SS' in local time, quoted for a query
+char *appendQuotedTime(char *out, time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    *out++ = '\'';
+    out = appendDateTime(out, local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+        local.tm_hour, local.tm_min, local.tm_sec, " ");
+    *out++ = '\'';
+    *out = '\0';
+    return out;
+}
+
+// Sleeps between batches. Returns 0 when the job is being stopped.
+int compactionPause(Compaction *compaction) {
+    if (compaction->stopping) return 0;
+    if (compaction->pauseUs > 0) usleep(compaction->pauseUs);
+    return !compaction->stopping;
+}
+
+// Runs `DELETE ... LIMIT batchRows` until it removes less than a batch.
+// Each statement commits on its own. Returns 0 on error or when stopped.
+int deleteInBatches(Compaction *compaction, MYSQL *conn, const char *query, uint64_t *deleted) {
+    while (1) {
+        if (mysql_query(conn, query)) {
+            fprintf(stderr, "Compaction delete failed: %s\n", mysql_error(conn));
+            return 0;
+        }
+        my_ulonglong affected = mysql_affected_rows(conn);
+        *deleted += affected;
+        if (affected < compaction->batchRows) return 1;
+        if (!compactionPause(compaction)) return 0;
+    }
+}
+
+// Makes sure the hourly rollup accounts for every raw row of the hour
+// before they go. Ingest keeps the rollup current, so this only rebuilds
+// hours written before the rollups existed and never backfilled. A rollup
+// that counts more rows than the raw table is left alone: that hour was
+// partly deleted by an earlier, interrupted run.
+int foldRawHour(SQLSetup *setup, Compaction *compaction, MYSQL *conn, const char *hour) {
+    char query[1024];
+    char rawCount[32], rollupCount[32];
+    int found;
+    snprintf(query, sizeof(query), "SELECT COUNT(*) FROM %s WHERE time >= '%s' AND time < '%s' + INTERVAL 1 HOUR",
+        setup->table, hour, hour);
+    if (!queryText(conn, query, rawCount, sizeof(rawCount), &found)) return 0;
+    snprintf(query, sizeof(query), "SELECT samples FROM %s_hourly WHERE bucket = '%s'", setup->table, hour);
+    if (!queryText(conn, query, rollupCount, sizeof(rollupCount), &found)) return 0;
+    if (found && strtoull(rollupCount, NULL, 10) >= strtoull(rawCount, NULL, 10)) return 1;
+
+    char queries[4][1024];
+    snprintf(queries[0], sizeof(queries[0]), "START TRANSACTION");
+    snprintf(queries[1], sizeof(queries[1]),
+        "REPLACE INTO %s_hourly (bucket, samples, temp_sum, temp_min, temp_max, hum_sum, hum_min, hum_max) "
+        "SELECT '%s', COUNT(*), "
+        "SUM(" SQL_TEMPERATURE "), MIN(" SQL_TEMPERATURE "), MAX(" SQL_TEMPERATURE "), "
+        "SUM(" SQL_HUMIDITY "), MIN(" SQL_HUMIDITY "), MAX(" SQL_HUMIDITY ") "
+        "FROM %s WHERE time >= '%s' AND time < '%s' + INTERVAL 1 HOUR",
+        setup->table, hour, setup->table, hour, hour);
+    snprintf(queries[2], sizeof(queries[2]),
+        "REPLACE INTO %s_daily (bucket, samples, temp_sum, temp_min, temp_max, hum_sum, hum_min, hum_max) "
+        "SELECT DATE(bucket), SUM(samples), SUM(temp_sum), MIN(temp_min), MAX(temp_max), "
+        "SUM(hum_sum), MIN(hum_min), MAX(hum_max) FROM %s_hourly "
+        "WHERE bucket >= DATE('%s') AND bucket < DATE('%s') + INTERVAL 1 DAY GROUP BY DATE(bucket)",
+        setup->table, setup->table, hour, hour);
+    snprintf(queries[3], sizeof(queries[3]), "COMMIT");
+    for (int i = 0; i < 4; i++) {
+        if (mysql_query(conn, queries[i])) {
+            fprintf(stderr, "Compaction fold failed: %s\n", mysql_error(conn));
+            mysql_rollback(conn);
+            return 0;
+        }
+    }
+    compaction->rebuiltHours++;
+    return 1;
+}
+
+// Oldest hour first, so an interrupted run leaves a clean cutoff behind
+int compactRawRows(SQLSetup *setup, Compaction *compaction, MYSQL *conn, time_t cutoff) {
+    char cutoffText[32];
+    appendQuotedTime(cutoffText, cutoff);
+    while (!compaction->stopping) {
+        char query[1024], hour[32];
+        int found;
+        snprintf(query, sizeof(query),
+            "SELECT DATE_FORMAT(MIN(time), '%%Y-%%m-%%d %%H:00:00') FROM %s WHERE time < %s",
+            setup->table, cutoffText);
+        if (!queryText(conn, query, hour, sizeof(hour), &found)) return 0;
+        if (!found) return 1;
+        if (!foldRawHour(setup, compaction, conn, hour)) return 0;
+
+        snprintf(query, sizeof(query),
+            "DELETE FROM %s WHERE time >= '%s' AND time < '%s' + INTERVAL 1 HOUR AND time < %s ORDER BY time LIMIT %zu",
+            setup->table, hour, hour, cutoffText, compaction->batchRows);
+        if (!deleteInBatches(compaction, conn, query, &compaction->deletedRaw)) return 0;
+        if (!compactionPause(compaction)) return 0;
+    }
+    return 0;
+}
+
+// One pass over both retention windows. Returns 1 when everything due was
+// compacted, 0 on error or when stopped part way.
+int runCompaction(SQLSetup *setup, Compaction *compaction) {
+    if (!compactionEnabled(compaction)) return 1;
+    if (compaction->batchRows == 0) compaction->batchRows = 1;
+    pthread_mutex_lock(&compaction->running);
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) {
+        pthread_mutex_unlock(&compaction->running);
+        return 0;
+    }
+    MYSQL *conn = connection->conn;
+    int result = createRollupTables(setup, conn);
+
+    time_t now = time(NULL);
+    if (result && compaction->rawDays > 0)
+        result = compactRawRows(setup, compaction, conn, retentionCutoff(now, compaction->rawDays, 0));
+    unsigned int hourlyDays = hourlyRetentionDays(compaction);
+    if (result && hourlyDays > 0) {
+        char query[512];
+        char *p = query + snprintf(query, sizeof(query), "DELETE FROM %s_hourly WHERE bucket < ", setup->table);
+        p = appendQuotedTime(p, retentionCutoff(now, hourlyDays, 1));
+        snprintf(p, sizeof(query) - (p - query), " ORDER BY bucket LIMIT %zu", compaction->batchRows);
+        result = deleteInBatches(compaction, conn, query, &compaction->deletedHourly);
+    }
+
+    if (result) {
+        compaction->runs++;
+        compaction->lastRun = now;
+    }
+    // A stopped run leaves the connection usable
+    releaseConnection(setup, connection, result || compaction->stopping);
+    pthread_mutex_unlock(&compaction->running);
+    return result;
+}
+
+void printCompactionStats(const Compaction *compaction) {
+    if (!compactionEnabled(compaction)) {
+        puts("\tCompaction: off");
+        return;
+    }
+    char last[32] = "never";
+    if (compaction->lastRun != 0) {
+        struct tm local;
+        localtime_r(&compaction->lastRun, &local);
+        *appendDateTime(last, local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+            local.tm_hour, local.tm_min, local.tm_sec, " ") = '\0';
+    }
+    printf("\tCompaction: %llu runs (last %s), %llu raw rows deleted, %llu hours folded, %llu hourly rows deleted\n",
+        (unsigned long long)compaction->runs, last, (unsigned long long)compaction->deletedRaw,
+        (unsigned long long)compaction->rebuiltHours, (unsigned long long)compaction->deletedHourly);
+}
+
+#endif
@@ -1,5 +1,10 @@
 #ifndef DATA_LIST_H
 #define DATA_LIST_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include <mysql/mysql.h>
 
 struct dataValue {
@@ -9,44 +14,213 @@ struct dataValue {
 	MYSQL_TIME time;
 };
 typedef struct dataValue DataValue;
-typedef struct DataNode {
-    DataValue data;
-    struct DataNode *next;
-} DataNode;
-
-DataNode* createDataNode(DataValue *data) {
-    DataNode *newNode = (DataNode*)malloc(sizeof(DataNode));
-    if (newNode == NULL) {
+
+// One time bucket of an aggregated query
+struct dataBucket {
+	MYSQL_TIME time;
+	uint32_t samples;
+	double temperature;
+	double temperatureMin;
+	double temperatureMax;
+	double humidity;
+	double humidityMin;
+	double humidityMax;
+};
+typedef struct dataBucket DataBucket;
+
+// Readings are stored column by column inside one arena allocation.
+// A range query reserves the row count up front so it costs a single
+// malloc and a single free no matter how many rows come back.
+struct dataSeries {
+    size_t count;
+    size_t capacity;
+    void *arena;
+    MYSQL_TIME *time;
+    double *temperature;
+    double *f_temperature;
+    double *humidity;
+    // Set for bucketed results: temperature and humidity hold the bucket
+    // averages, these columns the extremes and the raw row count.
+    int aggregated;
+    double *temperatureMin;
+    double *temperatureMax;
+    double *humidityMin;
+    double *humidityMax;
+    uint32_t *samples;
+};
+typedef struct dataSeries DataSeries;
+
+// Called with each full batch of a streamed range and once more with the
+// rest. The batch is reused afterwards, and may be a cached hour, so it is
+// read only. Return 0 to stop the stream early.
+typedef int (*DataBatchCallback)(DataSeries *batch, void *context);
+
+void initDataSeries(DataSeries *series) {
+    series->count = 0;
+    series->capacity = 0;
+    series->arena = NULL;
+    series->time = NULL;
+    series->temperature = NULL;
+    series->f_temperature = NULL;
+    series->humidity = NULL;
+    series->aggregated = 0;
+    series->temperatureMin = NULL;
+    series->temperatureMax = NULL;
+    series->humidityMin = NULL;
+    series->humidityMax = NULL;
+    series->samples = NULL;
+}
+
+void initBucketSeries(DataSeries *series) {
+    initDataSeries(series);
+    series->aggregated = 1;
+}
+
+double celsiusToFahrenheit(double celsius) {
+    return (celsius * (9.0/5.0)) + 32;
+}
+
+size_t dataSeriesArenaSize(size_t capacity, int aggregated) {
+    // MYSQL_TIME first and the counts last so every column stays naturally aligned
+    size_t row = sizeof(MYSQL_TIME) + 3 * sizeof(double);
+    if (aggregated) row += 4 * sizeof(double) + sizeof(uint32_t);
+    return capacity * row;
+}
+
+void layoutDataSeries(DataSeries *series, void *arena, size_t capacity, int aggregated) {
+    char *cursor = (char*)arena;
+    initDataSeries(series);
+    series->aggregated = aggregated;
+    series->arena = arena;
+    series->capacity = capacity;
+    series->time = (MYSQL_TIME*)cursor;
+    cursor += capacity * sizeof(MYSQL_TIME);
+    series->temperature = (double*)cursor;
+    cursor += capacity * sizeof(double);
+    series->f_temperature = (double*)cursor;
+    cursor += capacity * sizeof(double);
+    series->humidity = (double*)cursor;
+    if (!aggregated) return;
+    cursor += capacity * sizeof(double);
+    series->temperatureMin = (double*)cursor;
+    cursor += capacity * sizeof(double);
+    series->temperatureMax = (double*)cursor;
+    cursor += capacity * sizeof(double);
+    series->humidityMin = (double*)cursor;
+    cursor += capacity * sizeof(double);
+    series->humidityMax = (double*)cursor;
+    cursor += capacity * sizeof(double);
+    series->samples = (uint32_t*)cursor;
+}
+
+// Copies every column of one row between two series of the same kind
+void copyDataRow(DataSeries *to, size_t toIndex, const DataSeries *from, size_t fromIndex) {
+    to->time[toIndex] = from->time[fromIndex];
+    to->temperature[toIndex] = from->temperature[fromIndex];
+    to->f_temperature[toIndex] = from->f_temperature[fromIndex];
+    to->humidity[toIndex] = from->humidity[fromIndex];
+    if (!from->aggregated) return;
+    to->temperatureMin[toIndex] = from->temperatureMin[fromIndex];
+    to->temperatureMax[toIndex] = from->temperatureMax[fromIndex];
+    to->humidityMin[toIndex] = from->humidityMin[fromIndex];
+    to->humidityMax[toIndex] = from->humidityMax[fromIndex];
+    to->samples[toIndex] = from->samples[fromIndex];
+}
+
+int reserveDataSeries(DataSeries *series, size_t capacity) {
+    if (series == NULL) return 0;
+    if (capacity <= series->capacity) return 1;
+
+    void *arena = malloc(dataSeriesArenaSize(capacity, series->aggregated));
+    if (arena == NULL) {
         fprintf(stderr, "Memory allocation failed\n");
-        return NULL;
+        return 0;
     }
-    newNode->data = *data;
-    newNode->next = NULL;
-    return newNode;
-}
-void appendDataNode(DataNode **head, DataValue *data) {
-    DataNode *newNode = createDataNode(data);
-    if (newNode == NULL) return;
-
-    if (*head == NULL) {
-        *head = newNode;
-    } else {
-        DataNode *temp = *head;
-        while (temp->next != NULL) {
-            temp = temp->next;
-        }
-        temp->next = newNode;
+    DataSeries grown;
+    layoutDataSeries(&grown, arena, capacity, series->aggregated);
+    if (series->count > 0) {
+        memcpy(grown.time, series->time, series->count * sizeof(MYSQL_TIME));
+        memcpy(grown.temperature, series->temperature, series->count * sizeof(double));
+        memcpy(grown.f_temperature, series->f_temperature, series->count * sizeof(double));
+        memcpy(grown.humidity, series->humidity, series->count * sizeof(double));
+    }
+    if (series->count > 0 && series->aggregated) {
+        memcpy(grown.temperatureMin, series->temperatureMin, series->count * sizeof(double));
+        memcpy(grown.temperatureMax, series->temperatureMax, series->count * sizeof(double));
+        memcpy(grown.humidityMin, series->humidityMin, series->count * sizeof(double));
+        memcpy(grown.humidityMax, series->humidityMax, series->count * sizeof(double));
+        memcpy(grown.samples, series->samples, series->count * sizeof(uint32_t));
+    }
+    free(series->arena);
+    grown.count = series->count;
+    *series = grown;
+    return 1;
+}
+
+int appendDataValue(DataSeries *series, const DataValue *data) {
+    if (series->count == series->capacity) {
+        size_t capacity = (series->capacity == 0 ? 64 : series->capacity * 2);
+        if (!reserveDataSeries(series, capacity)) return 0;
     }
+    size_t i = series->count++;
+    series->time[i] = data->time;
+    series->temperature[i] = data->temperature;
+    series->f_temperature[i] = data->f_temperature;
+    series->humidity[i] = data->humidity;
+    return 1;
 }
-void freeDataList(DataNode *head) {
-    DataNode *current = head;
-    DataNode *nextNode;
 
-    while (current != NULL) {
-        nextNode = current->next;
-        free(current);
-        current = nextNode;
+int appendDataBucket(DataSeries *series, const DataBucket *bucket) {
+    if (series->count == series->capacity) {
+        size_t capacity = (series->capacity == 0 ? 64 : series->capacity * 2);
+        if (!reserveDataSeries(series, capacity)) return 0;
     }
+    size_t i = series->count++;
+    series->time[i] = bucket->time;
+    series->temperature[i] = bucket->temperature;
+    series->f_temperature[i] = celsiusToFahrenheit(bucket->temperature);
+    series->humidity[i] = bucket->humidity;
+    series->temperatureMin[i] = bucket->temperatureMin;
+    series->temperatureMax[i] = bucket->temperatureMax;
+    series->humidityMin[i] = bucket->humidityMin;
+    series->humidityMax[i] = bucket->humidityMax;
+    series->samples[i] = bucket->samples;
+    return 1;
+}
+
+// Appends every row of from (raw series only)
+int appendDataSeries(DataSeries *to, const DataSeries *from) {
+    if (to->count + from->count > to->capacity) {
+        size_t capacity = (to->capacity == 0 ? 64 : to->capacity);
+        while (capacity < to->count + from->count) capacity *= 2;
+        if (!reserveDataSeries(to, capacity)) return 0;
+    }
+    memcpy(to->time + to->count, from->time, from->count * sizeof(MYSQL_TIME));
+    memcpy(to->temperature + to->count, from->temperature, from->count * sizeof(double));
+    memcpy(to->f_temperature + to->count, from->f_temperature, from->count * sizeof(double));
+    memcpy(to->humidity + to->count, from->humidity, from->count * sizeof(double));
+    to->count += from->count;
+    return 1;
+}
+
+void getDataValue(const DataSeries *series, size_t index, DataValue *data) {
+    data->time = series->time[index];
+    data->temperature = series->temperature[index];
+    data->f_temperature = series->f_temperature[index];
+    data->humidity = series->humidity[index];
+}
+
+void setDataValue(DataSeries *series, size_t index, const DataValue *data) {
+    series->time[index] = data->time;
+    series->temperature[index] = data->temperature;
+    series->f_temperature[index] = data->f_temperature;
+    series->humidity[index] = data->humidity;
+}
+
+void freeDataSeries(DataSeries *series) {
+    if (series == NULL) return;
+    free(series->arena);
+    initDataSeries(series);
 }
 
 int compareTimestamps(MYSQL_TIME time1, MYSQL_TIME time2) {
@@ -59,86 +233,96 @@ int compareTimestamps(MYSQL_TIME time1, MYSQL_TIME time2) {
     return 0;
 }
 
-void sortedInsert(DataNode **sorted, DataNode *newNode) {
-    if (*sorted == NULL || compareTimestamps(newNode->data.time, (*sorted)->data.time) <= 0) {
-        newNode->next = *sorted;
-        *sorted = newNode;
-    } else {
-        DataNode *current = *sorted;
-        while (current->next != NULL && compareTimestamps(newNode->data.time, current->next->data.time) > 0) {
-            current = current->next;
-        }
-        newNode->next = current->next;
-        current->next = newNode;
+// Seconds since 0000-03-01 of the wall clock time in the MYSQL_TIME.
+// Monotonic in (year, month, day, hour, minute, second) so one 64-bit
+// compare replaces the six field walk of compareTimestamps.
+uint64_t timestampKey(const MYSQL_TIME *time) {
+    uint64_t year = time->year - (time->month <= 2);
+    uint64_t month = (time->month + 9) % 12;
+    uint64_t days = year * 365 + year / 4 - year / 100 + year / 400 + (153 * month + 2) / 5 + time->day - 1;
+    return ((days * 24 + time->hour) * 60 + time->minute) * 60 + time->second;
+}
+
+int isSortedByTimestamp(const DataSeries *series) {
+    if (series == NULL || series->count < 2) return 1;
+    uint64_t last = timestampKey(&series->time[0]);
+    for (size_t i = 1; i < series->count; i++) {
+        uint64_t key = timestampKey(&series->time[i]);
+        if (key < last) return 0;
+        last = key;
     }
+    return 1;
 }
 
-DataNode* sortDataByTimestamp(DataNode *dataList) {
-    if (dataList == NULL || dataList->next == NULL) return dataList;
+struct sortEntry {
+    uint64_t key;
+    size_t index;
+};
+typedef struct sortEntry SortEntry;
 
-    DataNode *sorted = NULL;
-    DataNode *current = dataList;
+// Stable LSD radix sort on the packed timestamp key, 8 bits per pass.
+// Passes where every key shares the same byte are skipped, so a range of a
+// few years only pays for the handful of bytes that actually differ.
+// Returns whichever of the two buffers ended up holding the sorted run.
+SortEntry *radixSortEntries(SortEntry *entries, SortEntry *scratch, size_t count) {
+    uint64_t differing = 0;
+    for (size_t i = 1; i < count; i++)
+        differing |= entries[i].key ^ entries[0].key;
 
-    while (current != NULL) {
-        DataNode *next = current->next;
-        current->next = NULL;
-        sortedInsert(&sorted, current);
-        current = next;
-    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differing >> shift) & 0xFF) == 0) continue;
 
-    return sorted;
-}
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < count; i++)
+            offsets[(entries[i].key >> shift) & 0xFF]++;
+        size_t total = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t bucket = offsets[b];
+            offsets[b] = total;
+            total += bucket;
+        }
+        for (size_t i = 0; i < count; i++)
+            scratch[offsets[(entries[i].key >> shift) & 0xFF]++] = entries[i];
 
-void getMinMaxTemperature(DataNode *dataList, double *min, double *max, double buffer, int fahrenheit) {
-    if (dataList == NULL || min == NULL || max == NULL) return;
-    *min = INFINITY;
-    *max = -INFINITY;
-    DataNode *current = dataList;
-    while (current != NULL) {
-	int temp = (fahrenheit ? current->data.f_temperature : current->data.temperature);
-        if (temp < *min) *min = temp;
-        if (temp > *max) *max = temp;
-        current = current->next;
-    }
-    if (*min == *max) {
-        *min -= buffer;
-        *max += buffer;
+        SortEntry *swap = entries;
+        entries = scratch;
+        scratch = swap;
     }
+    return entries;
 }
 
-void getMinMaxHumidity(DataNode *dataList, double *min, double *max, double buffer) {
-    if (dataList == NULL || min == NULL || max == NULL) return;
-    *min = INFINITY;
-    *max = -INFINITY;
-    DataNode *current = dataList;
-    while (current != NULL) {
-        if (current->data.humidity < *min) *min = current->data.humidity;
-        if (current->data.humidity > *max) *max = current->data.humidity;
-        current = current->next;
-    }
-    if (*min == *max) {
-        *min -= buffer;
-        *max += buffer;
-    }
-}
+int sortDataByTimestamp(DataSeries *series) {
+    if (series == NULL || series->count < 2) return 1;
+    // Rows come back from getDataInRange with ORDER BY time, so the common
+    // case is a single linear check.
+    if (isSortedByTimestamp(series)) return 1;
 
-void getMinMaxValue(DataNode *dataList, double *min, double *max, double buffer, int fahrenheit) {
-    if (dataList == NULL || min == NULL || max == NULL) return;
-    *min = INFINITY;
-    *max = -INFINITY;
-    DataNode *current = dataList;
-    while (current != NULL) {
-	int temp = (fahrenheit ? current->data.f_temperature : current->data.temperature);
-        if (temp < *min) *min = temp;
-	if (current->data.humidity < *min) *min = current->data.humidity;
-        if (temp > *max) *max = temp;
-	if (current->data.humidity > *max) *max = current->data.humidity;
-        current = current->next;
+    size_t count = series->count;
+    SortEntry *entries = malloc(2 * count * sizeof(SortEntry));
+    void *arena = malloc(dataSeriesArenaSize(count, series->aggregated));
+    if (entries == NULL || arena == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(entries);
+        free(arena);
+        return 0;
     }
-    if (*min == *max) {
-        *min -= buffer;
-        *max += buffer;
+    SortEntry *scratch = entries + count;
+    for (size_t i = 0; i < count; i++) {
+        entries[i].key = timestampKey(&series->time[i]);
+        entries[i].index = i;
     }
+    SortEntry *sorted = radixSortEntries(entries, scratch, count);
+
+    DataSeries ordered;
+    layoutDataSeries(&ordered, arena, count, series->aggregated);
+    for (size_t i = 0; i < count; i++)
+        copyDataRow(&ordered, i, series, sorted[i].index);
+    ordered.count = count;
+
+    free(entries);
+    free(series->arena);
+    *series = ordered;
+    return 1;
 }
 
 #endif
@@ -0,0 +1,220 @@
+#ifndef DHT11_DECODER_H
+#define DHT11_DECODER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+// DHT11 decoding from timestamped edges instead of a busy-wait counter.
+//
+// After the host start pulse the sensor answers with ~80us low, ~80us high,
+// then 40 bits, each ~50us low followed by a high pulse of ~26-28us for a
+// 0 or ~70us for a 1. Only the high pulse widths carry data, so the decoder
+// measures rising-to-falling edge gaps and classifies each within a
+// tolerance window. Edges come from the GPIO character device, which the
+// kernel timestamps in interrupt context, so the reading thread can be
+// preempted freely without corrupting the frame.
+
+#define DHT11_RESPONSE_MIN_US 60
+#define DHT11_RESPONSE_MAX_US 105
+#define DHT11_ZERO_US 27
+#define DHT11_ONE_US 70
+#define DHT11_BIT_TOLERANCE_US 18
+#define DHT11_MAX_EDGES 128
+// Stop collecting once the line has been quiet this long
+#define DHT11_QUIET_MS 3
+
+struct dht11Edge {
+    uint64_t timestampNs;
+    // Line level after the edge: 1 for rising, 0 for falling
+    int level;
+};
+typedef struct dht11Edge Dht11Edge;
+
+enum Dht11DecodeResult {
+    DHT11_OK = 0,
+    DHT11_NO_RESPONSE,
+    DHT11_BAD_PULSE,
+    DHT11_SHORT_FRAME,
+    DHT11_BAD_CHECKSUM
+};
+
+const char *dht11DecodeResultName(enum Dht11DecodeResult result) {
+    switch (result) {
+        case DHT11_OK: return "ok";
+        case DHT11_NO_RESPONSE: return "no response";
+        case DHT11_BAD_PULSE: return "bad pulse";
+        case DHT11_SHORT_FRAME: return "short frame";
+        case DHT11_BAD_CHECKSUM: return "bad checksum";
+    }
+    return "unknown";
+}
+
+// Width in microseconds of the pulse that starts at edges[i]
+double pulseWidthUs(const Dht11Edge *edges, size_t i) {
+    return (edges[i + 1].timestampNs - edges[i].timestampNs) / 1000.0;
+}
+
+int withinTolerance(double width, double nominal, double tolerance) {
+    return width >= nominal - tolerance && width <= nominal + tolerance;
+}
+
+enum Dht11DecodeResult decodeDHT11Edges(const Dht11Edge *edges, size_t count, int data[5]) {
+    data[0] = data[1] = data[2] = data[3] = data[4] = 0;
+
+    // Find the sensor response: a low then a high pulse, both about 80us
+    size_t i = 0;
+    for (; i + 2 < count; i++) {
+        if (edges[i].level != 0 || edges[i + 1].level != 1) continue;
+        double low = pulseWidthUs(edges, i);
+        double high = pulseWidthUs(edges, i + 1);
+        if (low >= DHT11_RESPONSE_MIN_US && low <= DHT11_RESPONSE_MAX_US &&
+            high >= DHT11_RESPONSE_MIN_US && high <= DHT11_RESPONSE_MAX_US)
+            break;
+    }
+    if (i + 2 >= count) return DHT11_NO_RESPONSE;
+    // edges[i + 2] is the falling edge that starts the first bit
+    i += 2;
+
+    int bits = 0;
+    for (; i + 1 < count && bits < 40; i++) {
+        if (edges[i].level != 1) continue;
+        // A missed edge shows up as two rising edges in a row
+        if (edges[i + 1].level != 0) return DHT11_BAD_PULSE;
+        double high = pulseWidthUs(edges, i);
+        int bit;
+        if (withinTolerance(high, DHT11_ZERO_US, DHT11_BIT_TOLERANCE_US)) bit = 0;
+        else if (withinTolerance(high, DHT11_ONE_US, DHT11_BIT_TOLERANCE_US)) bit = 1;
+        else return DHT11_BAD_PULSE;
+        data[bits / 8] = (data[bits / 8] << 1) | bit;
+        bits++;
+    }
+    if (bits < 40) return DHT11_SHORT_FRAME;
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) return DHT11_BAD_CHECKSUM;
+    return DHT11_OK;
+}
+
+// Trace files are "timestamp_ns level" per line, one edge each
+int writeDHT11Trace(FILE *file, const Dht11Edge *edges, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        fprintf(file, "%llu %d\n", (unsigned long long)edges[i].timestampNs, edges[i].level);
+    return fprintf(file, "\n") > 0;
+}
+
+// Reads the next blank line separated trace. Returns the edge count, 0 at end of file.
+size_t readDHT11Trace(FILE *file, Dht11Edge *edges, size_t max) {
+    char line[128];
+    size_t count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long long timestamp;
+        int level;
+        if (sscanf(line, "%llu %d", &timestamp, &level) != 2) {
+            if (count > 0) break;
+            continue;
+        }
+        if (count < max) {
+            edges[count].timestampNs = timestamp;
+            edges[count].level = level;
+            count++;
+        }
+    }
+    return count;
+}
+
+// DHT11 on a GPIO character device line (BCM numbering, e.g. GPIO4 is
+// wiringPi pin 7)
+struct dht11Line {
+    const char *chip;
+    unsigned int offset;
+    // Optional corpus of every captured trace
+    FILE *trace;
+    uint64_t reads;
+    uint64_t failures[DHT11_BAD_CHECKSUM + 1];
+};
+typedef struct dht11Line Dht11Line;
+
+int setDHT11LineConfig(int fd, uint64_t flags) {
+    struct gpio_v2_line_config config;
+    memset(&config, 0, sizeof(config));
+    config.flags = flags;
+    return ioctl(fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config);
+}
+
+// Collects the edges of one transfer. Returns the edge count or -1.
+int captureDHT11Edges(Dht11Line *line, Dht11Edge *edges, size_t max) {
+    int chip = open(line->chip, O_RDWR | O_CLOEXEC);
+    if (chip < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", line->chip, strerror(errno));
+        return -1;
+    }
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+    request.offsets[0] = line->offset;
+    request.num_lines = 1;
+    request.event_buffer_size = DHT11_MAX_EDGES;
+    strncpy(request.consumer, "dht11", sizeof(request.consumer) - 1);
+    // Start pulse: hold the line low for 18ms
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    request.config.num_attrs = 1;
+    request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    request.config.attrs[0].attr.values = 0;
+    request.config.attrs[0].mask = 1;
+    if (ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+        fprintf(stderr, "Failed to request GPIO line %u: %s\n", line->offset, strerror(errno));
+        close(chip);
+        return -1;
+    }
+    close(chip);
+
+    struct timespec startPulse = { 0, 18 * 1000000L };
+    nanosleep(&startPulse, NULL);
+
+    // Release the line and let the kernel timestamp every edge
+    if (setDHT11LineConfig(request.fd, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP |
+        GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING) < 0) {
+        fprintf(stderr, "Failed to configure GPIO line %u: %s\n", line->offset, strerror(errno));
+        close(request.fd);
+        return -1;
+    }
+
+    size_t count = 0;
+    struct pollfd poller = { request.fd, POLLIN, 0 };
+    // The whole transfer takes ~4ms; wait longer for the first edge
+    int timeout = 20;
+    while (count < max && poll(&poller, 1, timeout) > 0) {
+        struct gpio_v2_line_event events[16];
+        ssize_t bytes = read(request.fd, events, sizeof(events));
+        if (bytes <= 0) break;
+        for (size_t i = 0; i < (size_t)bytes / sizeof(events[0]) && count < max; i++) {
+            edges[count].timestampNs = events[i].timestamp_ns;
+            edges[count].level = (events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE);
+            count++;
+        }
+        timeout = DHT11_QUIET_MS;
+    }
+    close(request.fd);
+    return (int)count;
+}
+
+bool read_dht11_edges(Dht11Line *line, int data[5]) {
+    Dht11Edge edges[DHT11_MAX_EDGES];
+    int count = captureDHT11Edges(line, edges, DHT11_MAX_EDGES);
+    line->reads++;
+    if (count < 0) return false;
+    if (line->trace != NULL) writeDHT11Trace(line->trace, edges, count);
+
+    enum Dht11DecodeResult result = decodeDHT11Edges(edges, count, data);
+    if (result != DHT11_OK) line->failures[result]++;
+    return result == DHT11_OK;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "dataList.h"
+
+// Picks which raw rows of a window a Graph draws when there are more than
+// it should. Both pickers are one pass over the rows and return indices in
+// time order, so the output is plain rows and draws like any raw range.
+//   LTTB   Largest-Triangle-Three-Buckets: one row per bucket, the one
+//          spanning the largest triangle with the row picked before it and
+//          the average of the next bucket. Keeps the shape of the line.
+//   MINMAX The lowest and the highest row of every bucket, so no spike is
+//          ever dropped.
+// The envelope mode (a min - max band per pixel column) lives in
+// seriesPyramid.h; NONE draws every row.
+
+enum DownsampleMode { ENVELOPE_DOWNSAMPLE = 0, LTTB_DOWNSAMPLE, MINMAX_DOWNSAMPLE, NO_DOWNSAMPLE };
+
+const char *downsampleModeName(enum DownsampleMode mode) {
+    switch (mode) {
+        case ENVELOPE_DOWNSAMPLE: return "ENVELOPE";
+        case LTTB_DOWNSAMPLE: return "LTTB";
+        case MINMAX_DOWNSAMPLE: return "MINMAX";
+        default: return "NONE";
+    }
+}
+
+// Writes at most target indices of rows [0, count) into picked and returns
+// how many. x is the time key of each row.
+size_t lttbDownsample(const uint64_t *x, const double *y, size_t count, size_t target, size_t *picked) {
+    if (target >= count) {
+        for (size_t i = 0; i < count; i++) picked[i] = i;
+        return count;
+    }
+    if (target < 3) {
+        if (target > 0) picked[0] = 0;
+        if (target > 1) picked[1] = count - 1;
+        return target;
+    }
+    size_t n = 0;
+    picked[n++] = 0;
+    // The first and last rows are always kept; the rest is split evenly
+    double every = (double)(count - 2) / (target - 2);
+    size_t a = 0;
+    for (size_t bucket = 0; bucket < target - 2; bucket++) {
+        size_t nextStart = (size_t)((bucket + 1) * every) + 1;
+        size_t nextEnd = (size_t)((bucket + 2) * every) + 1;
+        if (nextEnd > count) nextEnd = count;
+        double averageX = 0, averageY = 0;
+        for (size_t i = nextStart; i < nextEnd; i++) {
+            averageX += (double)(x[i] - x[0]);
+            averageY += y[i];
+        }
+        size_t nextCount = nextEnd - nextStart;
+        averageX /= nextCount;
+        averageY /= nextCount;
+
+        size_t start = (size_t)(bucket * every) + 1, end = nextStart;
+        double ax = (double)(x[a] - x[0]), ay = y[a];
+        double largest = -1;
+        size_t chosen = start;
+        for (size_t i = start; i < end; i++) {
+            // Twice the triangle area; the factor does not change the pick
+            double area = fabs((ax - averageX) * (y[i] - ay) - (ax - (double)(x[i] - x[0])) * (averageY - ay));
+            if (area > largest) {
+                largest = area;
+                chosen = i;
+            }
+        }
+        picked[n++] = chosen;
+        a = chosen;
+    }
+    picked[n++] = count - 1;
+    return n;
+}
+
+// Lowest and highest row of each of `buckets` buckets, in row order.
+// Writes at most 2 * buckets indices.
+size_t minMaxDownsample(const double *y, size_t count, size_t buckets, size_t *picked) {
+    if (buckets == 0) buckets = 1;
+    if (buckets > count) buckets = count;
+    size_t n = 0;
+    for (size_t bucket = 0; bucket < buckets; bucket++) {
+        size_t start = bucket * count / buckets, end = (bucket + 1) * count / buckets;
+        size_t low = start, high = start;
+        for (size_t i = start + 1; i < end; i++) {
+            if (y[i] < y[low]) low = i;
+            if (y[i] > y[high]) high = i;
+        }
+        picked[n++] = (low < high ? low : high);
+        if (low != high) picked[n++] = (low < high ? high : low);
+    }
+    return n;
+}
+
+// Merges two ascending index lists without repeats
+size_t mergePicks(const size_t *a, size_t countA, const size_t *b, size_t countB, size_t *out) {
+    size_t i = 0, j = 0, n = 0;
+    while (i < countA || j < countB) {
+        size_t next;
+        if (j == countB || (i < countA && a[i] < b[j])) next = a[i++];
+        else if (i == countA || b[j] < a[i]) next = b[j++];
+        else {
+            next = a[i++];
+            j++;
+        }
+        out[n++] = next;
+    }
+    return n;
+}
+
+// Rows [first, last) of a time ordered raw series brought down to about
+// target rows, picked on temperature and / or humidity. Two columns are
+// picked independently and merged, so BOTH can draw up to twice as many.
+// keys are the timestampKey of each row.
+int downsampleRows(const DataSeries *rows, const uint64_t *keys, size_t first, size_t last,
+    enum DownsampleMode mode, int temperature, int humidity, size_t target, DataSeries *out) {
+    initDataSeries(out);
+    size_t count = last - first;
+    if (mode == NO_DOWNSAMPLE || mode == ENVELOPE_DOWNSAMPLE || count <= target) {
+        if (!reserveDataSeries(out, (count > 0 ? count : 1))) return 0;
+        for (size_t i = first; i < last; i++) copyDataRow(out, out->count++, rows, i);
+        return 1;
+    }
+
+    size_t *picks = malloc(4 * (target + 2) * sizeof(size_t));
+    if (picks == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    size_t *pickedA = picks, *pickedB = picks + (target + 2), *merged = picks + 2 * (target + 2);
+    const double *columns[2];
+    int columnCount = 0;
+    if (temperature) columns[columnCount++] = rows->temperature + first;
+    if (humidity) columns[columnCount++] = rows->humidity + first;
+    size_t counts[2] = {0, 0};
+    for (int c = 0; c < columnCount; c++) {
+        size_t *picked = (c == 0 ? pickedA : pickedB);
+        if (mode == LTTB_DOWNSAMPLE) counts[c] = lttbDownsample(keys + first, columns[c], count, target, picked);
+        else counts[c] = minMaxDownsample(columns[c], count, target / 2, picked);
+    }
+    size_t total = mergePicks(pickedA, counts[0], pickedB, counts[1], merged);
+
+    int result = reserveDataSeries(out, (total > 0 ? total : 1));
+    for (size_t i = 0; result && i < total; i++) copyDataRow(out, out->count++, rows, first + merged[i]);
+    free(picks);
+    return result;
+}
+
+#endif
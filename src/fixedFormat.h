@@ -0,0 +1,149 @@
+#ifndef FIXED_FORMAT_H
+#define FIXED_FORMAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// Number formatting and DHT11 decoding without malloc, pow or printf.
+// Every append writes into a caller provided buffer and returns a pointer
+// just past what it wrote, so a whole output line can be built with a chain
+// of appends and sent with one fputs. A numeric append writes at most
+// FIXED_NUMBER_MAX bytes.
+
+#define FIXED_MAX_DECIMALS 6
+#define FIXED_NUMBER_MAX 32
+// Decoded readings are kept in thousandths, which is exact for any
+// fraction byte the sensor can send (at most three digits)
+#define FIXED_READING_SCALE 1000
+
+static const int64_t POW10[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+    100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+    1000000000000LL, 10000000000000LL, 100000000000000LL,
+    1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+    1000000000000000000LL
+};
+
+// "00" "01" ... "99", two digits per lookup
+static const char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+int decimalDigits(uint64_t value) {
+    int count = 1;
+    while (count < 19 && value >= (uint64_t)POW10[count]) count++;
+    return count;
+}
+
+// Writes value zero padded to exactly width digits
+char *appendDigits(char *out, uint64_t value, int width) {
+    char *p = out + width;
+    while (p - out >= 2) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + (value % 100) * 2, 2);
+        value /= 100;
+    }
+    if (p > out) *--p = '0' + (char)(value % 10);
+    return out + width;
+}
+
+char *appendUnsigned(char *out, uint64_t value) {
+    return appendDigits(out, value, decimalDigits(value));
+}
+
+char *appendString(char *out, const char *text) {
+    size_t length = strlen(text);
+    memcpy(out, text, length);
+    return out + length;
+}
+
+// value / 10^decimals, e.g. (21500, 3) -> "21.500"
+char *appendFixed(char *out, int64_t scaled, int decimals) {
+    uint64_t magnitude = (scaled < 0 ? -(uint64_t)scaled : (uint64_t)scaled);
+    if (scaled < 0) *out++ = '-';
+    out = appendUnsigned(out, magnitude / POW10[decimals]);
+    if (decimals == 0) return out;
+    *out++ = '.';
+    return appendDigits(out, magnitude % POW10[decimals], decimals);
+}
+
+// Rounds half away from zero. The caller checks the range.
+int64_t scaleDouble(double value, int decimals) {
+    double scaled = value * POW10[decimals];
+    return (int64_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+// Like "%.*f", but rounds the scaled double half away from zero where
+// printf rounds the exact binary value (half to even on exact ties), so
+// the last digit can differ, e.g. 0.125 with 2 decimals is "0.13" here and
+// "0.12" from printf
+char *appendDouble(char *out, double value, int decimals) {
+    if (decimals > FIXED_MAX_DECIMALS) decimals = FIXED_MAX_DECIMALS;
+    double limit = 1e15 / POW10[decimals];
+    // Also catches NaN, which fails both comparisons
+    if (!(value < limit && value > -limit)) {
+        int written = snprintf(out, FIXED_NUMBER_MAX, "%.*f", decimals, value);
+        if (written < 0) return out;
+        return out + (written < FIXED_NUMBER_MAX ? written : FIXED_NUMBER_MAX - 1);
+    }
+    return appendFixed(out, scaleDouble(value, decimals), decimals);
+}
+
+// Fits value into exactly width characters (plus the terminator), using
+// whatever decimals are left after the whole part. A whole part that does
+// not fit is cut and its last character replaced by 'E'.
+size_t formatFitted(char *out, double value, unsigned int width) {
+    if (width == 0) {
+        out[0] = '\0';
+        return 0;
+    }
+    char buffer[FIXED_NUMBER_MAX * 2];
+    int sign = (value < 0);
+    double magnitude = (sign ? -value : value);
+    if (!(magnitude < 1e15)) magnitude = 1e15;
+    int whole = decimalDigits((uint64_t)magnitude) + sign;
+    int decimals = (int)width - whole - 1;
+    if (decimals > FIXED_MAX_DECIMALS) decimals = FIXED_MAX_DECIMALS;
+    if (decimals < 0) decimals = 0;
+
+    char *end = appendDouble(buffer, value, decimals);
+    // Rounding can carry into a new digit, e.g. 9.96 -> "10.0"
+    if ((unsigned int)(end - buffer) > width && decimals > 0)
+        end = appendDouble(buffer, value, decimals - 1);
+    size_t length = end - buffer;
+    if (length > width) {
+        length = width;
+        buffer[width - 1] = 'E';
+    }
+    memcpy(out, buffer, length);
+    out[length] = '\0';
+    return length;
+}
+
+// "YYYY-MM-DD" + between + "HH:MM:SS"
+char *appendDateTime(char *out, unsigned int year, unsigned int month, unsigned int day,
+    unsigned int hour, unsigned int minute, unsigned int second, const char *between) {
+    out = appendDigits(out, year, 4);
+    *out++ = '-';
+    out = appendDigits(out, month, 2);
+    *out++ = '-';
+    out = appendDigits(out, day, 2);
+    out = appendString(out, between);
+    out = appendDigits(out, hour, 2);
+    *out++ = ':';
+    out = appendDigits(out, minute, 2);
+    *out++ = ':';
+    return appendDigits(out, second, 2);
+}
+
+// DHT11 bytes to thousandths: the fraction byte is read as the digits after
+// the point, so (21, 5) is 21.5 and (21, 25) is 21.25.
+int32_t decodeFixedReading(int whole, int fraction) {
+    if (fraction <= 0) return whole * FIXED_READING_SCALE;
+    return whole * FIXED_READING_SCALE +
+        (int32_t)(fraction * FIXED_READING_SCALE / POW10[decimalDigits(fraction)]);
+}
+
+#endif
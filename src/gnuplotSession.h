@@ -0,0 +1,82 @@
+#ifndef GNUPLOT_SESSION_H
+#define GNUPLOT_SESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+
+// One gnuplot process for the whole run instead of one per Graph. It is
+// started on the first Graph and every later one is drawn as a new plot in
+// the same session and window. Rows go over the pipe as inline binary
+// records of float64 columns (see chartRender.h), so nothing is formatted
+// here or parsed by gnuplot. When gnuplot goes away the session is closed
+// and the next Graph starts a new one.
+
+struct gnuplotSession {
+    FILE *pipe;
+    unsigned int width;
+    unsigned int height;
+    uint64_t starts;
+    uint64_t plots;
+};
+typedef struct gnuplotSession GnuplotSession;
+
+void initGnuplotSession(GnuplotSession *session, unsigned int width, unsigned int height) {
+    memset(session, 0, sizeof(*session));
+    session->width = width;
+    session->height = height;
+}
+
+void closeGnuplotSession(GnuplotSession *session) {
+    if (session->pipe == NULL) return;
+    fputs("quit\n", session->pipe);
+    pclose(session->pipe);
+    session->pipe = NULL;
+}
+
+// Starts gnuplot when there is no session yet
+int openGnuplotSession(GnuplotSession *session) {
+    if (session->pipe != NULL) return 1;
+    // A gnuplot that was closed must not take this process with it
+    signal(SIGPIPE, SIG_IGN);
+    session->pipe = popen("gnuplot", "w");
+    if (session->pipe == NULL) {
+        perror("Failed to open gnuplot");
+        return 0;
+    }
+    FILE *pipe = session->pipe;
+    fprintf(pipe, "set terminal wxt size %u,%u noraise\n", session->width, session->height);
+    fputs("set xdata time\n", pipe);
+    fputs("set timefmt '%s'\n", pipe);
+    fputs("set format x '%H:%M'\n", pipe);
+    fputs("set xlabel 'Time'\n", pipe);
+    session->starts++;
+    return 1;
+}
+
+// Inline data for one "'-' binary record=(count) format='%<columns>float64'"
+// plot element, rows one after another
+int sendGnuplotRecords(GnuplotSession *session, const double *records, size_t count, size_t columns) {
+    return fwrite(records, columns * sizeof(double), count, session->pipe) == count;
+}
+
+// Hands the plot over. Returns 0 and closes the session when gnuplot is gone.
+int finishGnuplotPlot(GnuplotSession *session) {
+    if (fflush(session->pipe) != 0 || ferror(session->pipe)) {
+        fprintf(stderr, "Lost gnuplot, it is started again on the next Graph\n");
+        pclose(session->pipe);
+        session->pipe = NULL;
+        return 0;
+    }
+    session->plots++;
+    return 1;
+}
+
+void printGnuplotStats(const GnuplotSession *session) {
+    printf("\tGnuplot: %s, %llu starts, %llu plots\n", (session->pipe != NULL ? "running" : "not running"),
+        (unsigned long long)session->starts, (unsigned long long)session->plots);
+}
+
+#endif
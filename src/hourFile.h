@@ -0,0 +1,299 @@
+#ifndef HOUR_FILE_H
+#define HOUR_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mysql/mysql.h>
+#include "sqlControl.h"
+#include "storeControl.h"
+#include "dataList.h"
+#include "fixedFormat.h"
+
+// Memory-mapped file of closed raw hours, the on-disk tier under the range
+// cache, so past hours survive a restart. After the header comes a fixed
+// open-addressed slot table keyed by the hour, then the hour blocks one
+// after another: one 12 byte record per row holding the second within the
+// hour and both readings in FIXED_READING_SCALE units. A slot is written
+// after its block and carries a checksum of it, so a block torn by a crash
+// simply reads as missing. The header keeps a hash of the server, user,
+// database and table; a file written for other settings is emptied on open.
+// So is a full one, instead of tracking free space.
+
+#define HOUR_FILE_MAGIC "ENVHOURS"
+#define HOUR_FILE_VERSION 1
+#define HOUR_FILE_HEADER_SIZE 4096
+// About seven years of hours; the file starts over at three quarters full
+#define HOUR_FILE_SLOTS 65536
+#define HOUR_FILE_GROW_BYTES (4 * 1048576)
+
+struct hourFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t setupKey;
+    uint32_t slots;
+    uint32_t entries;
+    uint64_t dataEnd;
+};
+typedef struct hourFileHeader HourFileHeader;
+
+struct hourSlot {
+    // 0 for an empty slot
+    int64_t hour;
+    uint64_t offset;
+    uint32_t count;
+    uint32_t checksum;
+};
+typedef struct hourSlot HourSlot;
+
+struct hourRecord {
+    uint16_t second;
+    uint16_t reserved;
+    int32_t temperature;
+    int32_t humidity;
+};
+typedef struct hourRecord HourRecord;
+
+struct hourFile {
+    int fd;
+    char *path;
+    unsigned char *map;
+    size_t mapSize;
+    // Largest the file may get before it starts over
+    size_t limit;
+    uint64_t hits;
+    uint64_t writes;
+    uint64_t resets;
+    // Writes skipped because the file could not grow
+    uint64_t failedGrows;
+};
+typedef struct hourFile HourFile;
+
+#define HOUR_FILE_DATA_START (HOUR_FILE_HEADER_SIZE + HOUR_FILE_SLOTS * sizeof(HourSlot))
+
+void initHourFile(HourFile *file) {
+    memset(file, 0, sizeof(*file));
+    file->fd = -1;
+}
+
+HourFileHeader *hourFileHeader(HourFile *file) {
+    return (HourFileHeader*)file->map;
+}
+
+HourSlot *hourFileSlots(HourFile *file) {
+    return (HourSlot*)(file->map + HOUR_FILE_HEADER_SIZE);
+}
+
+int hourFileOpen(const HourFile *file) {
+    return file->map != NULL;
+}
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Everything that decides which rows a range query returns
+uint64_t hourFileKey(const SQLSetup *setup) {
+    const char *parts[4] = { setup->server, setup->user, setup->database, setup->table };
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 4; i++) {
+        const char *part = (parts[i] != NULL ? parts[i] : "");
+        // The terminator keeps "ab" + "c" apart from "a" + "bc"
+        hash = hashBytes(hash, part, strlen(part) + 1);
+    }
+    return hash;
+}
+
+uint32_t hourBlockChecksum(int64_t hour, uint32_t count, const HourRecord *records) {
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, &hour, sizeof(hour));
+    hash = hashBytes(hash, &count, sizeof(count));
+    hash = hashBytes(hash, records, count * sizeof(HourRecord));
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Maps the new size before the old mapping goes, so a grow that fails
+// keeps the file open as it was
+int mapHourFile(HourFile *file, size_t size) {
+    if (ftruncate(file->fd, size) != 0) {
+        fprintf(stderr, "Failed to grow hour file \"%s\": %s\n", file->path, strerror(errno));
+        return 0;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map hour file \"%s\": %s\n", file->path, strerror(errno));
+        return 0;
+    }
+    if (file->map != NULL) munmap(file->map, file->mapSize);
+    file->map = map;
+    file->mapSize = size;
+    return 1;
+}
+
+void resetHourFile(HourFile *file, uint64_t setupKey) {
+    HourFileHeader *header = hourFileHeader(file);
+    memset(file->map, 0, HOUR_FILE_DATA_START);
+    memcpy(header->magic, HOUR_FILE_MAGIC, 8);
+    header->version = HOUR_FILE_VERSION;
+    header->recordSize = sizeof(HourRecord);
+    header->setupKey = setupKey;
+    header->slots = HOUR_FILE_SLOTS;
+    header->dataEnd = HOUR_FILE_DATA_START;
+}
+
+int openHourFile(HourFile *file, const char *path, uint64_t setupKey, size_t limit) {
+    initHourFile(file);
+    file->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (file->fd < 0) {
+        fprintf(stderr, "Failed to open hour file \"%s\": %s\n", path, strerror(errno));
+        return 0;
+    }
+    file->path = strdup(path);
+    file->limit = (limit > HOUR_FILE_DATA_START ? limit : HOUR_FILE_DATA_START + HOUR_FILE_GROW_BYTES);
+
+    struct stat info;
+    fstat(file->fd, &info);
+    size_t size = HOUR_FILE_DATA_START + HOUR_FILE_GROW_BYTES;
+    if ((size_t)info.st_size > size) size = info.st_size;
+    if (!mapHourFile(file, size)) {
+        close(file->fd);
+        free(file->path);
+        initHourFile(file);
+        return 0;
+    }
+
+    HourFileHeader *header = hourFileHeader(file);
+    if (memcmp(header->magic, HOUR_FILE_MAGIC, 8) != 0 || header->version != HOUR_FILE_VERSION ||
+        header->recordSize != sizeof(HourRecord) || header->slots != HOUR_FILE_SLOTS ||
+        header->dataEnd < HOUR_FILE_DATA_START || header->dataEnd > file->mapSize)
+        resetHourFile(file, setupKey);
+    else if (header->setupKey != setupKey) {
+        puts("The database settings changed, emptying the hour file");
+        resetHourFile(file, setupKey);
+    }
+    return 1;
+}
+
+// Valid slot of the hour or NULL
+HourSlot *findHourSlot(HourFile *file, time_t hour) {
+    if (file->map == NULL) return NULL;
+    HourSlot *slots = hourFileSlots(file);
+    size_t index = (size_t)((uint64_t)(hour / 3600) % HOUR_FILE_SLOTS);
+    for (size_t probe = 0; probe < HOUR_FILE_SLOTS && slots[index].hour != 0; probe++) {
+        HourSlot *slot = &slots[index];
+        if (slot->hour == (int64_t)hour) {
+            if (slot->offset < HOUR_FILE_DATA_START ||
+                slot->offset + (uint64_t)slot->count * sizeof(HourRecord) > hourFileHeader(file)->dataEnd)
+                return NULL;
+            const HourRecord *records = (const HourRecord*)(file->map + slot->offset);
+            return (hourBlockChecksum(slot->hour, slot->count, records) == slot->checksum ? slot : NULL);
+        }
+        index = (index + 1) % HOUR_FILE_SLOTS;
+    }
+    return NULL;
+}
+
+// Appends the rows of the hour to rows. Returns 0 when the file does not
+// have the hour.
+int readHourFile(HourFile *file, time_t hour, DataSeries *rows) {
+    HourSlot *slot = findHourSlot(file, hour);
+    if (slot == NULL) return 0;
+    if (!reserveDataSeries(rows, rows->count + slot->count)) return 0;
+    MYSQL_TIME base;
+    toMySQLTime(hour, &base);
+    const HourRecord *records = (const HourRecord*)(file->map + slot->offset);
+    for (uint32_t i = 0; i < slot->count; i++) {
+        DataValue data;
+        data.time = base;
+        data.time.minute = records[i].second / 60;
+        data.time.second = records[i].second % 60;
+        data.temperature = (double)records[i].temperature / FIXED_READING_SCALE;
+        data.f_temperature = celsiusToFahrenheit(data.temperature);
+        data.humidity = (double)records[i].humidity / FIXED_READING_SCALE;
+        appendDataValue(rows, &data);
+    }
+    file->hits++;
+    return 1;
+}
+
+// Returns 1 when the hour was written
+int writeHourFile(HourFile *file, time_t hour, const DataSeries *rows) {
+    if (file->map == NULL || hour == 0) return 0;
+    HourFileHeader *header = hourFileHeader(file);
+    size_t bytes = rows->count * sizeof(HourRecord);
+    if (HOUR_FILE_DATA_START + bytes > file->limit) return 0;
+    if (header->dataEnd + bytes > file->limit || header->entries >= HOUR_FILE_SLOTS / 4 * 3) {
+        resetHourFile(file, header->setupKey);
+        file->resets++;
+    }
+    if (header->dataEnd + bytes > file->mapSize) {
+        size_t size = file->mapSize;
+        while (header->dataEnd + bytes > size) size += HOUR_FILE_GROW_BYTES;
+        if (size > file->limit) size = file->limit;
+        if (!mapHourFile(file, size)) {
+            file->failedGrows++;
+            return 0;
+        }
+        header = hourFileHeader(file);
+    }
+
+    uint64_t offset = header->dataEnd;
+    HourRecord *records = (HourRecord*)(file->map + offset);
+    for (size_t i = 0; i < rows->count; i++) {
+        records[i].second = (uint16_t)(rows->time[i].minute * 60 + rows->time[i].second);
+        records[i].reserved = 0;
+        records[i].temperature = (int32_t)llround(rows->temperature[i] * FIXED_READING_SCALE);
+        records[i].humidity = (int32_t)llround(rows->humidity[i] * FIXED_READING_SCALE);
+    }
+    header->dataEnd = offset + bytes;
+
+    HourSlot *slots = hourFileSlots(file);
+    size_t index = (size_t)((uint64_t)(hour / 3600) % HOUR_FILE_SLOTS);
+    while (slots[index].hour != 0 && slots[index].hour != (int64_t)hour)
+        index = (index + 1) % HOUR_FILE_SLOTS;
+    HourSlot *slot = &slots[index];
+    if (slot->hour == 0) header->entries++;
+    // Checksum last: until then the slot reads as torn
+    slot->checksum = 0;
+    slot->hour = hour;
+    slot->offset = offset;
+    slot->count = (uint32_t)rows->count;
+    slot->checksum = hourBlockChecksum(slot->hour, slot->count, records);
+    file->writes++;
+    return 1;
+}
+
+void closeHourFile(HourFile *file) {
+    if (file->map != NULL) munmap(file->map, file->mapSize);
+    if (file->fd >= 0) close(file->fd);
+    free(file->path);
+    initHourFile(file);
+}
+
+void printHourFileStats(HourFile *file) {
+    if (file->map == NULL) {
+        puts("\tHour file: off");
+        return;
+    }
+    HourFileHeader *header = hourFileHeader(file);
+    printf("\tHour file: %s, %u hours in %.1f of %.1f MB, %llu hits, %llu written, %llu resets, %llu failed grows\n",
+        file->path, header->entries, header->dataEnd / 1048576.0, file->limit / 1048576.0,
+        (unsigned long long)file->hits, (unsigned long long)file->writes, (unsigned long long)file->resets,
+        (unsigned long long)file->failedGrows);
+}
+
+#endif
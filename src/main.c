@@ -5,81 +5,102 @@
 #include <pthread.h>
 #include <time.h>
 #include <float.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "DHT11Control.h"
+#include "sensorDriver.h"
+#include "simulatedSensor.h"
 #include "LCDControl.h"
 #include "commandLineControl.h"
 #include "dataList.h"
+#include "fixedFormat.h"
+#include "seriesStats.h"
+#include "seriesPyramid.h"
+#include "downsample.h"
+#include "chartRender.h"
+#include "sqlControl.h"
+#include "storeControl.h"
+#include "rollup.h"
+#include "compaction.h"
+#include "schema.h"
+#include "shardedFetch.h"
+#include "hourFile.h"
+#include "rangeCache.h"
+#include "gnuplotSession.h"
+#include "spool.h"
+#include "sampleRing.h"
+#include "sampleChannel.h"
+#include "rollingStats.h"
+#include "scheduler.h"
+#include "workerPool.h"
+
+enum ReportFormat { PNG_REPORT = 1, SVG_REPORT = 2, PNG_SVG_REPORT = 3 };
 
 int LCD_ADDRESS = 0x27;
 int DHT11_PIN = 7;
-size_t RATE_SECONDS = 600;
+size_t RATE_US = 600000000;
 size_t MAX_READ_TRIES = 100;
 size_t MAX_STORE_TRIES = 5;
-
-char *buildStoreQuery(int data[], const char *tableName) {
-    // insert into tableName values (x, y, z, ... );
-    char *output = malloc(sizeof(char) * 256);
-    if (output == NULL) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
-    }
-    sprintf(output, "INSERT INTO %s (HumLHS, HumRHS, TempLHS, TempRHS) VALUES (%d, %d, %d, %d)", 
-        tableName, data[0], data[1], data[2], data[3]);
-    return output;
-}
-
-struct sqlSetup {
-    char *server;
-    char *user;
-    char *password;
-    char *database;
-    char *table;
-};
-typedef struct sqlSetup SQLSetup;
-
-void initSetup(SQLSetup *setup) {
-    setup->server = NULL;
-    setup->user = NULL;
-    setup->password = NULL;
-    setup->database = NULL;
-    setup->table = NULL;
-}
-void freeSetup(SQLSetup *setup) {
-    if (setup->server != NULL) free(setup->server);
-    if (setup->user != NULL) free(setup->user);
-    if (setup->password != NULL) free(setup->password);
-    if (setup->database != NULL) free(setup->database);
-    if (setup->table != NULL) free(setup->table);
-}
+size_t FLUSH_COUNT = 1;
+size_t FLUSH_SECONDS = 0;
+size_t TARGET_POINTS = 500;
+size_t PLOT_WIDTH = 1000;
+size_t PLOT_POINTS = 1000;
+enum DownsampleMode DOWNSAMPLE_MODE = ENVELOPE_DOWNSAMPLE;
+size_t PARTITION_MONTHS = 0;
+size_t STREAM_BATCH_ROWS = 1024;
+size_t PREFETCH_ROWS = 256;
+size_t SHARD_COUNT = 1;
+size_t CACHE_MB = 64;
+size_t HOUR_FILE_MB = 256;
+char *SPOOL_PATH = NULL;
+char *HOUR_FILE_PATH = NULL;
+char *REPORT_DIR = NULL;
+char *REPORT_FROM = NULL;
+char *REPORT_TO = NULL;
+enum ReportFormat REPORT_FORMAT = PNG_REPORT;
+size_t REPORT_THREADS = 0;
+Compaction compaction = { 0, 0, COMPACTION_DEFAULT_BATCH, COMPACTION_DEFAULT_PAUSE_US,
+    PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, 0, 0 };
+Spool spool;
+RangeCache rangeCache;
+HourFile hourFile;
+GnuplotSession gnuplot;
+SensorDriver sensor;
+SimulatedSensor simulatedSensor;
+Dht11Line dht11Line = { "/dev/gpiochip0", 4, NULL, 0, {0} };
+enum SensorType { DHT11_SENSOR = 0, DHT11_EDGE_SENSOR = 1, SIMULATED_SENSOR = 2 };
+enum SensorType sensorType = DHT11_SENSOR;
+// Sampler -> storage thread and sampler -> LCD thread
+SampleRing storageRing;
+SampleRing displayRing;
+// Sampler -> Watch. Every reading is published; Watch catches up on what
+// came while it was closed.
+SampleChannel sampleChannel;
+SampleSubscriber watchSubscriber;
+RollingStats watchStats;
 
 int testConnection(SQLSetup *setup) {
     if (setup == NULL) return 0;
-    MYSQL *conn;
     MYSQL_RES *res;
     
-    conn = mysql_init(NULL);
-    if (conn == NULL) {
-        fprintf(stderr, "mysql_init() failed\n");
-        return 0;
-    }
-    if (!mysql_real_connect(conn, setup->server, setup->user, setup->password, setup->database, 0, NULL, 0)) {
-        fprintf(stderr, "%s\n", mysql_error(conn));
-        return 0;
-    }
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
+    MYSQL *conn = connection->conn;
     
     char query[256];
     snprintf(query, sizeof(query), "SHOW TABLES LIKE '%s'", setup->table);
 
     if (mysql_query(conn, query)) {
         fprintf(stderr, "SHOW TABLES LIKE query failed: %s\n", mysql_error(conn));
-        mysql_close(conn);
+        releaseConnection(setup, connection, 0);
         return 0;
     }
 
     res = mysql_store_result(conn);
     if (res == NULL) {
         fprintf(stderr, "Failed to store result: %s\n", mysql_error(conn));
-        mysql_close(conn);
+        releaseConnection(setup, connection, 0);
         return 0;
     }
         
@@ -88,38 +109,13 @@ int testConnection(SQLSetup *setup) {
         result = 1;
        
     mysql_free_result(res);
-    mysql_close(conn);
-    return result;
-}
-
-MYSQL *buildConnection(SQLSetup *setup) {
-    MYSQL *conn;
-    conn = mysql_init(NULL);
-    if (conn == NULL) {
-        fprintf(stderr, "mysql_init() failed\n");
-        return NULL;
-    }
-    if (!mysql_real_connect(conn, setup->server, setup->user, setup->password, setup->database, 0, NULL, 0)) {
-        fprintf(stderr, "%s\n", mysql_error(conn));
-        return NULL;
-    }
-    return conn;
-}
-
-int storeData(int data[], SQLSetup *setup) {
-    MYSQL *conn = buildConnection(setup);
-    if (conn == NULL) return 0;
-        
-    char *query = buildStoreQuery(data, setup->table);
-    if (mysql_query(conn, query)) {
-        fprintf(stderr, "%s\n", mysql_error(conn));
-        free(query);
-        return 0;
+    // Creates the table when it is missing and migrates it on first contact
+    if (!result || !setup->schemaReady) {
+        setup->schemaReady = 0;
+        result = ensureSchema(setup, conn, PARTITION_MONTHS);
     }
-    free(query);
-
-    mysql_close(conn);
-    return 1;
+    releaseConnection(setup, connection, 1);
+    return result;
 }
 
 struct timeValue {
@@ -147,33 +143,52 @@ int timeDifference(TimeValue *lhs, TimeValue *rhs) {
     return 0;
 }
 
-int getDataInRange(SQLSetup *setup, TimeValue *start, TimeValue *end, DataNode **dataList) {
+// Whole hours from the start of start->hour to the end of end->hour
+void setRangeTimes(TimeValue *start, TimeValue *end, MYSQL_TIME *sql_start, MYSQL_TIME *sql_end) {
+    memset(sql_start, 0, sizeof(*sql_start));
+    memset(sql_end, 0, sizeof(*sql_end));
+
+    sql_start->year = start->year;
+    sql_start->month = start->month;
+    sql_start->day = start->day;
+    sql_start->hour = start->hour;
+
+    sql_end->year = end->year;
+    sql_end->month = end->month;
+    sql_end->day = end->day;
+    sql_end->hour = end->hour;
+    // Just in case you are checking a single hour
+    sql_end->minute = 59;
+    sql_end->second = 59;
+}
+
+// Shards worth using for the range: one per whole hour at most
+unsigned int rangeShardCount(const MYSQL_TIME *start, const MYSQL_TIME *end) {
+    if (SHARD_COUNT <= 1) return 1;
+    time_t hours = (mysqlTimeToTime(end) - mysqlTimeToTime(start) + 1) / 3600;
+    if (hours < 2) return 1;
+    return (unsigned int)((size_t)hours < SHARD_COUNT ? (size_t)hours : SHARD_COUNT);
+}
+
+int appendBatchCallback(DataSeries *batch, void *context) {
+    return appendDataSeries((DataSeries*)context, batch);
+}
+
+int getDataInRange(SQLSetup *setup, TimeValue *start, TimeValue *end, DataSeries *series) {
     if (start == NULL || end == NULL) {
         fprintf(stderr, "Null time range passed.\n");
         return 0;
     }
-        
-    MYSQL *conn = buildConnection(setup);
-    if (conn == NULL) return 0;
-        
+
     MYSQL_BIND bind[2];
     MYSQL_TIME sql_start, sql_end;
     memset(bind, 0, sizeof(bind));
-    memset(&sql_start, 0, sizeof(sql_start));
-    memset(&sql_end, 0, sizeof(sql_end));
-    
-    sql_start.year = start->year;
-    sql_start.month = start->month;
-    sql_start.day = start->day;
-    sql_start.hour = start->hour;
-
-    sql_end.year = end->year;
-    sql_end.month = end->month;
-    sql_end.day = end->day;
-    sql_end.hour = end->hour;
-    // Just in case you are checking a single hour
-    sql_end.minute = 59;
-    sql_end.second = 59;
+    setRangeTimes(start, end, &sql_start, &sql_end);
+    unsigned int shards = rangeShardCount(&sql_start, &sql_end);
+    if (shards > 1) return fetchShardedRange(setup, &sql_start, &sql_end, shards, PREFETCH_ROWS, series);
+        
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
     
     bind[0].buffer_type = MYSQL_TYPE_TIMESTAMP;
     bind[0].buffer = (void*)&sql_start;
@@ -182,72 +197,383 @@ int getDataInRange(SQLSetup *setup, TimeValue *start, TimeValue *end, DataNode *
     bind[1].buffer = (void *)&sql_end;
     bind[1].is_null = 0;
     
-    MYSQL_STMT *stmt = mysql_stmt_init(conn);
+    MYSQL_STMT *stmt = getStatement(setup, connection, RANGE_STATEMENT);
     if (!stmt) {
-        fprintf(stderr, "mysql_stmt_init() failed\n");
-        mysql_close(conn);
-        return 1;
-    }
-
-    if (mysql_stmt_prepare(stmt, "SELECT * FROM data_main WHERE time BETWEEN ? AND ?", -1)) {
-        fprintf(stderr, "mysql_stmt_prepare() failed: %s\n", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        mysql_close(conn);
-        return 1;
+        releaseConnection(setup, connection, 0);
+        return 0;
     }
 
     if (mysql_stmt_bind_param(stmt, bind)) {
         fprintf(stderr, "mysql_stmt_bind_param() failed: %s\n", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        mysql_close(conn);
-        return 1;
+        releaseConnection(setup, connection, 0);
+        return 0;
     }
 
     if (mysql_stmt_execute(stmt)) {
         fprintf(stderr, "mysql_stmt_execute() failed: %s\n", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        mysql_close(conn);
-        return 1;
+        releaseConnection(setup, connection, 0);
+        return 0;
     }
         
     // FETCH
+    RangeRow row;
     MYSQL_BIND resultBind[5];
-    memset(resultBind, 0, sizeof(resultBind));
+    bindRangeRow(resultBind, &row);
+
+    if (mysql_stmt_bind_result(stmt, resultBind)) {
+        fprintf(stderr, "Result bind failed: %s\n", mysql_stmt_error(stmt));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+
+    // Buffer the result client side so the row count is known and the
+    // series can be sized with one allocation.
+    if (mysql_stmt_store_result(stmt)) {
+        fprintf(stderr, "mysql_stmt_store_result() failed: %s\n", mysql_stmt_error(stmt));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    if (!reserveDataSeries(series, series->count + (size_t)mysql_stmt_num_rows(stmt))) {
+        mysql_stmt_free_result(stmt);
+        releaseConnection(setup, connection, 1);
+        return 0;
+    }
+
+    while (mysql_stmt_fetch(stmt) == 0)
+        appendRangeRow(series, &row);
         
-    int dataValues[5];
-    MYSQL_TIME ts;
-
-    resultBind[0].buffer_type = MYSQL_TYPE_LONG;
-    resultBind[0].buffer = &dataValues[0];
-    resultBind[1].buffer_type = MYSQL_TYPE_LONG;
-    resultBind[1].buffer = &dataValues[1];
-    resultBind[2].buffer_type = MYSQL_TYPE_LONG;
-    resultBind[2].buffer = &dataValues[2];
-    resultBind[3].buffer_type = MYSQL_TYPE_LONG;
-    resultBind[3].buffer = &dataValues[3];
-    resultBind[4].buffer_type = MYSQL_TYPE_TIMESTAMP;
-    resultBind[4].buffer = &ts;
+    // Keep the prepared statement cached, only drop the buffered rows
+    mysql_stmt_free_result(stmt);
+    releaseConnection(setup, connection, 1);
+    return 1;
+}
+
+// Same rows as getDataInRange, fetched through a read-only server cursor
+// PREFETCH_ROWS at a time and handed over STREAM_BATCH_ROWS at a time, so
+// memory stays the same however long the range is. With SHARD_COUNT > 1
+// long ranges are fetched in parallel shards (see shardedFetch.h).
+int streamRowsInRange(SQLSetup *setup, MYSQL_TIME *sql_start, MYSQL_TIME *sql_end,
+    DataBatchCallback callback, void *context) {
+    MYSQL_BIND bind[2];
+    memset(bind, 0, sizeof(bind));
+    unsigned int shards = rangeShardCount(sql_start, sql_end);
+    if (shards > 1)
+        return streamShardedRange(setup, sql_start, sql_end, shards, STREAM_BATCH_ROWS, PREFETCH_ROWS,
+            callback, context);
+    bind[0].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[0].buffer = sql_start;
+    bind[1].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[1].buffer = sql_end;
+
+    DataSeries batch;
+    initDataSeries(&batch);
+    if (!reserveDataSeries(&batch, (STREAM_BATCH_ROWS > 0 ? STREAM_BATCH_ROWS : 1))) return 0;
+
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) {
+        freeDataSeries(&batch);
+        return 0;
+    }
+
+    RangeRow row;
+    MYSQL_BIND resultBind[5];
+    bindRangeRow(resultBind, &row);
+
+    unsigned long cursorType = CURSOR_TYPE_READ_ONLY;
+    unsigned long prefetchRows = (PREFETCH_ROWS > 0 ? PREFETCH_ROWS : 1);
+    MYSQL_STMT *stmt = getStatement(setup, connection, RANGE_CURSOR_STATEMENT);
+    if (stmt == NULL ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_CURSOR_TYPE, &cursorType) ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_PREFETCH_ROWS, &prefetchRows) ||
+        mysql_stmt_bind_param(stmt, bind) ||
+        mysql_stmt_execute(stmt) ||
+        mysql_stmt_bind_result(stmt, resultBind)) {
+        if (stmt != NULL) fprintf(stderr, "Range stream failed: %s\n", mysql_stmt_error(stmt));
+        releaseConnection(setup, connection, 0);
+        freeDataSeries(&batch);
+        return 0;
+    }
+
+    int result = 1, status;
+    while ((status = mysql_stmt_fetch(stmt)) == 0) {
+        appendRangeRow(&batch, &row);
+        if (batch.count == batch.capacity) {
+            int more = callback(&batch, context);
+            batch.count = 0;
+            if (!more) break;
+        }
+    }
+    if (status == 1) {
+        fprintf(stderr, "mysql_stmt_fetch() failed: %s\n", mysql_stmt_error(stmt));
+        result = 0;
+    }
+    else if (batch.count > 0) callback(&batch, context);
+
+    // Closes the cursor; the statement stays cached
+    mysql_stmt_free_result(stmt);
+    mysql_stmt_reset(stmt);
+    releaseConnection(setup, connection, result);
+    freeDataSeries(&batch);
+    return result;
+}
+
+// Local time of the first second of value->hour
+time_t timeValueToTime(TimeValue *value) {
+    struct tm local;
+    memset(&local, 0, sizeof(local));
+    local.tm_year = value->year - 1900;
+    local.tm_mon = value->month - 1;
+    local.tm_mday = value->day;
+    local.tm_hour = value->hour;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+// Hours ending before this can no longer get rows: nothing of theirs is
+// still on its way into the spool or waiting in it
+time_t cacheClosedBefore() {
+    time_t closedBefore = time(NULL) - RANGE_CACHE_GRACE_SECONDS;
+    Reading oldest;
+    // There is no spool in report mode
+    if (spool.map != NULL && peekSpool(&spool, &oldest, 1) == 1 && oldest.time < closedBefore)
+        closedBefore = oldest.time;
+    return closedBefore;
+}
+
+// Fetches the hours first..last in one query, caching the closed ones
+int fetchCachedHours(SQLSetup *setup, time_t first, time_t last, time_t closedBefore,
+    DataBatchCallback callback, void *context) {
+    MYSQL_TIME sql_start, sql_end;
+    toMySQLTime(first, &sql_start);
+    toMySQLTime(last + RANGE_CACHE_HOUR - 1, &sql_end);
+    CacheFill fill;
+    beginCacheFill(&fill, &rangeCache, &hourFile, first, last, closedBefore, callback, context);
+    rangeCache.queries++;
+    int result = streamRowsInRange(setup, &sql_start, &sql_end, cacheFillBatch, &fill);
+    endCacheFill(&fill, result);
+    return result;
+}
+
+// Hands over a closed hour from the range cache or else the hour file.
+// Returns 0 when neither has it; *more is 0 when the callback stopped.
+int sendCachedHour(time_t hour, DataBatchCallback callback, void *context, int *more) {
+    CachedHour *entry = lookupCachedHour(&rangeCache, hour);
+    if (entry != NULL) {
+        rangeCache.hits++;
+        touchCachedHour(&rangeCache, entry);
+        *more = (entry->rows.count == 0 || callback(&entry->rows, context));
+        return 1;
+    }
+    DataSeries rows;
+    initDataSeries(&rows);
+    if (!readHourFile(&hourFile, hour, &rows)) {
+        freeDataSeries(&rows);
+        return 0;
+    }
+    *more = (rows.count == 0 || callback(&rows, context));
+    storeCachedHour(&rangeCache, hour, &rows);
+    return 1;
+}
+
+// streamRowsInRange for the whole hours of start..end through the range
+// cache and the hour file. Cached hours are handed over without a query,
+// each run of missing or still open hours is fetched with one.
+int streamDataInRange(SQLSetup *setup, TimeValue *start, TimeValue *end,
+    DataBatchCallback callback, void *context) {
+    if (start == NULL || end == NULL) {
+        fprintf(stderr, "Null time range passed.\n");
+        return 0;
+    }
+    if (rangeCache.capacity == 0 && !hourFileOpen(&hourFile)) {
+        MYSQL_TIME sql_start, sql_end;
+        setRangeTimes(start, end, &sql_start, &sql_end);
+        return streamRowsInRange(setup, &sql_start, &sql_end, callback, context);
+    }
+
+    time_t first = timeValueToTime(start), last = timeValueToTime(end);
+    time_t closedBefore = cacheClosedBefore();
+    time_t runStart = 0;
+    int inRun = 0;
+    for (time_t hour = first; hour <= last; hour += RANGE_CACHE_HOUR) {
+        int cached = (hour + RANGE_CACHE_HOUR <= closedBefore &&
+            (lookupCachedHour(&rangeCache, hour) != NULL || findHourSlot(&hourFile, hour) != NULL));
+        if (cached && inRun) {
+            inRun = 0;
+            if (!fetchCachedHours(setup, runStart, hour - RANGE_CACHE_HOUR, closedBefore, callback, context))
+                return 0;
+        }
+        // The fetch may have evicted it from memory, the file still has it
+        int more = 1;
+        if (cached && sendCachedHour(hour, callback, context, &more)) {
+            if (!more) return 1;
+            continue;
+        }
+        rangeCache.misses++;
+        if (!inRun) runStart = hour;
+        inRun = 1;
+    }
+    if (inRun) return fetchCachedHours(setup, runStart, last, closedBefore, callback, context);
+    return 1;
+}
+
+// Bucket widths an aggregated query can use, smallest first
+const unsigned int BUCKET_SECONDS[] = {
+    10, 30, 60, 120, 300, 600, 900, 1800, 3600, 7200, 10800, 21600, 43200,
+    86400, 172800, 604800
+};
+
+// Smallest width that keeps the range at or under targetPoints buckets
+unsigned int chooseBucketSeconds(uint64_t rangeSeconds, size_t targetPoints) {
+    size_t count = sizeof(BUCKET_SECONDS) / sizeof(BUCKET_SECONDS[0]);
+    if (targetPoints == 0) targetPoints = 1;
+    for (size_t i = 0; i < count; i++)
+        if (rangeSeconds / BUCKET_SECONDS[i] < targetPoints) return BUCKET_SECONDS[i];
+    return BUCKET_SECONDS[count - 1];
+}
+
+// Coarsest table that can answer the range at this bucket width: the daily
+// rollup when buckets are whole days and the range covers whole days (or
+// its start is only left in the daily rollup, see compactedBucketSeconds;
+// the query is then widened to whole days), the hourly rollup for whole
+// hour buckets, otherwise the raw rows.
+enum SQLStatement chooseBucketSource(TimeValue *start, TimeValue *end, unsigned int bucketSeconds) {
+    if (bucketSeconds % 86400 == 0 && ((start->hour == 0 && end->hour == 23) ||
+        compactedBucketSeconds(&compaction, timeValueToTime(start), time(NULL)) == SECONDS_PER_DAY))
+        return DAILY_RANGE_STATEMENT;
+    if (bucketSeconds % 3600 == 0) return HOURLY_RANGE_STATEMENT;
+    return AGGREGATE_STATEMENT;
+}
+
+const char *bucketSourceName(enum SQLStatement source) {
+    switch (source) {
+        case DAILY_RANGE_STATEMENT: return "daily rollup";
+        case HOURLY_RANGE_STATEMENT: return "hourly rollup";
+        default: return "raw rows";
+    }
+}
+
+// MIN / MAX / AVG / COUNT per time bucket, computed by the server from the
+// raw rows or one of the rollups
+int getBucketedDataInRange(SQLSetup *setup, TimeValue *start, TimeValue *end,
+    unsigned int bucketSeconds, enum SQLStatement source, DataSeries *series) {
+    if (start == NULL || end == NULL) {
+        fprintf(stderr, "Null time range passed.\n");
+        return 0;
+    }
+
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
+
+    MYSQL_BIND bind[4];
+    MYSQL_TIME sql_start, sql_end;
+    memset(bind, 0, sizeof(bind));
+    // The daily rollup only has whole days
+    TimeValue dayStart = *start, dayEnd = *end;
+    if (source == DAILY_RANGE_STATEMENT) {
+        dayStart.hour = 0;
+        dayEnd.hour = 23;
+    }
+    setRangeTimes(&dayStart, &dayEnd, &sql_start, &sql_end);
+    int width = (int)bucketSeconds;
+
+    bind[0].buffer_type = MYSQL_TYPE_LONG;
+    bind[0].buffer = &width;
+    bind[1].buffer_type = MYSQL_TYPE_LONG;
+    bind[1].buffer = &width;
+    bind[2].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[2].buffer = &sql_start;
+    bind[3].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[3].buffer = &sql_end;
+
+    MYSQL_STMT *stmt = getStatement(setup, connection, source);
+    if (!stmt) {
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    if (mysql_stmt_bind_param(stmt, bind)) {
+        fprintf(stderr, "mysql_stmt_bind_param() failed: %s\n", mysql_stmt_error(stmt));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    if (mysql_stmt_execute(stmt)) {
+        fprintf(stderr, "mysql_stmt_execute() failed: %s\n", mysql_stmt_error(stmt));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+
+    DataBucket bucket;
+    long long samples = 0;
+    MYSQL_BIND resultBind[8];
+    memset(resultBind, 0, sizeof(resultBind));
+    resultBind[0].buffer_type = MYSQL_TYPE_DATETIME;
+    resultBind[0].buffer = &bucket.time;
+    resultBind[1].buffer_type = MYSQL_TYPE_LONGLONG;
+    resultBind[1].buffer = &samples;
+    double *columns[6] = {
+        &bucket.temperature, &bucket.temperatureMin, &bucket.temperatureMax,
+        &bucket.humidity, &bucket.humidityMin, &bucket.humidityMax
+    };
+    for (int i = 0; i < 6; i++) {
+        resultBind[i + 2].buffer_type = MYSQL_TYPE_DOUBLE;
+        resultBind[i + 2].buffer = columns[i];
+    }
 
     if (mysql_stmt_bind_result(stmt, resultBind)) {
         fprintf(stderr, "Result bind failed: %s\n", mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        mysql_close(conn);
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    if (mysql_stmt_store_result(stmt)) {
+        fprintf(stderr, "mysql_stmt_store_result() failed: %s\n", mysql_stmt_error(stmt));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    if (!reserveDataSeries(series, series->count + (size_t)mysql_stmt_num_rows(stmt))) {
+        mysql_stmt_free_result(stmt);
+        releaseConnection(setup, connection, 1);
         return 0;
     }
 
     while (mysql_stmt_fetch(stmt) == 0) {
-        DataValue *data = malloc(sizeof(DataValue));
-        data->time = ts;
-        convertData(dataValues, &data->temperature, &data->humidity);
-        data->f_temperature = (data->temperature * (9.0/5.0)) + 32;
-        appendDataNode(dataList, data);
+        bucket.samples = (uint32_t)samples;
+        appendDataBucket(series, &bucket);
     }
-        
-    mysql_stmt_close(stmt);
-    mysql_close(conn);
+
+    mysql_stmt_free_result(stmt);
+    releaseConnection(setup, connection, 1);
     return 1;
 }
 
+enum QueryMode { RAW_MODE = 0, AGGREGATED_MODE = 1 };
+
+// Bucket width for the range so it comes back as about TARGET_POINTS rows
+unsigned int rangeBucketSeconds(TimeValue *start, TimeValue *end) {
+    MYSQL_TIME sql_start, sql_end;
+    setRangeTimes(start, end, &sql_start, &sql_end);
+    uint64_t from = timestampKey(&sql_start), to = timestampKey(&sql_end);
+    unsigned int bucketSeconds = chooseBucketSeconds(to > from ? to - from + 1 : 1, TARGET_POINTS);
+
+    // Compacted ranges only exist in the rollups
+    unsigned int minimum = compactedBucketSeconds(&compaction, timeValueToTime(start), time(NULL));
+    size_t count = sizeof(BUCKET_SECONDS) / sizeof(BUCKET_SECONDS[0]);
+    for (size_t i = 0; i < count && (bucketSeconds < minimum || bucketSeconds % minimum != 0); i++)
+        bucketSeconds = BUCKET_SECONDS[i];
+    return bucketSeconds;
+}
+
+int getSeriesInRange(SQLSetup *setup, TimeValue *start, TimeValue *end, enum QueryMode mode, DataSeries *series) {
+    if (mode == RAW_MODE) {
+        initDataSeries(series);
+        if (rangeCache.capacity > 0 || hourFileOpen(&hourFile))
+            return streamDataInRange(setup, start, end, appendBatchCallback, series);
+        return getDataInRange(setup, start, end, series);
+    }
+    initBucketSeries(series);
+    unsigned int bucketSeconds = rangeBucketSeconds(start, end);
+    return getBucketedDataInRange(setup, start, end, bucketSeconds,
+        chooseBucketSource(start, end, bucketSeconds), series);
+}
+
 char *promptString(const char *prompt) {
     printf("%s", prompt);
     char buffer[256];
@@ -264,39 +590,115 @@ char *promptString(const char *prompt) {
     return result;
 }
 
-void processData(SQLSetup *setup) {
-    int data[5];
+// Runs on the sampler thread. Only reads the sensor and hands the result to
+// the storage and display threads and the Watch channel so slow I/O never
+// shifts the next sample.
+void processData() {
+    Sample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.status = SAMPLE_READ_FAILED;
     for (size_t i = 0; i < MAX_READ_TRIES; i++) {
-        if (read_dht11_dat(data)) {
-            for (size_t j = 0; j < MAX_STORE_TRIES; j++) {
-                if (storeData(data, setup)) continue;
-                sleep(1);
-            }
-            double temp, hum;
-            convertData(data, &hum, &temp);
-            writeData(temp, hum, time(NULL));
-            return;
+        if (readSensor(&sensor, sample.reading.data)) {
+            sample.status = SAMPLE_OK;
+            break;
         }
     }
-    writeRegister(0, 0, "WRITE ISSUE");
+    sample.reading.time = time(NULL);
+    if (sample.status == SAMPLE_OK)
+        pushSample(&storageRing, &sample);
+    pushSample(&displayRing, &sample);
+    publishSample(&sampleChannel, &sample);
 }
 
-volatile int stopMainQueryThread = 0;
+Scheduler sampleScheduler;
 void *mainQuery(void *arg) {
-    SQLSetup *setup = (SQLSetup*)arg;
-    // Wait the time before processing. So I can test run the program without adding
+    (void)arg;
+    // The first tick is one period out. So I can test run the program without adding
     // unnecessary data.
-    for (size_t i = 0; i < RATE_SECONDS; i++) {
-        if (stopMainQueryThread) break;
-        sleep(1);
+    while (waitNextTick(&sampleScheduler))
+        processData();
+    return NULL;
+}
+
+volatile int stopStorageThread = 0;
+void *storageQuery(void *arg) {
+    (void)arg;
+    Sample sample;
+    while (1) {
+        int stopping = stopStorageThread;
+        while (popSample(&storageRing, &sample)) {
+            if (!appendSpool(&spool, sample.reading.data, sample.reading.time))
+                fprintf(stderr, "Failed to spool reading\n");
+        }
+        // The sampler has stopped by now, so the ring was fully emptied
+        if (stopping) break;
+        waitSampleRing(&storageRing, 1000);
     }
-    while (!stopMainQueryThread) {
-        processData(setup);
-        for (size_t i = 0; i < RATE_SECONDS; i++) {
-            if (stopMainQueryThread) break;
-            sleep(1);
+    return NULL;
+}
+
+volatile int stopDisplayThread = 0;
+void *displayQuery(void *arg) {
+    (void)arg;
+    Sample sample;
+    while (!stopDisplayThread) {
+        waitSampleRing(&displayRing, 1000);
+        // Only the newest sample is worth showing
+        int have = 0;
+        while (popSample(&displayRing, &sample)) have = 1;
+        if (!have) continue;
+        if (sample.status != SAMPLE_OK) {
+            writeRegister(0, 0, "WRITE ISSUE");
+            continue;
         }
+        double temp, hum;
+        convertData(sample.reading.data, &hum, &temp);
+        writeData(temp, hum, sample.reading.time);
+    }
+    return NULL;
+}
+
+// Rolls the partitions and compacts once at start up, then every
+// COMPACTION_INTERVAL_US
+Scheduler maintenanceScheduler;
+void *maintenanceQuery(void *arg) {
+    SQLSetup *setup = (SQLSetup*)arg;
+    if (PARTITION_MONTHS == 0 && !compactionEnabled(&compaction)) return NULL;
+    do {
+        if (PARTITION_MONTHS > 0) maintainPartitions(setup, PARTITION_MONTHS);
+        if (compactionEnabled(&compaction)) runCompaction(setup, &compaction);
+    } while (waitNextTick(&maintenanceScheduler));
+    mysql_thread_end();
+    return NULL;
+}
+
+volatile int stopDrainThread = 0;
+void *drainQuery(void *arg) {
+    SQLSetup *setup = (SQLSetup*)arg;
+    size_t batchSize = FLUSH_COUNT;
+    if (batchSize == 0) batchSize = 1;
+    if (batchSize > MAX_FLUSH_COUNT) batchSize = MAX_FLUSH_COUNT;
+    Reading *batch = malloc(batchSize * sizeof(Reading));
+    if (batch == NULL) {
+        perror("malloc failed");
+        return NULL;
+    }
+    while (!stopDrainThread) {
+        waitSpool(&spool, 1);
+        syncSpool(&spool, 0);
+        drainSpool(&spool, setup, batch, batchSize, FLUSH_SECONDS, 0);
+    }
+    // Last chance to store everything. Whatever is left stays in the spool
+    // and is replayed on the next start.
+    syncSpool(&spool, 1);
+    for (size_t i = 0; i < MAX_STORE_TRIES; i++) {
+        if (drainSpool(&spool, setup, batch, batchSize, FLUSH_SECONDS, 1)) break;
+        sleep(1);
     }
+    if (pendingSpool(&spool) > 0)
+        fprintf(stderr, "%llu readings left in spool \"%s\"\n", (unsigned long long)pendingSpool(&spool), spool.path);
+    free(batch);
+    mysql_thread_end();
     return NULL;
 }
 
@@ -321,6 +723,9 @@ void printCommands() {
     printf("%5s%40s\n", "Test / T", "Test the SQL connection.");
     printf("%5s%40s\n", "Data / D", "Open the tool to check the database.");
     printf("%5s%40s\n", "Show / S", "Show the current global settings.");
+    printf("%5s%40s\n", "Backfill / B", "Rebuild the hourly / daily rollups.");
+    printf("%5s%40s\n", "Compact / C", "Run the retention / compaction job now.");
+    printf("%5s%40s\n", "Watch / W", "Watch the live readings and rolling stats.");
 }
 
 void enterToContinue() {
@@ -374,149 +779,405 @@ void printTime(TimeValue *value) {
         value->year, value->month, value->day, value->hour);
 }
 
-enum PlotType { BOTH = 0, TEMPERATURE = 1, HUMIDITY = 2 };
-
-void plotData(DataNode *dataList, TimeValue *start, TimeValue *end, enum PlotType type, int fahrenheit) {
-    if (dataList == NULL) return;
-    dataList = sortDataByTimestamp(dataList);
-        
-    double buffer = 2.0;
-    double min, max;
-    switch (type) {
-        case BOTH:
-            getMinMaxValue(dataList, &min, &max, buffer, fahrenheit);
-            break;
-        case TEMPERATURE:
-            getMinMaxTemperature(dataList, &min, &max, buffer, fahrenheit);
-            break;
-        case HUMIDITY:
-            getMinMaxHumidity(dataList, &min, &max, buffer);
-            break;
-        default: return;
+// Draws the chart as the next plot of the gnuplot session
+int plotChart(ChartData *chart) {
+    if (!openGnuplotSession(&gnuplot)) return 0;
+    FILE *pipe = gnuplot.pipe;
+    char label[64];
+    chartYLabel(chart, label, sizeof(label));
+    fprintf(pipe, "set xrange ['%.0f':'%.0f']\n", chart->fromSeconds, chart->toSeconds);
+    fprintf(pipe, "set yrange [%lf:%lf]\n", chart->min, chart->max);
+    fprintf(pipe, "set ylabel '%s'\n", label);
+    ChartElement elements[4];
+    int count = chartElements(chart, elements);
+    fputs("plot", pipe);
+    for (int i = 0; i < count; i++) {
+        fprintf(pipe, "%s '-' binary record=(%zu) format='%%%zufloat64' ", (i > 0 ? "," : ""), chart->count, chart->columns);
+        // Columns count from 1 in gnuplot
+        if (elements[i].highColumn != 0)
+            fprintf(pipe, "using 1:%d:%d title '%s' with filledcurves fs transparent solid 0.25",
+                elements[i].lowColumn + 1, elements[i].highColumn + 1, elements[i].title);
+        else
+            fprintf(pipe, "using 1:%d title '%s' with %s", elements[i].column + 1, elements[i].title,
+                (chart->columns == 7 ? "lines lw 2" : "linespoints pt 7 ps 1.5"));
     }
-        
-    FILE *gnuplot = popen("gnuplot -persistent", "w");
-    if (gnuplot == NULL) {
-        perror("Failed to open gnuplot");
+    fputc('\n', pipe);
+    for (int i = 0; i < count; i++) sendGnuplotRecords(&gnuplot, chart->records, chart->count, chart->columns);
+    return finishGnuplotPlot(&gnuplot);
+}
+
+void plotData(DataSeries *series, TimeValue *start, TimeValue *end, enum PlotType type, int fahrenheit) {
+    if (series == NULL || series->count == 0) {
+        puts("No data in the time range.");
         return;
     }
-        
-    fprintf(gnuplot, "set terminal wxt\n");
+    sortDataByTimestamp(series);
+    MYSQL_TIME sql_start, sql_end;
+    setRangeTimes(start, end, &sql_start, &sql_end);
+    ChartData chart;
+    if (!buildChartData(series, plotSeconds(&sql_start), plotSeconds(&sql_end), type, fahrenheit, &chart)) return;
+    plotChart(&chart);
+    freeChartData(&chart);
+}
 
-    fprintf(gnuplot, "set xdata time\n");
-    fprintf(gnuplot, "set timefmt '%%Y-%%m-%%d%%H:%%M:%%S'\n");
-    fprintf(gnuplot, "set format x '%%H:%%M'\n");
-    fprintf(gnuplot, "set xlabel 'Time'\n");
-        
-    fprintf(gnuplot, "set xrange ['%04d-%02d-%02d%02d:%02d:%02d' to '%04d-%02d-%02d%02d:%02d:%02d']\n",
-        start->year, start->month, start->day, start->hour, 0, 0,
-        end->year, end->month, end->day, end->hour, 59, 59);
-    fprintf(gnuplot, "set yrange [%lf:%lf]\n", min - buffer, max + buffer);
-    
-    switch (type) {
-        case BOTH:
-            fprintf(gnuplot, "set ylabel 'Temperature (%s) / Humidity'\n", (fahrenheit ? "F" : "C"));
-            fprintf(gnuplot, "plot '-' using 1:2 title 'Temperature' with linespoints pt 7 ps 1.5, "
-                "'-' using 1:2 title 'Humidity' with linespoints pt 7 ps 1.5\n");
-            break;
-        case HUMIDITY:
-            fprintf(gnuplot, "set ylabel 'Humidity'\n");
-            fprintf(gnuplot, "plot '-' using 1:2 title 'Humidity' with linespoints pt 7 ps 1.5\n");
-            break;
-        case TEMPERATURE:
-            fprintf(gnuplot, "set ylabel 'Temperature (%s)'\n", (fahrenheit ? "F" : "C"));
-            fprintf(gnuplot, "plot '-' using 1:2 title 'Temperature' with linespoints pt 7 ps 1.5\n");
-            break;
+struct pyramidLoad {
+    DataSeries rows;
+    int tooLong;
+};
+typedef struct pyramidLoad PyramidLoad;
+
+int pyramidLoadBatch(DataSeries *batch, void *context) {
+    PyramidLoad *load = (PyramidLoad*)context;
+    if (load->rows.count + batch->count > PYRAMID_MAX_ROWS) {
+        load->tooLong = 1;
+        return 0;
+    }
+    return appendDataSeries(&load->rows, batch);
+}
+
+// Loads the raw rows of start..end into the pyramid. Hours that are not
+// closed yet are left out of its span, so a window reaching into them is
+// loaded again. *tooLong is set when the range has more rows than
+// PYRAMID_MAX_ROWS.
+int loadPyramid(SQLSetup *setup, TimeValue *start, TimeValue *end, SeriesPyramid *pyramid, int *tooLong) {
+    PyramidLoad load;
+    initDataSeries(&load.rows);
+    load.tooLong = 0;
+    int result = streamDataInRange(setup, start, end, pyramidLoadBatch, &load);
+    *tooLong = load.tooLong;
+    if (!result || load.tooLong) {
+        freeDataSeries(&load.rows);
+        return 0;
+    }
+    MYSQL_TIME sql_start, sql_end, closed;
+    setRangeTimes(start, end, &sql_start, &sql_end);
+    toMySQLTime(cacheClosedBefore() - 1, &closed);
+    uint64_t toKey = timestampKey(&sql_end);
+    if (timestampKey(&closed) < toKey) toKey = timestampKey(&closed);
+    sortDataByTimestamp(&load.rows);
+    return buildSeriesPyramid(pyramid, &load.rows, timestampKey(&sql_start), toKey);
+}
+
+// The rows of fromKey..toKey brought down to PLOT_POINTS by DOWNSAMPLE_MODE
+int pyramidView(SeriesPyramid *pyramid, uint64_t fromKey, uint64_t toKey, enum PlotType type, DataSeries *view) {
+    if (DOWNSAMPLE_MODE == ENVELOPE_DOWNSAMPLE) return queryPyramid(pyramid, fromKey, toKey, PLOT_POINTS, view);
+    return downsampleRows(&pyramid->rows, pyramid->keys, pyramidLowerBound(pyramid, fromKey),
+        pyramidLowerBound(pyramid, toKey + 1), DOWNSAMPLE_MODE, type != HUMIDITY, type != TEMPERATURE,
+        PLOT_POINTS, view);
+}
+
+// Raw ranges are loaded into the pyramid once; zooming or panning inside
+// them is drawn from memory, brought down to PLOT_POINTS points by
+// DOWNSAMPLE_MODE. Ranges too long to hold are drawn from server side
+// buckets instead, so the time to draw stays flat however long the range.
+void graphData(SQLSetup *setup, TimeValue *start, TimeValue *end, enum PlotType type, int fahrenheit,
+    enum QueryMode mode, SeriesPyramid *pyramid) {
+    if (mode == RAW_MODE) {
+        MYSQL_TIME sql_start, sql_end;
+        setRangeTimes(start, end, &sql_start, &sql_end);
+        uint64_t fromKey = timestampKey(&sql_start), toKey = timestampKey(&sql_end);
+        int tooLong = 0;
+        if (pyramidCovers(pyramid, fromKey, toKey) || loadPyramid(setup, start, end, pyramid, &tooLong)) {
+            DataSeries view;
+            if (pyramidView(pyramid, fromKey, toKey, type, &view)) plotData(&view, start, end, type, fahrenheit);
+            freeDataSeries(&view);
+            return;
         }
-        
-        DataNode *current = NULL;
-        
-    switch (type) {
-        case BOTH:
-            current = dataList;
-            while (current != NULL) {
-                char timestamp[64];
-                snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02d%02d:%02d:%02d",
-                    current->data.time.year, current->data.time.month, current->data.time.day,
-                    current->data.time.hour, current->data.time.minute, current->data.time.second);
-                    fprintf(gnuplot, "%s %.2lf\n", timestamp, (fahrenheit ? current->data.f_temperature : current->data.temperature));
-                    current = current->next;
-            }
-            fprintf(gnuplot, "e\n");
-            __attribute__((fallthrough));
-        case HUMIDITY:
-            current = dataList;
-            while (current != NULL) {
-                char timestamp[64];
-                snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02d%02d:%02d:%02d",
-                    current->data.time.year, current->data.time.month, current->data.time.day,
-                    current->data.time.hour, current->data.time.minute, current->data.time.second);
-                fprintf(gnuplot, "%s %.2lf\n", timestamp, current->data.humidity);
-                current = current->next;
-            }
-            fprintf(gnuplot, "e\n");
-            break;
-        case TEMPERATURE:
-            current = dataList;
-            while (current != NULL) {
-                char timestamp[64];
-                snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02d%02d:%02d:%02d",
-                    current->data.time.year, current->data.time.month, current->data.time.day,
-                    current->data.time.hour, current->data.time.minute, current->data.time.second);
-                fprintf(gnuplot, "%s %.2lf\n", timestamp, (fahrenheit ? current->data.f_temperature : current->data.temperature));
-                current = current->next;
-            }
-            fprintf(gnuplot, "e\n");
-            break;
+        if (!tooLong) return;
+        puts("Too many rows to hold, drawing server side buckets.");
+        mode = AGGREGATED_MODE;
     }
-    
-    fflush(gnuplot);
-    pclose(gnuplot);
+    DataSeries series;
+    if (getSeriesInRange(setup, start, end, mode, &series))
+        plotData(&series, start, end, type, fahrenheit);
+    freeDataSeries(&series);
 }
 
-void listData(SQLSetup *setup, TimeValue *start, TimeValue *end, int fahrenheit) {
-    DataNode *dataList = NULL;
-    if (!getDataInRange(setup, start, end, &dataList)) return;
-    DataNode *current = dataList;
-    int totalDataBlocks = 0;
-    
+struct reportRun {
+    const char *directory;
+    enum ReportFormat format;
+    pthread_mutex_t lock;
+    size_t charts;
+    size_t failed;
+};
+typedef struct reportRun ReportRun;
+
+// The rows of one day, rendered on a worker thread that frees it
+struct reportDay {
+    TimeValue day;
+    DataSeries rows;
+    ReportRun *run;
+};
+typedef struct reportDay ReportDay;
+
+// A day is drawn like a raw Graph of 00 to 23 with the pyramid and
+// DOWNSAMPLE_MODE, into <directory>/YYYY-MM-DD.png / .svg
+void renderReportDay(void *job) {
+    ReportDay *day = (ReportDay*)job;
+    ReportRun *run = day->run;
+    TimeValue start = day->day, end = day->day;
+    start.hour = 0;
+    end.hour = 23;
+    MYSQL_TIME sql_start, sql_end;
+    setRangeTimes(&start, &end, &sql_start, &sql_end);
+    uint64_t fromKey = timestampKey(&sql_start), toKey = timestampKey(&sql_end);
+
+    SeriesPyramid pyramid;
+    DataSeries view;
+    ChartData chart;
+    initSeriesPyramid(&pyramid);
+    initDataSeries(&view);
+    initChartData(&chart);
+    sortDataByTimestamp(&day->rows);
+    int result = buildSeriesPyramid(&pyramid, &day->rows, fromKey, toKey) &&
+        pyramidView(&pyramid, fromKey, toKey, BOTH, &view) &&
+        buildChartData(&view, plotSeconds(&sql_start), plotSeconds(&sql_end), BOTH, 0, &chart);
+    size_t charts = 0;
+    char title[16], path[4096];
+    snprintf(title, sizeof(title), "%04u-%02u-%02u", start.year, start.month, start.day);
+    if (result && (run->format & PNG_REPORT)) {
+        snprintf(path, sizeof(path), "%s/%s.png", run->directory, title);
+        result = renderChartPng(&chart, (unsigned int)PLOT_WIDTH, (unsigned int)(PLOT_WIDTH * 3 / 5), title, path);
+        charts += result;
+    }
+    if (result && (run->format & SVG_REPORT)) {
+        snprintf(path, sizeof(path), "%s/%s.svg", run->directory, title);
+        result = renderChartSvg(&chart, (unsigned int)PLOT_WIDTH, (unsigned int)(PLOT_WIDTH * 3 / 5), title, path);
+        charts += result;
+    }
+    freeChartData(&chart);
+    freeDataSeries(&view);
+    freeSeriesPyramid(&pyramid);
+    freeDataSeries(&day->rows);
+    free(day);
+
+    pthread_mutex_lock(&run->lock);
+    run->charts += charts;
+    if (!result) run->failed++;
+    pthread_mutex_unlock(&run->lock);
+}
+
+// Cuts the fetched rows into days and hands each finished day to the pool
+struct reportFetch {
+    WorkerPool *pool;
+    ReportRun *run;
+    ReportDay *day;
+    size_t days;
+};
+typedef struct reportFetch ReportFetch;
+
+void submitReportDay(ReportFetch *fetch) {
+    if (fetch->day == NULL) return;
+    submitWorkerJob(fetch->pool, fetch->day);
+    fetch->day = NULL;
+    fetch->days++;
+}
+
+int reportBatch(DataSeries *batch, void *context) {
+    ReportFetch *fetch = (ReportFetch*)context;
+    for (size_t i = 0; i < batch->count; i++) {
+        const MYSQL_TIME *time = &batch->time[i];
+        ReportDay *day = fetch->day;
+        if (day == NULL || day->day.day != time->day || day->day.month != time->month || day->day.year != time->year) {
+            submitReportDay(fetch);
+            day = malloc(sizeof(ReportDay));
+            if (day == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                return 0;
+            }
+            day->day.year = time->year;
+            day->day.month = time->month;
+            day->day.day = time->day;
+            day->day.hour = 0;
+            initDataSeries(&day->rows);
+            day->run = fetch->run;
+            fetch->day = day;
+        }
+        DataValue data;
+        getDataValue(batch, i, &data);
+        if (!appendDataValue(&day->rows, &data)) return 0;
+    }
+    return 1;
+}
+
+// "YYYY-MM-DD"
+int parseReportDay(const char *text, TimeValue *value) {
+    unsigned int year, month, day;
+    if (text == NULL || sscanf(text, "%u-%u-%u", &year, &month, &day) != 3 ||
+        month < 1 || month > 12 || day < 1 || day > 31) {
+        fprintf(stderr, "\"%s\" is not a YYYY-MM-DD day\n", (text != NULL ? text : ""));
+        return 0;
+    }
+    value->year = year;
+    value->month = month;
+    value->day = day;
+    value->hour = 0;
+    return 1;
+}
+
+// Renders a chart per day with readings from REPORT_FROM to REPORT_TO
+// (both yesterday when not set) into REPORT_DIR, REPORT_THREADS at a time,
+// while the range is still being fetched
+int runReport(SQLSetup *setup) {
+    TimeValue start, end;
+    time_t yesterday = time(NULL) - 86400;
+    struct tm local;
+    localtime_r(&yesterday, &local);
+    start.year = local.tm_year + 1900;
+    start.month = local.tm_mon + 1;
+    start.day = local.tm_mday;
+    start.hour = 0;
+    end = start;
+    if ((REPORT_FROM != NULL && !parseReportDay(REPORT_FROM, &start)) ||
+        (REPORT_TO != NULL && !parseReportDay(REPORT_TO, &end)))
+        return 0;
+    if (REPORT_TO == NULL && REPORT_FROM != NULL) end = start;
+    end.hour = 23;
+    if (timeDifference(&start, &end) > 0) {
+        fprintf(stderr, "The report starts after it ends\n");
+        return 0;
+    }
+    if (mkdir(REPORT_DIR, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create \"%s\": %s\n", REPORT_DIR, strerror(errno));
+        return 0;
+    }
+
+    ReportRun run;
+    memset(&run, 0, sizeof(run));
+    run.directory = REPORT_DIR;
+    run.format = REPORT_FORMAT;
+    pthread_mutex_init(&run.lock, NULL);
+    WorkerPool pool;
+    size_t threads = (REPORT_THREADS > 0 ? REPORT_THREADS : workerPoolDefaultThreads());
+    if (!startWorkerPool(&pool, threads, renderReportDay)) {
+        pthread_mutex_destroy(&run.lock);
+        return 0;
+    }
+    int64_t began = monotonicNs();
+    ReportFetch fetch = { &pool, &run, NULL, 0 };
+    int fetched = streamDataInRange(setup, &start, &end, reportBatch, &fetch);
+    // Even after a failed fetch the days that came in are drawn
+    submitReportDay(&fetch);
+    finishWorkerPool(&pool);
+    pthread_mutex_destroy(&run.lock);
+
+    printf("%zu charts for %zu days with readings written to %s on %zu threads in %.2f s\n", run.charts, fetch.days,
+        REPORT_DIR, pool.threadCount, (monotonicNs() - began) / 1e9);
+    if (run.failed > 0) fprintf(stderr, "%zu days could not be drawn\n", run.failed);
+    return fetched && run.failed == 0;
+}
+
+// "avg (min - max)" for one bucket column
+char *appendBucketValue(char *out, double average, double min, double max) {
+    out = appendDouble(out, average, 3);
+    out = appendString(out, " (");
+    out = appendDouble(out, min, 1);
+    out = appendString(out, " - ");
+    out = appendDouble(out, max, 1);
+    *out++ = ')';
+    return out;
+}
+
+void listBuckets(DataSeries *series, int fahrenheit, unsigned int bucketSeconds, const char *source) {
     char tempChar = (fahrenheit ? 'F' : 'C');
-    
-    double averageTemp = 0;
-    double averageHum = 0;
-    
-    double maxTemp = DBL_MIN;
-    double maxHum = DBL_MIN;
-    double minTemp = DBL_MAX;
-    double minHum = DBL_MAX;
-    
-    double currentTemp = 0;
-    while (current != NULL) {
-        currentTemp = (fahrenheit ? current->data.f_temperature : current->data.temperature);
-        printf("Temperature: %.3lf%c | Humidity: %.3lf | Time: %04d-%02d-%02d %02d:%02d:%02d\n",
-            currentTemp, tempChar, current->data.humidity,
-            current->data.time.year, current->data.time.month, current->data.time.day,
-            current->data.time.hour, current->data.time.minute, current->data.time.second);
-        averageTemp += currentTemp;
-        averageHum += current->data.humidity;
-        
-        if (currentTemp > maxTemp) maxTemp = currentTemp;
-        if (current->data.humidity > maxHum) maxHum = current->data.humidity;
-        if (currentTemp < minTemp) minTemp = currentTemp;
-        if (current->data.humidity < minHum) minHum = current->data.humidity;
-        
-        current = current->next;
-        totalDataBlocks++;
+    printf("%u second buckets from the %s: average (min - max)\n", bucketSeconds, source);
+    for (size_t i = 0; i < series->count; i++) {
+        double minTemp = series->temperatureMin[i], maxTemp = series->temperatureMax[i];
+        if (fahrenheit) {
+            minTemp = celsiusToFahrenheit(minTemp);
+            maxTemp = celsiusToFahrenheit(maxTemp);
+        }
+        char line[192];
+        char *p = appendString(line, "Temperature: ");
+        p = appendBucketValue(p, (fahrenheit ? series->f_temperature[i] : series->temperature[i]), minTemp, maxTemp);
+        *p++ = tempChar;
+        p = appendString(p, " | Humidity: ");
+        p = appendBucketValue(p, series->humidity[i], series->humidityMin[i], series->humidityMax[i]);
+        p = appendString(p, " | Time: ");
+        p = appendDateTime(p, series->time[i].year, series->time[i].month, series->time[i].day,
+            series->time[i].hour, series->time[i].minute, series->time[i].second, " ");
+        p = appendString(p, " | Readings: ");
+        p = appendUnsigned(p, series->samples[i]);
+        *p++ = '\n';
+        *p = '\0';
+        fputs(line, stdout);
+    }
+}
+
+void listRows(DataSeries *series, int fahrenheit) {
+    char tempChar = (fahrenheit ? 'F' : 'C');
+    for (size_t i = 0; i < series->count; i++) {
+        double currentTemp = (fahrenheit ? series->f_temperature[i] : series->temperature[i]);
+        double currentHum = series->humidity[i];
+        char line[128];
+        char *p = appendString(line, "Temperature: ");
+        p = appendDouble(p, currentTemp, 3);
+        *p++ = tempChar;
+        p = appendString(p, " | Humidity: ");
+        p = appendDouble(p, currentHum, 3);
+        p = appendString(p, " | Time: ");
+        p = appendDateTime(p, series->time[i].year, series->time[i].month, series->time[i].day,
+            series->time[i].hour, series->time[i].minute, series->time[i].second, " ");
+        *p++ = '\n';
+        *p = '\0';
+        fputs(line, stdout);
+    }
+}
+
+struct listStream {
+    int fahrenheit;
+    SummaryStream summary;
+};
+typedef struct listStream ListStream;
+
+// Prints each batch and folds it into the totals as it arrives
+int listBatch(DataSeries *batch, void *context) {
+    ListStream *list = (ListStream*)context;
+    listRows(batch, list->fahrenheit);
+    addToSummaryStream(&list->summary, batch, list->fahrenheit);
+    return 1;
+}
+
+void printSummary(SeriesSummary *summary, int fahrenheit) {
+    char tempChar = (fahrenheit ? 'F' : 'C');
+    if (summary->temperature.count > 0) {
+        printf("\nAverage temperature: %.3lf%c | Average humidity: %.3lf\n",
+            summary->temperature.mean, tempChar, summary->humidity.mean);
+        printf("Max temperature: %.3lf%c | Max humidity: %.3lf\n",
+            summary->temperature.max, tempChar, summary->humidity.max);
+        printf("Min temperature: %.3lf%c | Min humidity: %.3lf\n",
+            summary->temperature.min, tempChar, summary->humidity.min);
+        if (!isnan(summary->temperature.variance))
+            printf("Std dev temperature: %.3lf%c | Std dev humidity: %.3lf\n",
+                sqrt(summary->temperature.variance), tempChar, sqrt(summary->humidity.variance));
     }
-    averageTemp /= totalDataBlocks;
-    averageHum /= totalDataBlocks;
-    
-    printf("\nAverage temperature: %.3lf%c | Average humidity: %.3lf\n", averageTemp, tempChar, averageHum);
-    printf("Max temperature: %.3lf%c | Max humidity: %.3lf\n", maxTemp, tempChar, maxHum);
-    printf("Min temperature: %.3lf%c | Min humidity: %.3lf\n", minTemp, tempChar, minHum);
     
-    printf("Total values in set: %d\n", totalDataBlocks);
-    freeDataList(dataList);
+    printf("Total values in set: %zu\n", summary->temperature.count);
+}
+
+void listData(SQLSetup *setup, TimeValue *start, TimeValue *end, int fahrenheit, enum QueryMode mode) {
+    SeriesSummary summary;
+    if (mode == RAW_MODE) {
+        ListStream list;
+        list.fahrenheit = fahrenheit;
+        initSummaryStream(&list.summary);
+        if (!streamDataInRange(setup, start, end, listBatch, &list)) return;
+        finishSummaryStream(&list.summary, &summary);
+        printSummary(&summary, fahrenheit);
+        return;
+    }
+
+    DataSeries series;
+    if (!getSeriesInRange(setup, start, end, mode, &series)) {
+        freeDataSeries(&series);
+        return;
+    }
+    unsigned int bucketSeconds = rangeBucketSeconds(start, end);
+    listBuckets(&series, fahrenheit, bucketSeconds,
+        bucketSourceName(chooseBucketSource(start, end, bucketSeconds)));
+    summarizeBuckets(&series, fahrenheit, &summary);
+    printSummary(&summary, fahrenheit);
+    freeDataSeries(&series);
 }
 
 void printGraphingType(enum PlotType plotType) {
@@ -533,6 +1194,7 @@ void printEvaluationCommands() {
     printf("%5s%40s\n", "List  / L", "List data in time range.");
     printf("%5s%40s\n", "Graph / G", "Graph the data in the time range.");
     printf("%5s%40s\n", "Type  / T", "Change graphing type.");
+    printf("%5s%40s\n", "Mode  / M", "Toggle raw rows / server buckets.");
     printf("%5s%40s\n", "Range / R", "Set the time range for data retrieval.");
     printf("%5s%40s\n", "Back  / B", "Back to main control.");
 }
@@ -670,7 +1332,11 @@ void databaseMenu(SQLSetup *setup) {
     TimeValue start;
     TimeValue end;
     enum PlotType plotType = BOTH;
+    enum QueryMode queryMode = RAW_MODE;
     int fahrenheit = 0;
+    // Rows of the last raw Graph, for zooming and panning inside it
+    SeriesPyramid pyramid;
+    initSeriesPyramid(&pyramid);
     initTime(&start, &end);
     clearScreen();
     while (1) {
@@ -679,6 +1345,13 @@ void databaseMenu(SQLSetup *setup) {
         printTimeRange(&start, &end);
         printGraphingType(plotType);
         printf("Temperature type: %s\n", (fahrenheit ? "Fahrenheit" : "Celsius"));
+        if (queryMode == AGGREGATED_MODE) {
+            unsigned int bucketSeconds = rangeBucketSeconds(&start, &end);
+            printf("Query mode: AGGREGATED (%u second buckets from the %s)\n", bucketSeconds,
+                bucketSourceName(chooseBucketSource(&start, &end, bucketSeconds)));
+        }
+        else
+            printf("Query mode: RAW (graphs %s to %zu points)\n", downsampleModeName(DOWNSAMPLE_MODE), PLOT_POINTS);
         input = promptString("> ");
         if (testInput(input, "help", 1)) {
             clearScreen();
@@ -687,17 +1360,16 @@ void databaseMenu(SQLSetup *setup) {
         }
         else if (testInput(input, "list", 1)) {
             clearScreen();
-            listData(setup, &start, &end, fahrenheit);
+            listData(setup, &start, &end, fahrenheit, queryMode);
             enterToContinue();
         }
         else if (testInput(input, "graph", 1)) {
             clearScreen();
-            DataNode *dataList = NULL;
-            if (getDataInRange(setup, &start, &end, &dataList)) {
-                plotData(dataList, &start, &end, plotType, fahrenheit);
-                enterToContinue();
-            }
-            freeDataList(dataList);
+            graphData(setup, &start, &end, plotType, fahrenheit, queryMode, &pyramid);
+            enterToContinue();
+        }
+        else if (testInput(input, "mode", 1)) {
+            queryMode = (queryMode == RAW_MODE ? AGGREGATED_MODE : RAW_MODE);
         }
         else if (testInput(input, "fahrenheit", 1)) {
             fahrenheit = 1;
@@ -715,6 +1387,22 @@ void databaseMenu(SQLSetup *setup) {
             else if (testInput(tempInput, "humidity", 1))
                 plotType = HUMIDITY;
             if (tempInput != NULL) free(tempInput);
+            tempInput = promptString("Enter a downsampling mode for raw graphs (ENVELOPE / E, LTTB / L, MINMAX / M, NONE / N)\n> ");
+            if (testInput(tempInput, "envelope", 1))
+                DOWNSAMPLE_MODE = ENVELOPE_DOWNSAMPLE;
+            else if (testInput(tempInput, "lttb", 1))
+                DOWNSAMPLE_MODE = LTTB_DOWNSAMPLE;
+            else if (testInput(tempInput, "minmax", 1))
+                DOWNSAMPLE_MODE = MINMAX_DOWNSAMPLE;
+            else if (testInput(tempInput, "none", 1))
+                DOWNSAMPLE_MODE = NO_DOWNSAMPLE;
+            if (tempInput != NULL) free(tempInput);
+            char prompt[64];
+            snprintf(prompt, sizeof(prompt), "Points to draw (Enter keeps %zu)\n> ", PLOT_POINTS);
+            tempInput = promptString(prompt);
+            unsigned long points = strtoul(tempInput, NULL, 10);
+            if (points > 0) PLOT_POINTS = points;
+            free(tempInput);
         }
         else if (testInput(input, "range", 1)) {
             clearScreen();
@@ -724,9 +1412,144 @@ void databaseMenu(SQLSetup *setup) {
             break;
         clearScreen();
     }
+    freeSeriesPyramid(&pyramid);
     if (input != NULL) free(input);
 }
 
+struct watchInput {
+    volatile int back;
+    // Bumped for every "graph" line
+    volatile unsigned int graphToggles;
+};
+typedef struct watchInput WatchInput;
+
+// Reads the lines typed while Watch redraws, so the view never waits on
+// the keyboard
+void *watchInputQuery(void *arg) {
+    WatchInput *input = (WatchInput*)arg;
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), stdin) != NULL) {
+        buffer[strcspn(buffer, "\r\n\t")] = '\0';
+        if (buffer[0] == '\0' || testInput(buffer, "back", 1)) break;
+        if (testInput(buffer, "graph", 1)) input->graphToggles++;
+    }
+    input->back = 1;
+    return NULL;
+}
+
+// Takes everything the sampler published since the last call into the
+// rolling stats. Returns the number of samples taken.
+size_t receiveWatchSamples() {
+    Sample sample;
+    size_t count = 0;
+    while (receiveSample(&watchSubscriber, &sample)) {
+        count++;
+        if (sample.status != SAMPLE_OK) {
+            watchStats.failures++;
+            continue;
+        }
+        double temp, hum;
+        convertData(sample.reading.data, &hum, &temp);
+        addRollingReading(&watchStats, sample.reading.time, temp, hum);
+    }
+    return count;
+}
+
+// The minutes of the last hour as a bucketed series
+int watchHourSeries(DataSeries *series) {
+    initBucketSeries(series);
+    for (int64_t minute = watchStats.minute - watchStats.hour.minutes + 1; minute <= watchStats.minute; minute++) {
+        if (minute < 0) continue;
+        MinuteBucket *bucket = minuteBucket(&watchStats, minute);
+        if (bucket->minute != minute || bucket->count == 0) continue;
+        DataBucket row;
+        toMySQLTime((time_t)(minute * 60), &row.time);
+        row.samples = bucket->count;
+        row.temperature = bucket->temperatureSum / bucket->count;
+        row.temperatureMin = bucket->temperatureMin;
+        row.temperatureMax = bucket->temperatureMax;
+        row.humidity = bucket->humiditySum / bucket->count;
+        row.humidityMin = bucket->humidityMin;
+        row.humidityMax = bucket->humidityMax;
+        if (!appendDataBucket(series, &row)) return 0;
+    }
+    return 1;
+}
+
+void plotWatchHour() {
+    DataSeries series;
+    ChartData chart;
+    if (!watchHourSeries(&series) || series.count == 0) {
+        freeDataSeries(&series);
+        return;
+    }
+    MYSQL_TIME from, to;
+    toMySQLTime((time_t)((watchStats.minute - watchStats.hour.minutes + 1) * 60), &from);
+    toMySQLTime((time_t)((watchStats.minute + 1) * 60), &to);
+    if (buildChartData(&series, plotSeconds(&from), plotSeconds(&to), BOTH, 0, &chart)) {
+        plotChart(&chart);
+        freeChartData(&chart);
+    }
+    freeDataSeries(&series);
+}
+
+void drawWatch(int graph) {
+    // Home and clear instead of clearScreen(), which runs a process per frame
+    printf("\033[H\033[2J");
+    puts("Watch: readings straight from the sampler, the database is not queried.\n");
+    if (watchStats.readings == 0)
+        puts("Waiting for the first reading...");
+    else {
+        char stamp[32];
+        struct tm local;
+        localtime_r(&watchStats.latestTime, &local);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+        printf("Latest    %s  temperature %.2f C / %.2f F  humidity %.2f %%\n", stamp,
+            watchStats.latestTemperature, celsiusToFahrenheit(watchStats.latestTemperature),
+            watchStats.latestHumidity);
+    }
+    puts("Windows show min / avg / max.");
+    printRollingWindow("Last hour", &watchStats.hour);
+    printRollingWindow("Last day", &watchStats.day);
+    printf("\n%llu readings, %llu read failures, %llu missed, %llu late\n",
+        (unsigned long long)watchStats.readings, (unsigned long long)watchStats.failures,
+        (unsigned long long)watchSubscriber.missed, (unsigned long long)watchStats.late);
+    printf("Live graph %s. G + Enter to toggle it, Enter to go back.\n", (graph ? "on" : "off"));
+    fflush(stdout);
+}
+
+void watchMenu() {
+    WatchInput input = { 0, 0 };
+    pthread_t inputThread;
+    if (pthread_create(&inputThread, NULL, watchInputQuery, &input) != 0) {
+        perror("Failed to create thread");
+        return;
+    }
+    int graph = 0;
+    unsigned int graphToggles = 0;
+    time_t drawn = 0;
+    struct timespec pause = { 0, 100000000 };
+    while (!input.back) {
+        size_t received = receiveWatchSamples();
+        // The windows end at the current minute even when the sampler
+        // has stopped
+        time_t now = time(NULL);
+        if (watchStats.minute >= 0 && now / 60 > watchStats.minute) advanceRollingStats(&watchStats, now / 60);
+        int toggled = (input.graphToggles != graphToggles);
+        if (toggled) {
+            graphToggles = input.graphToggles;
+            graph = !graph;
+        }
+        if (received > 0 || toggled || now != drawn) {
+            if (graph && (received > 0 || toggled)) plotWatchHour();
+            drawWatch(graph);
+            drawn = now;
+        }
+        nanosleep(&pause, NULL);
+    }
+    pthread_join(inputThread, NULL);
+}
+
 void menuInput(SQLSetup *setup) {
     char *input = NULL;
     printf("%5s%40s\n", "Help / H", "Show all commands.");
@@ -740,7 +1563,7 @@ void menuInput(SQLSetup *setup) {
         }
         else if (testInput(input, "quit", 1)) {
             clearScreen();
-            stopMainQueryThread = 1;
+            stopScheduler(&sampleScheduler);
             puts("Quitting application...");
             break;
         }
@@ -752,14 +1575,75 @@ void menuInput(SQLSetup *setup) {
         else if (testInput(input, "data", 1)) {
             databaseMenu(setup);
         }
+        else if (testInput(input, "backfill", 1)) {
+            clearScreen();
+            puts("Rebuilding the rollup tables from the raw rows...");
+            // Compaction must not delete raw rows while they are summed
+            pthread_mutex_lock(&compaction.running);
+            int rebuilt = backfillRollups(setup);
+            pthread_mutex_unlock(&compaction.running);
+            printf("%s\n", (rebuilt ? "Rollups rebuilt." : "Backfill failed."));
+            enterToContinue();
+        }
+        else if (testInput(input, "compact", 1)) {
+            clearScreen();
+            if (!compactionEnabled(&compaction))
+                puts("Compaction is off. Start with -raw_days and / or -hourly_days to enable it.");
+            else {
+                puts("Compacting old rows...");
+                printf("%s\n", (runCompaction(setup, &compaction) ? "Compaction finished." : "Compaction failed."));
+                printCompactionStats(&compaction);
+            }
+            enterToContinue();
+        }
+        else if (testInput(input, "watch", 1)) {
+            watchMenu();
+        }
         else if (testInput(input, "show", 1)) {
             clearScreen();
             printf("Current settings\n");
             printf("\tLCD_ADDRESS = 0x%X\n", LCD_ADDRESS);
-            printf("\tDHT11_PIN = %d\n", DHT11PIN);
-            printf("\tRATE_SECONDS = %d\n", (int)RATE_SECONDS);
+            printf("\tSENSOR = %s\n", sensor.name);
+            if (sensorType == SIMULATED_SENSOR)
+                printf("\tSIMULATED reads = %llu, checksum failures = %llu\n",
+                    (unsigned long long)simulatedSensor.reads, (unsigned long long)simulatedSensor.failures);
+            else if (sensorType == DHT11_EDGE_SENSOR) {
+                printf("\tGPIO = %s line %u, reads = %llu\n", dht11Line.chip, dht11Line.offset,
+                    (unsigned long long)dht11Line.reads);
+                for (int i = DHT11_NO_RESPONSE; i <= DHT11_BAD_CHECKSUM; i++)
+                    printf("\t\t%s: %llu\n", dht11DecodeResultName(i), (unsigned long long)dht11Line.failures[i]);
+            }
+            else
+                printf("\tDHT11_PIN = %d\n", DHT11PIN);
+            printf("\tRATE_US = %llu\n", (unsigned long long)RATE_US);
             printf("\tMAX_READ_TRIES = %d\n", (int)MAX_READ_TRIES);
             printf("\tMAX_STORE_TRIES = %d\n", (int)MAX_STORE_TRIES);
+            printf("\tFLUSH_COUNT = %d\n", (int)FLUSH_COUNT);
+            printf("\tFLUSH_SECONDS = %d\n", (int)FLUSH_SECONDS);
+            printf("\tTARGET_POINTS = %d\n", (int)TARGET_POINTS);
+            printf("\tPLOT_WIDTH = %d\n", (int)PLOT_WIDTH);
+            printf("\tPLOT_POINTS = %d\n", (int)PLOT_POINTS);
+            printf("\tDOWNSAMPLE = %s\n", downsampleModeName(DOWNSAMPLE_MODE));
+            printf("\tSTREAM_BATCH_ROWS = %d\n", (int)STREAM_BATCH_ROWS);
+            printf("\tPREFETCH_ROWS = %d\n", (int)PREFETCH_ROWS);
+            printf("\tSHARD_COUNT = %d\n", (int)SHARD_COUNT);
+            printf("\tCACHE_MB = %d\n", (int)CACHE_MB);
+            printf("\tHOUR_FILE_MB = %d\n", (int)HOUR_FILE_MB);
+            printf("\tPARTITION_MONTHS = %d\n", (int)PARTITION_MONTHS);
+            printf("\tRAW_DAYS = %u\n", compaction.rawDays);
+            printf("\tHOURLY_DAYS = %u\n", compaction.hourlyDays);
+            printf("\tCOMPACT_BATCH = %d\n", (int)compaction.batchRows);
+            printf("\tCOMPACT_PAUSE_US = %llu\n", (unsigned long long)compaction.pauseUs);
+            printf("\tSPOOL = %s (%llu readings waiting)\n", spool.path, (unsigned long long)pendingSpool(&spool));
+            printSchedulerStats(&sampleScheduler);
+            printSampleRing(&storageRing);
+            printSampleRing(&displayRing);
+            printSampleChannel(&sampleChannel, &watchSubscriber);
+            printDisplayStats(&lcd);
+            printCompactionStats(&compaction);
+            printRangeCacheStats(&rangeCache);
+            printHourFileStats(&hourFile);
+            printGnuplotStats(&gnuplot);
             enterToContinue();
         }
         clearScreen();
@@ -838,7 +1722,27 @@ int printEnvironmentSetupExport(const SQLSetup *setup) {
     return 1;
 }
 
+// The range cache and the hour file under it. Not having the file only
+// costs speed.
+void openRangeStores(SQLSetup *setup) {
+    initRangeCache(&rangeCache, CACHE_MB * 1048576);
+    initHourFile(&hourFile);
+    if (HOUR_FILE_MB > 0 && !openHourFile(&hourFile, (HOUR_FILE_PATH != NULL ? HOUR_FILE_PATH : "environmental_data.hours"),
+        hourFileKey(setup), HOUR_FILE_MB * 1048576))
+        fprintf(stderr, "Continuing without an hour file\n");
+    free(HOUR_FILE_PATH);
+    HOUR_FILE_PATH = NULL;
+}
+
+void freeReportSettings() {
+    free(REPORT_DIR);
+    free(REPORT_FROM);
+    free(REPORT_TO);
+    REPORT_DIR = REPORT_FROM = REPORT_TO = NULL;
+}
+
 int main(int argc, char *argv[]) {    
+    initSimulatedSensor(&simulatedSensor);
     if (argc > 1) {
         Argument **args = getArgs(argc, argv);
         if (args == NULL) {
@@ -862,8 +1766,90 @@ int main(int argc, char *argv[]) {
                 }
             }
             if (compareFlag(args[i], "-rate")) {
-                if (args[i]->isInt) {
-                    RATE_SECONDS = (size_t)args[i]->intValue;
+                if (convertPeriodValue(args[i], &RATE_US) && RATE_US > 0)
+                    used = 1;
+            }
+            if (compareFlag(args[i], "-partition_months")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    PARTITION_MONTHS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-raw_days")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    compaction.rawDays = (unsigned int)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-hourly_days")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    compaction.hourlyDays = (unsigned int)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-compact_batch")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    compaction.batchRows = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-compact_pause")) {
+                if (convertPeriodValue(args[i], &compaction.pauseUs))
+                    used = 1;
+            }
+            if (compareFlag(args[i], "-sensor")) {
+                if (testInput(args[i]->value, "dht11", 0)) {
+                    sensorType = DHT11_SENSOR;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "dht11_edge", 0)) {
+                    sensorType = DHT11_EDGE_SENSOR;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "simulated", 0)) {
+                    sensorType = SIMULATED_SENSOR;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-gpio_chip")) {
+                dht11Line.chip = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-gpio_line")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    dht11Line.offset = (unsigned int)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-dht11_trace")) {
+                if (dht11Line.trace != NULL) fclose(dht11Line.trace);
+                dht11Line.trace = fopen(args[i]->value, "a");
+                if (dht11Line.trace == NULL) perror("Failed to open trace file");
+                else used = 1;
+            }
+            if (compareFlag(args[i], "-sim_csv")) {
+                simulatedSensor.csvPath = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-sim_table")) {
+                simulatedSensor.table = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-sim_fail_pct")) {
+                if (args[i]->isInt && args[i]->intValue >= 0 && args[i]->intValue <= 100) {
+                    simulatedSensor.failPercent = (unsigned int)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-sim_latency_us")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    simulatedSensor.latencyUs = (unsigned int)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-sim_jitter_us")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    simulatedSensor.jitterUs = (unsigned int)args[i]->intValue;
                     used = 1;
                 }
             }
@@ -879,6 +1865,129 @@ int main(int argc, char *argv[]) {
                     used = 1;
                 }
             }
+            if (compareFlag(args[i], "-flush_count")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    FLUSH_COUNT = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-flush_seconds")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    FLUSH_SECONDS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-target_points")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    TARGET_POINTS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-plot_width")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    PLOT_WIDTH = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-plot_points")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    PLOT_POINTS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-downsample")) {
+                if (testInput(args[i]->value, "envelope", 0)) {
+                    DOWNSAMPLE_MODE = ENVELOPE_DOWNSAMPLE;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "lttb", 0)) {
+                    DOWNSAMPLE_MODE = LTTB_DOWNSAMPLE;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "minmax", 0)) {
+                    DOWNSAMPLE_MODE = MINMAX_DOWNSAMPLE;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "none", 0)) {
+                    DOWNSAMPLE_MODE = NO_DOWNSAMPLE;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-stream_batch")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    STREAM_BATCH_ROWS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-prefetch_rows")) {
+                if (args[i]->isInt && args[i]->intValue > 0) {
+                    PREFETCH_ROWS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-shards")) {
+                if (args[i]->isInt && args[i]->intValue > 0 && args[i]->intValue <= MAX_SHARDS) {
+                    SHARD_COUNT = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-cache_mb")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    CACHE_MB = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-hour_file")) {
+                free(HOUR_FILE_PATH);
+                HOUR_FILE_PATH = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-hour_file_mb")) {
+                if (args[i]->isInt && args[i]->intValue >= 0) {
+                    HOUR_FILE_MB = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-spool")) {
+                free(SPOOL_PATH);
+                SPOOL_PATH = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-report_dir")) {
+                free(REPORT_DIR);
+                REPORT_DIR = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-report_from")) {
+                free(REPORT_FROM);
+                REPORT_FROM = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-report_to")) {
+                free(REPORT_TO);
+                REPORT_TO = strdup(args[i]->value);
+                used = 1;
+            }
+            if (compareFlag(args[i], "-report_format")) {
+                if (testInput(args[i]->value, "png", 0)) {
+                    REPORT_FORMAT = PNG_REPORT;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "svg", 0)) {
+                    REPORT_FORMAT = SVG_REPORT;
+                    used = 1;
+                }
+                else if (testInput(args[i]->value, "both", 0)) {
+                    REPORT_FORMAT = PNG_SVG_REPORT;
+                    used = 1;
+                }
+            }
+            if (compareFlag(args[i], "-report_threads")) {
+                if (args[i]->isInt && args[i]->intValue >= 0 && args[i]->intValue <= WORKER_POOL_MAX_THREADS) {
+                    REPORT_THREADS = (size_t)args[i]->intValue;
+                    used = 1;
+                }
+            }
             if (!used) {
                 printf("Invalid argument of flag: \"%s\"\n", args[i]->flag);
                 printArg(args[i]);
@@ -890,21 +1999,81 @@ int main(int argc, char *argv[]) {
             puts("\nValid arguments");
             puts("\t-lcd_address {Decimal}");
             puts("\t-dht11_pin {Decimal}");
-            puts("\t-rate {Decimal}");
+            puts("\t-rate {Decimal seconds | Decimal followed by ms or us}");
+            puts("\t-partition_months {Decimal}");
+            puts("\t-raw_days {Decimal}");
+            puts("\t-hourly_days {Decimal}");
+            puts("\t-compact_batch {Decimal}");
+            puts("\t-compact_pause {Decimal seconds | Decimal followed by ms or us}");
             puts("\t-read_tries {Decimal}");
             puts("\t-store_tries {Decimal}");
+            puts("\t-flush_count {Decimal}");
+            puts("\t-flush_seconds {Decimal}");
+            puts("\t-target_points {Decimal}");
+            puts("\t-plot_width {Decimal}");
+            puts("\t-plot_points {Decimal}");
+            puts("\t-downsample {envelope | lttb | minmax | none}");
+            puts("\t-stream_batch {Decimal}");
+            puts("\t-prefetch_rows {Decimal}");
+            puts("\t-shards {Decimal}");
+            puts("\t-cache_mb {Decimal}");
+            puts("\t-hour_file {Path}");
+            puts("\t-hour_file_mb {Decimal}");
+            puts("\t-spool {Path}");
+            puts("\t-report_dir {Path}");
+            puts("\t-report_from {YYYY-MM-DD}");
+            puts("\t-report_to {YYYY-MM-DD}");
+            puts("\t-report_format {png | svg | both}");
+            puts("\t-report_threads {Decimal}");
+            puts("\t-sensor {dht11 | dht11_edge | simulated}");
+            puts("\t-gpio_chip {Path}");
+            puts("\t-gpio_line {Decimal}");
+            puts("\t-dht11_trace {Path}");
+            puts("\t-sim_csv {Path}");
+            puts("\t-sim_table {Table}");
+            puts("\t-sim_fail_pct {Decimal}");
+            puts("\t-sim_latency_us {Decimal}");
+            puts("\t-sim_jitter_us {Decimal}");
+            free(SPOOL_PATH);
+            free(HOUR_FILE_PATH);
+            freeReportSettings();
             return -1;
         }
     }
     
+    if (mysql_library_init(0, NULL, NULL)) {
+        fprintf(stderr, "Failed to initialize the MySQL client library\n");
+        return -1;
+    }
+    
     SQLSetup setup;
     int exitProgram = 0;
     
+    initSetup(&setup);
     getEnvironmentSetup(&setup);
-    if (!testConnection(&setup)) {
+    int connected = testConnection(&setup);
+    if (REPORT_DIR != NULL) {
+        // Unattended: nobody to ask for the settings, and no sensor, LCD,
+        // spool or menu
+        int reported = 0;
+        if (!connected) fprintf(stderr, "Failed to connect to the database for the report\n");
+        else {
+            openRangeStores(&setup);
+            reported = runReport(&setup);
+            freeRangeCache(&rangeCache);
+            closeHourFile(&hourFile);
+        }
+        freeReportSettings();
+        free(SPOOL_PATH);
+        freeSetup(&setup);
+        mysql_library_end();
+        return (reported ? 0 : 1);
+    }
+    if (!connected) {
         while (1) {
             clearScreen();
             printf("Database information (Quit / Q to exit)\n");
+            freeSetup(&setup);
             initSetup(&setup);
             setup.server = promptString("Server: ");
             if (testInput(setup.server, "quit", 1)) { exitProgram = 1; break; }
@@ -926,17 +2095,29 @@ int main(int argc, char *argv[]) {
                     enterToContinue();
                 break;
             }
-            freeSetup(&setup);
         }
     }
     clearScreen();
     if (exitProgram) {
         freeSetup(&setup);
+        mysql_library_end();
         return 0;
     }
     
-    if (!dht11_init(DHT11_PIN)) {
-        printf("Failed initiallize DHT11 pin\n");
+    if (sensorType == SIMULATED_SENSOR) {
+        simulatedSensor.setup = &setup;
+        createSimulatedDriver(&sensor, &simulatedSensor);
+    }
+    else if (sensorType == DHT11_EDGE_SENSOR) createDHT11EdgeDriver(&sensor, &dht11Line);
+    else createDHT11Driver(&sensor, &DHT11_PIN);
+    int sensorReady = initSensor(&sensor);
+    // Only needed while loading replay data
+    free((char*)simulatedSensor.csvPath);
+    free((char*)simulatedSensor.table);
+    simulatedSensor.csvPath = NULL;
+    simulatedSensor.table = NULL;
+    if (!sensorReady) {
+        printf("Failed initiallize %s sensor\n", sensor.name);
         return -1;
     }
     if (!lcd_init(LCD_ADDRESS)) {
@@ -944,16 +2125,67 @@ int main(int argc, char *argv[]) {
         return -1;
     }
         
-    pthread_t mainQueryThread;
-    if (pthread_create(&mainQueryThread, NULL, mainQuery, &setup) != 0) {
+    if (!openSpool(&spool, (SPOOL_PATH != NULL ? SPOOL_PATH : "environmental_data.spool"))) {
+        printf("Failed to open the spool file\n");
+        return -1;
+    }
+    free(SPOOL_PATH);
+    SPOOL_PATH = NULL;
+        
+    if (!initSampleRing(&storageRing, "Storage", SAMPLE_RING_CAPACITY) ||
+        !initSampleRing(&displayRing, "Display", SAMPLE_RING_CAPACITY) ||
+        !initSampleChannel(&sampleChannel, SAMPLE_CHANNEL_CAPACITY)) {
+        printf("Failed to allocate the sample queues\n");
+        return -1;
+    }
+    subscribeSamples(&watchSubscriber, &sampleChannel);
+    initRollingStats(&watchStats);
+        
+    openRangeStores(&setup);
+    // One point per pixel column at most (see queryPyramid)
+    initGnuplotSession(&gnuplot, (unsigned int)PLOT_WIDTH, (unsigned int)(PLOT_WIDTH * 3 / 5));
+    initScheduler(&sampleScheduler, RATE_US);
+    initScheduler(&maintenanceScheduler, COMPACTION_INTERVAL_US);
+    pthread_t mainQueryThread, storageThread, displayThread, drainThread, maintenanceThread;
+    if (pthread_create(&mainQueryThread, NULL, mainQuery, NULL) != 0 ||
+        pthread_create(&storageThread, NULL, storageQuery, NULL) != 0 ||
+        pthread_create(&displayThread, NULL, displayQuery, NULL) != 0 ||
+        pthread_create(&drainThread, NULL, drainQuery, &setup) != 0 ||
+        pthread_create(&maintenanceThread, NULL, maintenanceQuery, &setup) != 0) {
         perror("Failed to create thread");
         exit(EXIT_FAILURE);
     }
         
     menuInput(&setup);
         
+    // A compaction in progress stops after its current statement
+    compaction.stopping = 1;
+    stopScheduler(&maintenanceScheduler);
+    pthread_join(maintenanceThread, NULL);
+    // Stop producers before their consumers so nothing is left queued
     pthread_join(mainQueryThread, NULL);
+    stopDisplayThread = 1;
+    wakeSampleRing(&displayRing);
+    pthread_join(displayThread, NULL);
+    stopStorageThread = 1;
+    wakeSampleRing(&storageRing);
+    pthread_join(storageThread, NULL);
+    stopDrainThread = 1;
+    wakeSpool(&spool);
+    pthread_join(drainThread, NULL);
+    freeSampleRing(&storageRing);
+    freeSampleRing(&displayRing);
+    freeSampleChannel(&sampleChannel);
+    freeScheduler(&sampleScheduler);
+    freeScheduler(&maintenanceScheduler);
+    freeRangeCache(&rangeCache);
+    closeHourFile(&hourFile);
+    closeGnuplotSession(&gnuplot);
+    closeSensor(&sensor);
+    if (dht11Line.trace != NULL) fclose(dht11Line.trace);
+    closeSpool(&spool);
     freeSetup(&setup);
+    mysql_library_end();
     
     return 0;
 }
@@ -0,0 +1,207 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+// Palette PNG writer with no zlib. Charts are long runs of one colour, so
+// the image data is deflated with a single fixed Huffman block whose only
+// matches are runs of the previous byte (distance 1): one pass, no hash
+// chains, and a 1000 x 600 chart comes out at a fraction of its 600 KB of
+// pixels.
+
+struct pngBuffer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    // Bits not yet written to data, lowest first
+    uint32_t bits;
+    int bitCount;
+    int failed;
+};
+typedef struct pngBuffer PngBuffer;
+
+uint32_t pngCrcTable[256];
+pthread_once_t pngCrcOnce = PTHREAD_ONCE_INIT;
+
+void buildPngCrcTable() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1);
+        pngCrcTable[n] = c;
+    }
+}
+
+uint32_t pngCrc(uint32_t crc, const unsigned char *data, size_t size) {
+    pthread_once(&pngCrcOnce, buildPngCrcTable);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = pngCrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const unsigned char *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // Largest run before the sums can overflow 32 bits
+        size_t run = (size < 5552 ? size : 5552);
+        size -= run;
+        while (run-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+int growPngBuffer(PngBuffer *buffer, size_t extra) {
+    if (buffer->failed) return 0;
+    if (buffer->size + extra <= buffer->capacity) return 1;
+    size_t capacity = (buffer->capacity > 0 ? buffer->capacity : 4096);
+    while (capacity < buffer->size + extra) capacity *= 2;
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        buffer->failed = 1;
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+void putPngBytes(PngBuffer *buffer, const void *data, size_t size) {
+    if (!growPngBuffer(buffer, size)) return;
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+void putPngUint32(PngBuffer *buffer, uint32_t value) {
+    unsigned char bytes[4] = { value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF };
+    putPngBytes(buffer, bytes, 4);
+}
+
+// Deflate writes bit fields lowest bit first
+void putDeflateBits(PngBuffer *buffer, uint32_t value, int count) {
+    buffer->bits |= value << buffer->bitCount;
+    buffer->bitCount += count;
+    while (buffer->bitCount >= 8) {
+        unsigned char byte = buffer->bits & 0xFF;
+        putPngBytes(buffer, &byte, 1);
+        buffer->bits >>= 8;
+        buffer->bitCount -= 8;
+    }
+}
+
+// ...but Huffman codes highest bit first
+void putHuffmanCode(PngBuffer *buffer, uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+    putDeflateBits(buffer, reversed, length);
+}
+
+// Fixed literal / length codes of RFC 1951 3.2.6
+void putFixedSymbol(PngBuffer *buffer, int symbol) {
+    if (symbol < 144) putHuffmanCode(buffer, 0x30 + symbol, 8);
+    else if (symbol < 256) putHuffmanCode(buffer, 0x190 + symbol - 144, 9);
+    else if (symbol < 280) putHuffmanCode(buffer, symbol - 256, 7);
+    else putHuffmanCode(buffer, 0xC0 + symbol - 280, 8);
+}
+
+void putRunLength(PngBuffer *buffer, int length) {
+    static const int base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    int code = 28;
+    while (base[code] > length) code--;
+    putFixedSymbol(buffer, 257 + code);
+    if (extra[code] > 0) putDeflateBits(buffer, length - base[code], extra[code]);
+    // Distance code 0 (distance 1), five bits with no extra bits
+    putHuffmanCode(buffer, 0, 5);
+}
+
+// zlib stream of data: one final fixed Huffman block of literals and runs
+void putZlibStream(PngBuffer *buffer, const unsigned char *data, size_t size) {
+    unsigned char header[2] = { 0x78, 0x01 };
+    putPngBytes(buffer, header, 2);
+    putDeflateBits(buffer, 1, 1);
+    putDeflateBits(buffer, 1, 2);
+    size_t i = 0;
+    while (i < size) {
+        size_t run = 0;
+        if (i > 0)
+            while (run < 258 && i + run < size && data[i + run] == data[i - 1]) run++;
+        if (run >= 3) {
+            putRunLength(buffer, (int)run);
+            i += run;
+        }
+        else putFixedSymbol(buffer, data[i++]);
+    }
+    putFixedSymbol(buffer, 256);
+    if (buffer->bitCount > 0) putDeflateBits(buffer, 0, 8 - buffer->bitCount);
+    putPngUint32(buffer, adler32(data, size));
+}
+
+void putPngChunk(PngBuffer *buffer, const char *type, const unsigned char *data, size_t size) {
+    putPngUint32(buffer, (uint32_t)size);
+    size_t start = buffer->size;
+    putPngBytes(buffer, type, 4);
+    if (size > 0) putPngBytes(buffer, data, size);
+    if (buffer->failed) return;
+    putPngUint32(buffer, pngCrc(0, buffer->data + start, size + 4));
+}
+
+// pixels holds one palette index per pixel, rows top to bottom, and palette
+// three bytes (r, g, b) per colour
+int writePng(const char *path, unsigned int width, unsigned int height, const unsigned char *pixels,
+    const unsigned char *palette, int colors) {
+    // Every row starts with its filter type, 0 (none)
+    size_t stride = (size_t)width + 1;
+    unsigned char *rows = malloc(stride * height);
+    if (rows == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (unsigned int y = 0; y < height; y++) {
+        rows[y * stride] = 0;
+        memcpy(rows + y * stride + 1, pixels + (size_t)y * width, width);
+    }
+
+    PngBuffer image, png;
+    memset(&image, 0, sizeof(image));
+    memset(&png, 0, sizeof(png));
+    putZlibStream(&image, rows, stride * height);
+    free(rows);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    unsigned char header[13] = { width >> 24, (width >> 16) & 0xFF, (width >> 8) & 0xFF, width & 0xFF,
+        height >> 24, (height >> 16) & 0xFF, (height >> 8) & 0xFF, height & 0xFF,
+        8, 3, 0, 0, 0 };
+    putPngBytes(&png, signature, 8);
+    putPngChunk(&png, "IHDR", header, 13);
+    putPngChunk(&png, "PLTE", palette, (size_t)colors * 3);
+    if (!image.failed) putPngChunk(&png, "IDAT", image.data, image.size);
+    putPngChunk(&png, "IEND", NULL, 0);
+    int result = !image.failed && !png.failed;
+    free(image.data);
+
+    FILE *file = (result ? fopen(path, "wb") : NULL);
+    if (result && file == NULL) {
+        fprintf(stderr, "Failed to create \"%s\"\n", path);
+        result = 0;
+    }
+    if (file != NULL) {
+        if (fwrite(png.data, 1, png.size, file) != png.size) result = 0;
+        if (fclose(file) != 0) result = 0;
+        if (!result) fprintf(stderr, "Failed to write \"%s\"\n", path);
+    }
+    free(png.data);
+    return result;
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef RANGE_CACHE_H
+#define RANGE_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "dataList.h"
+#include "storeControl.h"
+#include "hourFile.h"
+
+// Raw rows of past hours kept in memory for the data menu, so List and
+// Graph over the same range only go to MySQL once. Entries are whole local
+// hours keyed by the time_t of their first second, and only closed hours
+// are kept: hours that can no longer get rows. Least recently used hours
+// are dropped once the entries pass the memory cap. Hours fetched from
+// MySQL are written to the hour file as well (see hourFile.h). Only the
+// menu thread uses the cache, so it has no lock.
+
+#define RANGE_CACHE_BUCKETS 4096
+#define RANGE_CACHE_HOUR 3600
+// How long a reading may take from the sensor into the spool
+#define RANGE_CACHE_GRACE_SECONDS 120
+
+struct cachedHour {
+    time_t hour;
+    // Empty for hours without readings, which are worth remembering too
+    DataSeries rows;
+    size_t bytes;
+    struct cachedHour *newer;
+    struct cachedHour *older;
+    struct cachedHour *next;
+};
+typedef struct cachedHour CachedHour;
+
+struct rangeCache {
+    // 0 turns the cache off
+    size_t capacity;
+    size_t used;
+    size_t entries;
+    CachedHour *buckets[RANGE_CACHE_BUCKETS];
+    CachedHour *newest;
+    CachedHour *oldest;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t queries;
+    uint64_t evictions;
+};
+typedef struct rangeCache RangeCache;
+
+void initRangeCache(RangeCache *cache, size_t capacity) {
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = capacity;
+}
+
+size_t rangeCacheBucket(time_t hour) {
+    return (size_t)((uint64_t)(hour / RANGE_CACHE_HOUR) % RANGE_CACHE_BUCKETS);
+}
+
+// Does not count as a use, see touchCachedHour
+CachedHour *lookupCachedHour(RangeCache *cache, time_t hour) {
+    for (CachedHour *entry = cache->buckets[rangeCacheBucket(hour)]; entry != NULL; entry = entry->next)
+        if (entry->hour == hour) return entry;
+    return NULL;
+}
+
+void unlinkCachedHour(RangeCache *cache, CachedHour *entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+void pushCachedHour(RangeCache *cache, CachedHour *entry) {
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if (cache->newest != NULL) cache->newest->newer = entry;
+    cache->newest = entry;
+    if (cache->oldest == NULL) cache->oldest = entry;
+}
+
+void touchCachedHour(RangeCache *cache, CachedHour *entry) {
+    if (cache->newest == entry) return;
+    unlinkCachedHour(cache, entry);
+    pushCachedHour(cache, entry);
+}
+
+void dropCachedHour(RangeCache *cache, CachedHour *entry) {
+    CachedHour **link = &cache->buckets[rangeCacheBucket(entry->hour)];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    unlinkCachedHour(cache, entry);
+    cache->used -= entry->bytes;
+    cache->entries--;
+    freeDataSeries(&entry->rows);
+    free(entry);
+}
+
+// Takes the rows over whether or not they could be kept. Returns 1 when
+// the hour is now cached.
+int storeCachedHour(RangeCache *cache, time_t hour, DataSeries *rows) {
+    // Growth by doubling leaves up to half the arena unused
+    if (rows->count > 0 && rows->count < rows->capacity) {
+        DataSeries exact;
+        initDataSeries(&exact);
+        if (reserveDataSeries(&exact, rows->count) && appendDataSeries(&exact, rows)) {
+            freeDataSeries(rows);
+            *rows = exact;
+        }
+        else freeDataSeries(&exact);
+    }
+    size_t bytes = sizeof(CachedHour) + dataSeriesArenaSize(rows->capacity, 0);
+    CachedHour *entry = (bytes <= cache->capacity ? malloc(sizeof(CachedHour)) : NULL);
+    if (entry == NULL) {
+        freeDataSeries(rows);
+        return 0;
+    }
+
+    CachedHour *stale = lookupCachedHour(cache, hour);
+    if (stale != NULL) dropCachedHour(cache, stale);
+    while (cache->used + bytes > cache->capacity && cache->oldest != NULL) {
+        dropCachedHour(cache, cache->oldest);
+        cache->evictions++;
+    }
+
+    entry->hour = hour;
+    entry->rows = *rows;
+    entry->bytes = bytes;
+    size_t bucket = rangeCacheBucket(hour);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    pushCachedHour(cache, entry);
+    cache->used += bytes;
+    cache->entries++;
+    initDataSeries(rows);
+    return 1;
+}
+
+void freeRangeCache(RangeCache *cache) {
+    while (cache->oldest != NULL) dropCachedHour(cache, cache->oldest);
+}
+
+// Sits between a range fetch and its callback: passes every batch on and
+// cuts the rows into hours for the cache on the way through. Rows come in
+// time order, so an hour is complete once a row of a later hour shows up.
+struct cacheFill {
+    RangeCache *cache;
+    // NULL when there is no hour file
+    HourFile *file;
+    // Largest hour worth keeping, in arena bytes
+    size_t limit;
+    time_t hour;
+    time_t last;
+    time_t closedBefore;
+    // timestampKey of the first second after the current hour
+    uint64_t nextHourKey;
+    DataSeries rows;
+    // 0 once the current hour has outgrown both the cache and the file
+    int keep;
+    int stopped;
+    DataBatchCallback callback;
+    void *context;
+};
+typedef struct cacheFill CacheFill;
+
+void startFillHour(CacheFill *fill, time_t hour) {
+    MYSQL_TIME next;
+    toMySQLTime(hour + RANGE_CACHE_HOUR, &next);
+    fill->hour = hour;
+    fill->nextHourKey = timestampKey(&next);
+    fill->keep = (hour + RANGE_CACHE_HOUR <= fill->closedBefore);
+    initDataSeries(&fill->rows);
+}
+
+// first and last are the starts of the first and the last hour fetched
+void beginCacheFill(CacheFill *fill, RangeCache *cache, HourFile *file, time_t first, time_t last,
+    time_t closedBefore, DataBatchCallback callback, void *context) {
+    fill->cache = cache;
+    fill->file = (file != NULL && hourFileOpen(file) ? file : NULL);
+    fill->limit = cache->capacity;
+    if (fill->file != NULL && fill->file->limit > fill->limit) fill->limit = fill->file->limit;
+    fill->last = last;
+    fill->closedBefore = closedBefore;
+    fill->stopped = 0;
+    fill->callback = callback;
+    fill->context = context;
+    startFillHour(fill, first);
+}
+
+void finishFillHour(CacheFill *fill) {
+    if (!fill->keep) {
+        freeDataSeries(&fill->rows);
+        return;
+    }
+    if (fill->file != NULL) writeHourFile(fill->file, fill->hour, &fill->rows);
+    storeCachedHour(fill->cache, fill->hour, &fill->rows);
+}
+
+int cacheFillBatch(DataSeries *batch, void *context) {
+    CacheFill *fill = (CacheFill*)context;
+    for (size_t i = 0; i < batch->count; i++) {
+        uint64_t key = timestampKey(&batch->time[i]);
+        while (key >= fill->nextHourKey && fill->hour < fill->last) {
+            finishFillHour(fill);
+            startFillHour(fill, fill->hour + RANGE_CACHE_HOUR);
+        }
+        if (!fill->keep) continue;
+        DataValue data;
+        getDataValue(batch, i, &data);
+        if (!appendDataValue(&fill->rows, &data) ||
+            dataSeriesArenaSize(fill->rows.capacity, 0) > fill->limit) {
+            fill->keep = 0;
+            freeDataSeries(&fill->rows);
+        }
+    }
+    if (!fill->callback(batch, fill->context)) fill->stopped = 1;
+    return !fill->stopped;
+}
+
+// The hours after the last row had no rows at all. Nothing more is cached
+// when the fetch failed or was stopped part way.
+void endCacheFill(CacheFill *fill, int fetched) {
+    if (!fetched || fill->stopped) {
+        freeDataSeries(&fill->rows);
+        return;
+    }
+    finishFillHour(fill);
+    while (fill->hour < fill->last) {
+        startFillHour(fill, fill->hour + RANGE_CACHE_HOUR);
+        finishFillHour(fill);
+    }
+}
+
+void printRangeCacheStats(const RangeCache *cache) {
+    if (cache->capacity == 0) {
+        puts("\tRange cache: off");
+        return;
+    }
+    uint64_t lookups = cache->hits + cache->misses;
+    printf("\tRange cache: %zu hours in %.1f of %.1f MB, %llu hits / %llu misses (%.1f%%), %llu queries, %llu evictions\n",
+        cache->entries, cache->used / 1048576.0, cache->capacity / 1048576.0,
+        (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+        (lookups > 0 ? 100.0 * cache->hits / lookups : 0.0),
+        (unsigned long long)cache->queries, (unsigned long long)cache->evictions);
+}
+
+#endif
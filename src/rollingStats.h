@@ -0,0 +1,192 @@
+#ifndef ROLLING_STATS_H
+#define ROLLING_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Count, min, max and mean of the readings of the last hour and the last
+// 24 hours, kept up to date one reading at a time. Readings go into one
+// bucket per minute (a ring of a day of them). Each window keeps the sums
+// of its buckets: a reading adds to them, and a minute leaving the window
+// subtracts its bucket. Min and max only widen while readings come in; when
+// a minute that held readings leaves, they are taken again over the
+// window's buckets (60 or 1440), so a reading never costs more than a few
+// compares and the rescan happens at most once a minute.
+
+#define ROLLING_MINUTES 1440
+
+struct minuteBucket {
+    // time / 60 of the minute, -1 when unused
+    int64_t minute;
+    uint32_t count;
+    double temperatureSum;
+    double temperatureMin;
+    double temperatureMax;
+    double humiditySum;
+    double humidityMin;
+    double humidityMax;
+};
+typedef struct minuteBucket MinuteBucket;
+
+struct rollingWindow {
+    int64_t minutes;
+    uint64_t count;
+    double temperatureSum;
+    double temperatureMin;
+    double temperatureMax;
+    double humiditySum;
+    double humidityMin;
+    double humidityMax;
+};
+typedef struct rollingWindow RollingWindow;
+
+struct rollingStats {
+    MinuteBucket buckets[ROLLING_MINUTES];
+    // Newest minute seen; the windows end with it
+    int64_t minute;
+    RollingWindow hour;
+    RollingWindow day;
+    // Newest reading
+    time_t latestTime;
+    double latestTemperature;
+    double latestHumidity;
+    uint64_t readings;
+    uint64_t failures;
+    uint64_t late;
+};
+typedef struct rollingStats RollingStats;
+
+void resetRollingWindow(RollingWindow *window) {
+    window->count = 0;
+    window->temperatureSum = window->humiditySum = 0;
+    window->temperatureMin = window->humidityMin = INFINITY;
+    window->temperatureMax = window->humidityMax = -INFINITY;
+}
+
+void initRollingStats(RollingStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < ROLLING_MINUTES; i++) stats->buckets[i].minute = -1;
+    stats->minute = -1;
+    stats->hour.minutes = 60;
+    stats->day.minutes = ROLLING_MINUTES;
+    resetRollingWindow(&stats->hour);
+    resetRollingWindow(&stats->day);
+}
+
+MinuteBucket *minuteBucket(RollingStats *stats, int64_t minute) {
+    return &stats->buckets[minute % ROLLING_MINUTES];
+}
+
+// Min and max over the buckets still inside the window
+void rescanRollingWindow(RollingStats *stats, RollingWindow *window) {
+    window->temperatureMin = window->humidityMin = INFINITY;
+    window->temperatureMax = window->humidityMax = -INFINITY;
+    for (int64_t minute = stats->minute - window->minutes + 1; minute <= stats->minute; minute++) {
+        if (minute < 0) continue;
+        MinuteBucket *bucket = minuteBucket(stats, minute);
+        if (bucket->minute != minute || bucket->count == 0) continue;
+        window->temperatureMin = fmin(window->temperatureMin, bucket->temperatureMin);
+        window->temperatureMax = fmax(window->temperatureMax, bucket->temperatureMax);
+        window->humidityMin = fmin(window->humidityMin, bucket->humidityMin);
+        window->humidityMax = fmax(window->humidityMax, bucket->humidityMax);
+    }
+}
+
+// Moves the end of the windows to `minute`, dropping the minutes that fall
+// out of them and recycling buckets older than a day
+void advanceRollingStats(RollingStats *stats, int64_t minute) {
+    if (stats->minute < 0 || minute - stats->minute > ROLLING_MINUTES) {
+        // First reading, or nothing of the last day is left
+        for (int i = 0; i < ROLLING_MINUTES; i++) stats->buckets[i].minute = -1;
+        resetRollingWindow(&stats->hour);
+        resetRollingWindow(&stats->day);
+        stats->minute = minute - 1;
+    }
+    RollingWindow *windows[2] = { &stats->hour, &stats->day };
+    int dropped[2] = { 0, 0 };
+    while (stats->minute < minute) {
+        int64_t next = stats->minute + 1;
+        for (int w = 0; w < 2; w++) {
+            RollingWindow *window = windows[w];
+            int64_t leaving = next - window->minutes;
+            if (leaving < 0) continue;
+            // Before the bucket is recycled below, for the day window
+            MinuteBucket *bucket = minuteBucket(stats, leaving);
+            if (bucket->minute != leaving || bucket->count == 0) continue;
+            window->count -= bucket->count;
+            window->temperatureSum -= bucket->temperatureSum;
+            window->humiditySum -= bucket->humiditySum;
+            dropped[w] = 1;
+        }
+        stats->minute = next;
+        MinuteBucket *bucket = minuteBucket(stats, next);
+        memset(bucket, 0, sizeof(*bucket));
+        bucket->minute = next;
+        bucket->temperatureMin = bucket->humidityMin = INFINITY;
+        bucket->temperatureMax = bucket->humidityMax = -INFINITY;
+    }
+    for (int w = 0; w < 2; w++) {
+        if (!dropped[w]) continue;
+        if (windows[w]->count == 0) resetRollingWindow(windows[w]);
+        else rescanRollingWindow(stats, windows[w]);
+    }
+}
+
+void addToRollingWindow(RollingWindow *window, double temperature, double humidity) {
+    window->count++;
+    window->temperatureSum += temperature;
+    window->humiditySum += humidity;
+    window->temperatureMin = fmin(window->temperatureMin, temperature);
+    window->temperatureMax = fmax(window->temperatureMax, temperature);
+    window->humidityMin = fmin(window->humidityMin, humidity);
+    window->humidityMax = fmax(window->humidityMax, humidity);
+}
+
+void addRollingReading(RollingStats *stats, time_t time, double temperature, double humidity) {
+    int64_t minute = (int64_t)time / 60;
+    // Readings arrive in order, but the windows may have been moved on to
+    // the current minute already. One older than the day they cover, or
+    // from a minute they skipped over, cannot be placed.
+    if (stats->minute >= 0 && minute <= stats->minute - ROLLING_MINUTES) {
+        stats->late++;
+        return;
+    }
+    if (minute > stats->minute) advanceRollingStats(stats, minute);
+    MinuteBucket *bucket = minuteBucket(stats, minute);
+    if (bucket->minute != minute) {
+        stats->late++;
+        return;
+    }
+    bucket->count++;
+    bucket->temperatureSum += temperature;
+    bucket->humiditySum += humidity;
+    bucket->temperatureMin = fmin(bucket->temperatureMin, temperature);
+    bucket->temperatureMax = fmax(bucket->temperatureMax, temperature);
+    bucket->humidityMin = fmin(bucket->humidityMin, humidity);
+    bucket->humidityMax = fmax(bucket->humidityMax, humidity);
+    if (minute > stats->minute - stats->hour.minutes) addToRollingWindow(&stats->hour, temperature, humidity);
+    addToRollingWindow(&stats->day, temperature, humidity);
+    if (time >= stats->latestTime) {
+        stats->latestTime = time;
+        stats->latestTemperature = temperature;
+        stats->latestHumidity = humidity;
+    }
+    stats->readings++;
+}
+
+void printRollingWindow(const char *name, const RollingWindow *window) {
+    if (window->count == 0) {
+        printf("%-9s no readings\n", name);
+        return;
+    }
+    printf("%-9s %6llu readings  temperature %6.2f / %6.2f / %6.2f C  humidity %6.2f / %6.2f / %6.2f %%\n",
+        name, (unsigned long long)window->count,
+        window->temperatureMin, window->temperatureSum / window->count, window->temperatureMax,
+        window->humidityMin, window->humiditySum / window->count, window->humidityMax);
+}
+
+#endif
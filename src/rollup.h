@@ -0,0 +1,192 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "sqlControl.h"
+#include "fixedFormat.h"
+
+// Hourly and daily summaries of the raw table, kept in <table>_hourly and
+// <table>_daily with the reading count, sum, min and max of temperature
+// and humidity per bucket. storeReadings folds every batch into them in the
+// same transaction as the raw INSERT, so they always agree with the raw
+// rows. Buckets are local time, like the time column.
+
+enum RollupLevel { HOURLY_ROLLUP = 0, DAILY_ROLLUP, ROLLUP_COUNT };
+
+struct rollupBucket {
+    MYSQL_TIME bucket;
+    long long samples;
+    double temperatureSum;
+    double temperatureMin;
+    double temperatureMax;
+    double humiditySum;
+    double humidityMin;
+    double humidityMax;
+};
+typedef struct rollupBucket RollupBucket;
+
+const char *rollupSuffix(enum RollupLevel level) {
+    return (level == HOURLY_ROLLUP ? "hourly" : "daily");
+}
+
+// CREATE TABLE commits implicitly, so call this outside any transaction
+int createRollupTables(SQLSetup *setup, MYSQL *conn) {
+    if (setup->rollupsReady) return 1;
+    for (int level = 0; level < ROLLUP_COUNT; level++) {
+        char query[512];
+        snprintf(query, sizeof(query),
+            "CREATE TABLE IF NOT EXISTS %s_%s (bucket DATETIME NOT NULL PRIMARY KEY, "
+            "samples BIGINT NOT NULL, temp_sum DOUBLE NOT NULL, temp_min DOUBLE NOT NULL, "
+            "temp_max DOUBLE NOT NULL, hum_sum DOUBLE NOT NULL, hum_min DOUBLE NOT NULL, "
+            "hum_max DOUBLE NOT NULL)", setup->table, rollupSuffix(level));
+        if (mysql_query(conn, query)) {
+            fprintf(stderr, "Failed to create rollup table: %s\n", mysql_error(conn));
+            return 0;
+        }
+    }
+    setup->rollupsReady = 1;
+    return 1;
+}
+
+// Start of the local hour or day containing time
+void rollupBucketTime(time_t time, enum RollupLevel level, MYSQL_TIME *out) {
+    struct tm local;
+    localtime_r(&time, &local);
+    memset(out, 0, sizeof(*out));
+    out->year = local.tm_year + 1900;
+    out->month = local.tm_mon + 1;
+    out->day = local.tm_mday;
+    out->hour = (level == HOURLY_ROLLUP ? local.tm_hour : 0);
+    out->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+int sameRollupBucket(const MYSQL_TIME *a, const MYSQL_TIME *b) {
+    return a->year == b->year && a->month == b->month && a->day == b->day && a->hour == b->hour;
+}
+
+void startRollupBucket(RollupBucket *bucket, const MYSQL_TIME *time) {
+    bucket->bucket = *time;
+    bucket->samples = 0;
+    bucket->temperatureSum = 0;
+    bucket->temperatureMin = INFINITY;
+    bucket->temperatureMax = -INFINITY;
+    bucket->humiditySum = 0;
+    bucket->humidityMin = INFINITY;
+    bucket->humidityMax = -INFINITY;
+}
+
+// data[] in sensor order (HumLHS, HumRHS, TempLHS, TempRHS, checksum)
+void addToRollupBucket(RollupBucket *bucket, const int data[5]) {
+    double temperature = (double)decodeFixedReading(data[2], data[3]) / FIXED_READING_SCALE;
+    double humidity = (double)decodeFixedReading(data[0], data[1]) / FIXED_READING_SCALE;
+    bucket->samples++;
+    bucket->temperatureSum += temperature;
+    bucket->humiditySum += humidity;
+    if (temperature < bucket->temperatureMin) bucket->temperatureMin = temperature;
+    if (temperature > bucket->temperatureMax) bucket->temperatureMax = temperature;
+    if (humidity < bucket->humidityMin) bucket->humidityMin = humidity;
+    if (humidity > bucket->humidityMax) bucket->humidityMax = humidity;
+}
+
+// Adds the bucket onto whatever the table already holds for it
+int upsertRollupBucket(SQLSetup *setup, SQLConnection *connection, enum RollupLevel level, RollupBucket *bucket) {
+    if (bucket->samples == 0) return 1;
+    MYSQL_STMT *stmt = getStatement(setup, connection,
+        (level == HOURLY_ROLLUP ? HOURLY_UPSERT_STATEMENT : DAILY_UPSERT_STATEMENT));
+    if (stmt == NULL) return 0;
+
+    MYSQL_BIND bind[8];
+    memset(bind, 0, sizeof(bind));
+    bind[0].buffer_type = MYSQL_TYPE_DATETIME;
+    bind[0].buffer = &bucket->bucket;
+    bind[1].buffer_type = MYSQL_TYPE_LONGLONG;
+    bind[1].buffer = &bucket->samples;
+    double *values[6] = {
+        &bucket->temperatureSum, &bucket->temperatureMin, &bucket->temperatureMax,
+        &bucket->humiditySum, &bucket->humidityMin, &bucket->humidityMax
+    };
+    for (int i = 0; i < 6; i++) {
+        bind[i + 2].buffer_type = MYSQL_TYPE_DOUBLE;
+        bind[i + 2].buffer = values[i];
+    }
+    if (mysql_stmt_bind_param(stmt, bind) || mysql_stmt_execute(stmt)) {
+        fprintf(stderr, "Rollup update failed: %s\n", mysql_stmt_error(stmt));
+        return 0;
+    }
+    return 1;
+}
+
+// Rebuilds both rollups from the raw table in one transaction: hourly from
+// the raw rows, daily from hourly. Only the hours from the oldest raw row on
+// and the days they touch are rebuilt; anything older has been compacted
+// (see compaction.h) and the rollups are all that is left of it.
+// Concurrent inserts wait on the rollup row locks and land on top of the
+// rebuilt rows.
+int backfillRollups(SQLSetup *setup) {
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
+    MYSQL *conn = connection->conn;
+    if (!createRollupTables(setup, conn)) {
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    if (mysql_query(conn, "START TRANSACTION")) {
+        fprintf(stderr, "Backfill failed: %s\n", mysql_error(conn));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+
+    char query[1024];
+    char first[32];
+    int found;
+    snprintf(query, sizeof(query), "SELECT DATE_FORMAT(MIN(time), '%%Y-%%m-%%d %%H:00:00') FROM %s", setup->table);
+    if (!queryText(conn, query, first, sizeof(first), &found)) {
+        mysql_rollback(conn);
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+
+    char queries[4][1024];
+    int count = 0;
+    // No raw rows: there is nothing the rollups could be rebuilt from
+    if (found) {
+        snprintf(queries[0], sizeof(queries[0]), "DELETE FROM %s_hourly WHERE bucket >= '%s'", setup->table, first);
+        snprintf(queries[1], sizeof(queries[1]),
+            "INSERT INTO %s_hourly (bucket, samples, temp_sum, temp_min, temp_max, hum_sum, hum_min, hum_max) "
+            "SELECT DATE_FORMAT(time, '%%Y-%%m-%%d %%H:00:00'), COUNT(*), "
+            "SUM(" SQL_TEMPERATURE "), MIN(" SQL_TEMPERATURE "), MAX(" SQL_TEMPERATURE "), "
+            "SUM(" SQL_HUMIDITY "), MIN(" SQL_HUMIDITY "), MAX(" SQL_HUMIDITY ") "
+            "FROM %s WHERE time >= '%s' GROUP BY 1", setup->table, setup->table, first);
+        // The hours of that first day before the oldest raw row are still
+        // in the hourly rollup, so whole days can be summed again
+        snprintf(queries[2], sizeof(queries[2]), "DELETE FROM %s_daily WHERE bucket >= DATE('%s')", setup->table, first);
+        snprintf(queries[3], sizeof(queries[3]),
+            "INSERT INTO %s_daily (bucket, samples, temp_sum, temp_min, temp_max, hum_sum, hum_min, hum_max) "
+            "SELECT DATE(bucket), SUM(samples), SUM(temp_sum), MIN(temp_min), MAX(temp_max), "
+            "SUM(hum_sum), MIN(hum_min), MAX(hum_max) FROM %s_hourly WHERE bucket >= DATE('%s') "
+            "GROUP BY DATE(bucket)", setup->table, setup->table, first);
+        count = 4;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (mysql_query(conn, queries[i])) {
+            fprintf(stderr, "Backfill failed: %s\n", mysql_error(conn));
+            mysql_rollback(conn);
+            releaseConnection(setup, connection, 0);
+            return 0;
+        }
+    }
+    if (mysql_commit(conn)) {
+        fprintf(stderr, "Backfill commit failed: %s\n", mysql_error(conn));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    releaseConnection(setup, connection, 1);
+    return 1;
+}
+
+#endif
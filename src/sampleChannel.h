@@ -0,0 +1,151 @@
+#ifndef SAMPLE_CHANNEL_H
+#define SAMPLE_CHANNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "sampleRing.h"
+
+// Lock-free publish / subscribe channel for samples. The sampler thread is
+// the one publisher and never waits: it overwrites the oldest slot of a
+// broadcast ring. Any number of subscribers read behind it, each with its
+// own cursor, and nobody has to register with the publisher. A subscriber
+// that falls a whole ring behind skips to the oldest slot still there and
+// counts what it missed.
+//
+// Every slot is a small seqlock: the publisher clears its sequence, writes
+// the sample, then stores the sequence of the sample. A reader takes the
+// sample only when it saw the same expected sequence before and after
+// reading it. The sample is kept in atomic words so a read racing a write
+// is a retry, never a torn value.
+
+// About 18 hours at one reading a second
+#define SAMPLE_CHANNEL_CAPACITY 65536
+
+struct channelSlot {
+    // Sequence of the sample in the slot plus one, 0 while it is written
+    _Atomic uint64_t sequence;
+    // The five sensor bytes and the status, one byte each
+    _Atomic uint64_t packed;
+    _Atomic int64_t time;
+};
+typedef struct channelSlot ChannelSlot;
+
+struct sampleChannel {
+    ChannelSlot *slots;
+    size_t mask;
+    // Sequence the next sample gets
+    _Atomic uint64_t head;
+};
+typedef struct sampleChannel SampleChannel;
+
+struct sampleSubscriber {
+    SampleChannel *channel;
+    uint64_t cursor;
+    uint64_t received;
+    uint64_t missed;
+};
+typedef struct sampleSubscriber SampleSubscriber;
+
+int initSampleChannel(SampleChannel *channel, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    channel->slots = calloc(size, sizeof(ChannelSlot));
+    if (channel->slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    channel->mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&channel->slots[i].sequence, 0);
+        atomic_init(&channel->slots[i].packed, 0);
+        atomic_init(&channel->slots[i].time, 0);
+    }
+    atomic_init(&channel->head, 0);
+    return 1;
+}
+
+void freeSampleChannel(SampleChannel *channel) {
+    free(channel->slots);
+    channel->slots = NULL;
+}
+
+uint64_t packSample(const Sample *sample) {
+    uint64_t packed = (uint64_t)(sample->status & 0xFF) << 40;
+    for (int i = 0; i < 5; i++) packed |= (uint64_t)(sample->reading.data[i] & 0xFF) << (8 * i);
+    return packed;
+}
+
+void unpackSample(uint64_t packed, int64_t time, Sample *sample) {
+    for (int i = 0; i < 5; i++) sample->reading.data[i] = (int)((packed >> (8 * i)) & 0xFF);
+    sample->status = (enum SampleStatus)((packed >> 40) & 0xFF);
+    sample->reading.time = (time_t)time;
+}
+
+// Publisher side, the sampler thread only. Never blocks.
+void publishSample(SampleChannel *channel, const Sample *sample) {
+    uint64_t sequence = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    ChannelSlot *slot = &channel->slots[sequence & channel->mask];
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    // Readers that see the new sample also see the slot was being written
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&slot->packed, packSample(sample), memory_order_relaxed);
+    atomic_store_explicit(&slot->time, (int64_t)sample->reading.time, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_release);
+    atomic_store_explicit(&channel->head, sequence + 1, memory_order_release);
+}
+
+uint64_t publishedSamples(SampleChannel *channel) {
+    return atomic_load_explicit(&channel->head, memory_order_acquire);
+}
+
+// Starts at the oldest sample still in the channel, so a subscriber made
+// at start up sees everything and one made later catches up on the ring
+void subscribeSamples(SampleSubscriber *subscriber, SampleChannel *channel) {
+    subscriber->channel = channel;
+    uint64_t head = publishedSamples(channel);
+    subscriber->cursor = (head > channel->mask + 1 ? head - (channel->mask + 1) : 0);
+    subscriber->received = 0;
+    subscriber->missed = 0;
+}
+
+// Subscriber side. Returns 0 when there is nothing new.
+int receiveSample(SampleSubscriber *subscriber, Sample *sample) {
+    SampleChannel *channel = subscriber->channel;
+    size_t capacity = channel->mask + 1;
+    while (1) {
+        uint64_t head = publishedSamples(channel);
+        if (subscriber->cursor == head) return 0;
+        // Lapped: everything older than one ring back is gone
+        if (head - subscriber->cursor > capacity) {
+            subscriber->missed += head - capacity - subscriber->cursor;
+            subscriber->cursor = head - capacity;
+        }
+        ChannelSlot *slot = &channel->slots[subscriber->cursor & channel->mask];
+        uint64_t expected = subscriber->cursor + 1;
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == expected) {
+            uint64_t packed = atomic_load_explicit(&slot->packed, memory_order_relaxed);
+            int64_t time = atomic_load_explicit(&slot->time, memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == expected) {
+                unpackSample(packed, time, sample);
+                subscriber->cursor++;
+                subscriber->received++;
+                return 1;
+            }
+        }
+        // Overwritten while reading: the publisher is a lap ahead on this
+        // slot, so this sample is gone
+        subscriber->missed++;
+        subscriber->cursor++;
+    }
+}
+
+void printSampleChannel(SampleChannel *channel, const SampleSubscriber *subscriber) {
+    printf("\tSample channel: %llu published, capacity %zu, watch received %llu, missed %llu\n",
+        (unsigned long long)publishedSamples(channel), channel->mask + 1,
+        (unsigned long long)subscriber->received, (unsigned long long)subscriber->missed);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <time.h>
+#include "storeControl.h"
+
+// Single producer / single consumer ring of samples. The sampler thread is
+// the only producer and each ring has exactly one consumer thread, so a pair
+// of acquire/release indices is all the synchronisation needed. A full ring
+// drops the new sample instead of blocking the producer.
+
+#define SAMPLE_RING_CAPACITY 1024
+
+enum SampleStatus { SAMPLE_OK = 0, SAMPLE_READ_FAILED = 1 };
+
+struct sample {
+    Reading reading;
+    enum SampleStatus status;
+};
+typedef struct sample Sample;
+
+struct sampleRing {
+    const char *name;
+    Sample *slots;
+    size_t mask;
+    // head is only written by the producer, tail only by the consumer
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic size_t dropped;
+    _Atomic size_t highWater;
+    // Counts pushed samples so the consumer can sleep until there is work
+    sem_t ready;
+};
+typedef struct sampleRing SampleRing;
+
+int initSampleRing(SampleRing *ring, const char *name, size_t capacity) {
+    // Round up to a power of two so the index wraps with a mask
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    ring->slots = malloc(size * sizeof(Sample));
+    if (ring->slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    ring->name = name;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->highWater, 0);
+    sem_init(&ring->ready, 0, 0);
+    return 1;
+}
+
+void freeSampleRing(SampleRing *ring) {
+    sem_destroy(&ring->ready);
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+// Producer side. Never blocks.
+int pushSample(SampleRing *ring, const Sample *sample) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ring->mask) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+    ring->slots[head & ring->mask] = *sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    size_t depth = head + 1 - tail;
+    if (depth > atomic_load_explicit(&ring->highWater, memory_order_relaxed))
+        atomic_store_explicit(&ring->highWater, depth, memory_order_relaxed);
+    sem_post(&ring->ready);
+    return 1;
+}
+
+// Consumer side. Returns 0 when the ring is empty.
+int popSample(SampleRing *ring, Sample *sample) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head) return 0;
+    *sample = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Consumer side. Sleeps until a sample is pushed, wakeSampleRing is called
+// or the timeout passes.
+void waitSampleRing(SampleRing *ring, unsigned int milliseconds) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (sem_timedwait(&ring->ready, &deadline) == -1 && errno == EINTR) { }
+}
+
+void wakeSampleRing(SampleRing *ring) { sem_post(&ring->ready); }
+
+size_t sampleRingDepth(SampleRing *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire) -
+        atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+void printSampleRing(SampleRing *ring) {
+    printf("\t%s queue: depth %zu / %zu, high water %zu, dropped %zu\n", ring->name,
+        sampleRingDepth(ring), ring->mask + 1,
+        atomic_load_explicit(&ring->highWater, memory_order_relaxed),
+        atomic_load_explicit(&ring->dropped, memory_order_relaxed));
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+// Periodic wakeups on absolute CLOCK_MONOTONIC deadlines. Deadlines are
+// advanced by whole periods from the start time, so time spent handling a
+// tick never pushes the following ticks back. Waiting is a condition wait
+// so stopScheduler wakes the thread immediately.
+
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+struct scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stopping;
+    int64_t periodNs;
+    int64_t nextNs;
+    // Lateness of each wakeup relative to its deadline
+    uint64_t ticks;
+    uint64_t missed;
+    int64_t maxLateNs;
+    int64_t totalLateNs;
+};
+typedef struct scheduler Scheduler;
+
+int64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+// The first tick fires one period from now
+void initScheduler(Scheduler *scheduler, uint64_t periodUs) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&scheduler->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&scheduler->lock, NULL);
+
+    if (periodUs == 0) periodUs = 1;
+    scheduler->stopping = 0;
+    scheduler->periodNs = (int64_t)periodUs * 1000LL;
+    scheduler->nextNs = monotonicNs() + scheduler->periodNs;
+    scheduler->ticks = 0;
+    scheduler->missed = 0;
+    scheduler->maxLateNs = 0;
+    scheduler->totalLateNs = 0;
+}
+
+void freeScheduler(Scheduler *scheduler) {
+    pthread_cond_destroy(&scheduler->wake);
+    pthread_mutex_destroy(&scheduler->lock);
+}
+
+// Blocks until the next deadline. Returns 0 once the scheduler is stopped.
+int waitNextTick(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    struct timespec deadline;
+    deadline.tv_sec = scheduler->nextNs / NANOSECONDS_PER_SECOND;
+    deadline.tv_nsec = scheduler->nextNs % NANOSECONDS_PER_SECOND;
+    while (!scheduler->stopping) {
+        if (pthread_cond_timedwait(&scheduler->wake, &scheduler->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    if (scheduler->stopping) {
+        pthread_mutex_unlock(&scheduler->lock);
+        return 0;
+    }
+
+    int64_t late = monotonicNs() - scheduler->nextNs;
+    if (late < 0) late = 0;
+    scheduler->ticks++;
+    scheduler->totalLateNs += late;
+    if (late > scheduler->maxLateNs) scheduler->maxLateNs = late;
+
+    // If the last tick overran whole periods, skip them instead of firing a
+    // burst of catch-up ticks; the phase stays locked to the start time.
+    int64_t skipped = late / scheduler->periodNs;
+    scheduler->missed += skipped;
+    scheduler->nextNs += (skipped + 1) * scheduler->periodNs;
+    pthread_mutex_unlock(&scheduler->lock);
+    return 1;
+}
+
+void stopScheduler(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = 1;
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void printSchedulerStats(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    double meanUs = (scheduler->ticks ? scheduler->totalLateNs / 1000.0 / scheduler->ticks : 0);
+    printf("\tSampler: %llu ticks, %llu missed deadlines, jitter mean %.1lfus max %.1lfus\n",
+        (unsigned long long)scheduler->ticks, (unsigned long long)scheduler->missed,
+        meanUs, scheduler->maxLateNs / 1000.0);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+#endif
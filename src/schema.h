@@ -0,0 +1,242 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "sqlControl.h"
+#include "rollup.h"
+#include "fixedFormat.h"
+
+// Checks and migrates the raw table on first contact: creates it when it is
+// missing, adds an index on time and, when asked, partitions it by month.
+// Partitions are named pYYYYMM and hold that month; a pmax partition
+// catches anything past the last month. rollPartitions splits new months
+// off pmax while they are still empty, which is a metadata only change.
+// Range queries (time BETWEEN ? AND ?) then only touch the months they
+// cover.
+
+#define SCHEMA_TIME_INDEX "time_index"
+
+struct partitionMonth {
+    int year;
+    int month;
+};
+typedef struct partitionMonth PartitionMonth;
+
+void nextPartitionMonth(PartitionMonth *month) {
+    if (++month->month > 12) {
+        month->month = 1;
+        month->year++;
+    }
+}
+
+int comparePartitionMonth(const PartitionMonth *lhs, const PartitionMonth *rhs) {
+    if (lhs->year != rhs->year) return lhs->year - rhs->year;
+    return lhs->month - rhs->month;
+}
+
+// Local month of time plus monthsAhead
+void partitionMonthOf(time_t time, unsigned int monthsAhead, PartitionMonth *month) {
+    struct tm local;
+    localtime_r(&time, &local);
+    month->year = local.tm_year + 1900;
+    month->month = local.tm_mon + 1;
+    for (unsigned int i = 0; i < monthsAhead; i++) nextPartitionMonth(month);
+}
+
+// "PARTITION p202610 VALUES LESS THAN (...)" with the first second of the
+// following month as the bound. TIMESTAMP columns can only be partitioned
+// through UNIX_TIMESTAMP(); DATETIME columns use RANGE COLUMNS.
+char *appendPartition(char *out, PartitionMonth month, int timestampColumn) {
+    out = appendString(out, "PARTITION p");
+    out = appendDigits(out, month.year, 4);
+    out = appendDigits(out, month.month, 2);
+    nextPartitionMonth(&month);
+    out = appendString(out, (timestampColumn ? " VALUES LESS THAN (UNIX_TIMESTAMP('" : " VALUES LESS THAN ('"));
+    out = appendDateTime(out, month.year, month.month, 1, 0, 0, 0, " ");
+    return appendString(out, (timestampColumn ? "')), " : "'), "));
+}
+
+// Partition definitions for first..last followed by pmax, or NULL when the
+// allocation fails. The caller frees it.
+char *buildPartitionList(PartitionMonth first, PartitionMonth last, int timestampColumn) {
+    size_t months = 1;
+    for (PartitionMonth month = first; comparePartitionMonth(&month, &last) < 0; nextPartitionMonth(&month))
+        months++;
+    char *list = malloc(months * 96 + 64);
+    if (list == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    char *p = list;
+    for (PartitionMonth month = first; comparePartitionMonth(&month, &last) <= 0; nextPartitionMonth(&month))
+        p = appendPartition(p, month, timestampColumn);
+    p = appendString(p, "PARTITION pmax VALUES LESS THAN (MAXVALUE)");
+    *p = '\0';
+    return list;
+}
+
+int runSchemaQuery(MYSQL *conn, const char *query) {
+    if (mysql_query(conn, query)) {
+        fprintf(stderr, "Schema migration failed: %s\n", mysql_error(conn));
+        return 0;
+    }
+    return 1;
+}
+
+int timeColumnIsTimestamp(SQLSetup *setup, MYSQL *conn, int *timestampColumn) {
+    char query[512], type[32];
+    int found;
+    snprintf(query, sizeof(query),
+        "SELECT DATA_TYPE FROM information_schema.COLUMNS "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '%s' AND COLUMN_NAME = 'time'", setup->table);
+    if (!queryText(conn, query, type, sizeof(type), &found)) return 0;
+    if (!found) {
+        fprintf(stderr, "Table %s has no time column\n", setup->table);
+        return 0;
+    }
+    *timestampColumn = (strcmp(type, "timestamp") == 0);
+    return 1;
+}
+
+// Any index whose first column is time serves the range queries
+int ensureTimeIndex(SQLSetup *setup, MYSQL *conn) {
+    char query[512], count[32];
+    int found;
+    snprintf(query, sizeof(query),
+        "SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE() "
+        "AND TABLE_NAME = '%s' AND COLUMN_NAME = 'time' AND SEQ_IN_INDEX = 1", setup->table);
+    if (!queryText(conn, query, count, sizeof(count), &found)) return 0;
+    if (found && strtoul(count, NULL, 10) > 0) return 1;
+
+    printf("Adding an index on %s.time (this can take a while on a large table)...\n", setup->table);
+    snprintf(query, sizeof(query), "ALTER TABLE %s ADD INDEX " SCHEMA_TIME_INDEX " (time)", setup->table);
+    return runSchemaQuery(conn, query);
+}
+
+// Highest pYYYYMM partition of the table. Returns 0 on error; *partitioned
+// is 0 when the table has no partitions at all.
+int lastPartitionMonth(SQLSetup *setup, MYSQL *conn, int *partitioned, PartitionMonth *month) {
+    char query[512], text[32];
+    int found;
+    snprintf(query, sizeof(query),
+        "SELECT COUNT(*) FROM information_schema.PARTITIONS WHERE TABLE_SCHEMA = DATABASE() "
+        "AND TABLE_NAME = '%s' AND PARTITION_NAME IS NOT NULL", setup->table);
+    if (!queryText(conn, query, text, sizeof(text), &found)) return 0;
+    *partitioned = (found && strtoul(text, NULL, 10) > 0);
+    if (!*partitioned) return 1;
+
+    snprintf(query, sizeof(query),
+        "SELECT MAX(PARTITION_NAME) FROM information_schema.PARTITIONS WHERE TABLE_SCHEMA = DATABASE() "
+        "AND TABLE_NAME = '%s' AND PARTITION_NAME REGEXP '^p[0-9]{6}$'", setup->table);
+    if (!queryText(conn, query, text, sizeof(text), &found)) return 0;
+    if (!found) {
+        month->year = 0;
+        month->month = 0;
+        return 1;
+    }
+    unsigned long value = strtoul(text + 1, NULL, 10);
+    month->year = (int)(value / 100);
+    month->month = (int)(value % 100);
+    return 1;
+}
+
+// Converts an unpartitioned table, starting at the month of its oldest row
+int partitionTable(SQLSetup *setup, MYSQL *conn, unsigned int monthsAhead, int timestampColumn) {
+    char query[512], oldest[32];
+    int found;
+    snprintf(query, sizeof(query), "SELECT UNIX_TIMESTAMP(MIN(time)) FROM %s", setup->table);
+    if (!queryText(conn, query, oldest, sizeof(oldest), &found)) return 0;
+    time_t now = time(NULL);
+    PartitionMonth first, last;
+    partitionMonthOf(found ? (time_t)strtoll(oldest, NULL, 10) : now, 0, &first);
+    partitionMonthOf(now, monthsAhead, &last);
+    if (comparePartitionMonth(&first, &last) > 0) first = last;
+
+    char *list = buildPartitionList(first, last, timestampColumn);
+    if (list == NULL) return 0;
+    size_t size = strlen(list) + 256;
+    char *alter = malloc(size);
+    if (alter == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(list);
+        return 0;
+    }
+    snprintf(alter, size, "ALTER TABLE %s PARTITION BY %s (%s)", setup->table,
+        (timestampColumn ? "RANGE (UNIX_TIMESTAMP(time))" : "RANGE COLUMNS (time)"), list);
+    printf("Partitioning %s by month (this can take a while on a large table)...\n", setup->table);
+    int result = runSchemaQuery(conn, alter);
+    free(alter);
+    free(list);
+    return result;
+}
+
+// Keeps monthsAhead months of partitions past the current one. Tables that
+// were partitioned some other way are left alone.
+int rollPartitions(SQLSetup *setup, MYSQL *conn, unsigned int monthsAhead) {
+    int timestampColumn, partitioned;
+    PartitionMonth last;
+    if (!timeColumnIsTimestamp(setup, conn, &timestampColumn)) return 0;
+    if (!lastPartitionMonth(setup, conn, &partitioned, &last)) return 0;
+    if (!partitioned) return partitionTable(setup, conn, monthsAhead, timestampColumn);
+    if (last.year == 0) {
+        fprintf(stderr, "Table %s is partitioned but not by month, not rolling its partitions\n", setup->table);
+        return 1;
+    }
+
+    PartitionMonth first = last, target;
+    nextPartitionMonth(&first);
+    partitionMonthOf(time(NULL), monthsAhead, &target);
+    if (comparePartitionMonth(&first, &target) > 0) return 1;
+
+    char *list = buildPartitionList(first, target, timestampColumn);
+    if (list == NULL) return 0;
+    size_t size = strlen(list) + 256;
+    char *alter = malloc(size);
+    if (alter == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(list);
+        return 0;
+    }
+    snprintf(alter, size, "ALTER TABLE %s REORGANIZE PARTITION pmax INTO (%s)", setup->table, list);
+    int result = runSchemaQuery(conn, alter);
+    free(alter);
+    free(list);
+    return result;
+}
+
+// Periodic roll from a background thread, on a pooled connection
+int maintainPartitions(SQLSetup *setup, unsigned int monthsAhead) {
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
+    int result = rollPartitions(setup, connection->conn, monthsAhead);
+    releaseConnection(setup, connection, result);
+    return result;
+}
+
+// Idempotent; the checks only run once per setup. partitionMonths = 0
+// leaves the table unpartitioned. Returns 0 only when the table or the
+// rollups could not be created.
+int ensureSchema(SQLSetup *setup, MYSQL *conn, unsigned int partitionMonths) {
+    if (setup->schemaReady) return 1;
+    char query[512];
+    snprintf(query, sizeof(query),
+        "CREATE TABLE IF NOT EXISTS %s (TempLHS INT, TempRHS INT, HumLHS INT, HumRHS INT, "
+        "time TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP, INDEX " SCHEMA_TIME_INDEX " (time))",
+        setup->table);
+    if (!runSchemaQuery(conn, query)) return 0;
+    // Both only cost speed when they fail (e.g. no ALTER privilege or a
+    // primary key without time), so the program still starts
+    if (!ensureTimeIndex(setup, conn))
+        fprintf(stderr, "Continuing without an index on %s.time\n", setup->table);
+    if (partitionMonths > 0 && !rollPartitions(setup, conn, partitionMonths))
+        fprintf(stderr, "Continuing without monthly partitions on %s\n", setup->table);
+    if (!createRollupTables(setup, conn)) return 0;
+    setup->schemaReady = 1;
+    return 1;
+}
+
+#endif
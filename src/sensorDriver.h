@@ -0,0 +1,60 @@
+#ifndef SENSOR_DRIVER_H
+#define SENSOR_DRIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "DHT11Control.h"
+#include "dht11Decoder.h"
+
+// Everything downstream of the sampler only needs DHT11 style frames
+// (HumLHS, HumRHS, TempLHS, TempRHS, checksum), so any source that can
+// fill one can stand in for the real sensor.
+struct sensorDriver {
+    const char *name;
+    bool (*init)(struct sensorDriver *driver);
+    bool (*read)(struct sensorDriver *driver, int data[5]);
+    void (*close)(struct sensorDriver *driver);
+    void *context;
+};
+typedef struct sensorDriver SensorDriver;
+
+bool initSensor(SensorDriver *driver) { return driver->init == NULL || driver->init(driver); }
+bool readSensor(SensorDriver *driver, int data[5]) { return driver->read(driver, data); }
+void closeSensor(SensorDriver *driver) {
+    if (driver->close != NULL) driver->close(driver);
+}
+
+// Fills in the checksum byte the way the DHT11 sends it
+void setChecksum(int data[5]) {
+    data[4] = (data[0] + data[1] + data[2] + data[3]) & 0xFF;
+}
+
+// DHT11 on a wiringPi pin
+bool dht11DriverInit(SensorDriver *driver) { return dht11_init(*(int*)driver->context); }
+bool dht11DriverRead(SensorDriver *driver, int data[5]) {
+    (void)driver;
+    return read_dht11_dat(data);
+}
+
+void createDHT11Driver(SensorDriver *driver, int *pin) {
+    driver->name = "dht11";
+    driver->init = dht11DriverInit;
+    driver->read = dht11DriverRead;
+    driver->close = NULL;
+    driver->context = pin;
+}
+
+// DHT11 decoded from kernel timestamped GPIO edges
+bool dht11EdgeDriverRead(SensorDriver *driver, int data[5]) {
+    return read_dht11_edges((Dht11Line*)driver->context, data);
+}
+
+void createDHT11EdgeDriver(SensorDriver *driver, Dht11Line *line) {
+    driver->name = "dht11_edge";
+    driver->init = NULL;
+    driver->read = dht11EdgeDriverRead;
+    driver->close = NULL;
+    driver->context = line;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef SERIES_PYRAMID_H
+#define SERIES_PYRAMID_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <mysql/mysql.h>
+#include "dataList.h"
+
+// Min / max / sum pyramid over a loaded raw series, so the graph can zoom
+// and pan inside it without going back to MySQL. Level 0 is the rows
+// themselves, level k holds one summary per 2^k rows. keys[] is the
+// timestampKey of every row and finds the rows of any time window with a
+// binary search. Any run of rows [i, j) splits into O(log n) aligned
+// blocks from the levels, so a window drawn as `columns` points costs
+// O(columns * log n) whatever its length.
+
+#define PYRAMID_MAX_LEVELS 40
+// About 110 bytes a row; longer ranges are streamed instead
+#define PYRAMID_MAX_ROWS 2000000
+
+struct pyramidLevel {
+    size_t count;
+    void *arena;
+    double *temperatureMin;
+    double *temperatureMax;
+    double *temperatureSum;
+    double *humidityMin;
+    double *humidityMax;
+    double *humiditySum;
+};
+typedef struct pyramidLevel PyramidLevel;
+
+struct seriesPyramid {
+    DataSeries rows;
+    uint64_t *keys;
+    int levels;
+    PyramidLevel level[PYRAMID_MAX_LEVELS];
+    // Span that was loaded, inclusive. Only windows inside it are answered.
+    uint64_t fromKey;
+    uint64_t toKey;
+    int loaded;
+};
+typedef struct seriesPyramid SeriesPyramid;
+
+struct pyramidSummary {
+    size_t count;
+    double temperatureMin;
+    double temperatureMax;
+    double temperatureSum;
+    double humidityMin;
+    double humidityMax;
+    double humiditySum;
+};
+typedef struct pyramidSummary PyramidSummary;
+
+void initSeriesPyramid(SeriesPyramid *pyramid) {
+    memset(pyramid, 0, sizeof(*pyramid));
+    initDataSeries(&pyramid->rows);
+}
+
+void freeSeriesPyramid(SeriesPyramid *pyramid) {
+    freeDataSeries(&pyramid->rows);
+    free(pyramid->keys);
+    for (int k = 1; k < pyramid->levels; k++) free(pyramid->level[k].arena);
+    initSeriesPyramid(pyramid);
+}
+
+int allocPyramidLevel(PyramidLevel *level, size_t count) {
+    level->count = count;
+    level->arena = malloc(6 * count * sizeof(double));
+    if (level->arena == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    double *column = (double*)level->arena;
+    level->temperatureMin = column;
+    level->temperatureMax = column + count;
+    level->temperatureSum = column + 2 * count;
+    level->humidityMin = column + 3 * count;
+    level->humidityMax = column + 4 * count;
+    level->humiditySum = column + 5 * count;
+    return 1;
+}
+
+// Takes the rows over; they must be in time order. Returns 0 (and frees
+// everything) when the levels could not be allocated.
+int buildSeriesPyramid(SeriesPyramid *pyramid, DataSeries *rows, uint64_t fromKey, uint64_t toKey) {
+    freeSeriesPyramid(pyramid);
+    pyramid->rows = *rows;
+    initDataSeries(rows);
+    size_t count = pyramid->rows.count;
+    pyramid->keys = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    if (pyramid->keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        freeSeriesPyramid(pyramid);
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) pyramid->keys[i] = timestampKey(&pyramid->rows.time[i]);
+
+    pyramid->levels = 1;
+    for (int k = 1; k < PYRAMID_MAX_LEVELS && (count >> k) > 0; k++) {
+        PyramidLevel *level = &pyramid->level[k];
+        if (!allocPyramidLevel(level, count >> k)) {
+            freeSeriesPyramid(pyramid);
+            return 0;
+        }
+        pyramid->levels = k + 1;
+        for (size_t j = 0; j < level->count; j++) {
+            size_t a = 2 * j, b = 2 * j + 1;
+            if (k == 1) {
+                const double *temperature = pyramid->rows.temperature, *humidity = pyramid->rows.humidity;
+                level->temperatureMin[j] = fmin(temperature[a], temperature[b]);
+                level->temperatureMax[j] = fmax(temperature[a], temperature[b]);
+                level->temperatureSum[j] = temperature[a] + temperature[b];
+                level->humidityMin[j] = fmin(humidity[a], humidity[b]);
+                level->humidityMax[j] = fmax(humidity[a], humidity[b]);
+                level->humiditySum[j] = humidity[a] + humidity[b];
+                continue;
+            }
+            PyramidLevel *below = &pyramid->level[k - 1];
+            level->temperatureMin[j] = fmin(below->temperatureMin[a], below->temperatureMin[b]);
+            level->temperatureMax[j] = fmax(below->temperatureMax[a], below->temperatureMax[b]);
+            level->temperatureSum[j] = below->temperatureSum[a] + below->temperatureSum[b];
+            level->humidityMin[j] = fmin(below->humidityMin[a], below->humidityMin[b]);
+            level->humidityMax[j] = fmax(below->humidityMax[a], below->humidityMax[b]);
+            level->humiditySum[j] = below->humiditySum[a] + below->humiditySum[b];
+        }
+    }
+    pyramid->fromKey = fromKey;
+    pyramid->toKey = toKey;
+    pyramid->loaded = 1;
+    return 1;
+}
+
+int pyramidCovers(const SeriesPyramid *pyramid, uint64_t fromKey, uint64_t toKey) {
+    return pyramid->loaded && fromKey >= pyramid->fromKey && toKey <= pyramid->toKey;
+}
+
+// First row at or after key
+size_t pyramidLowerBound(const SeriesPyramid *pyramid, uint64_t key) {
+    size_t low = 0, high = pyramid->rows.count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (pyramid->keys[middle] < key) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// Summary of rows [i, j) from the largest aligned blocks that fit
+void summarizePyramidRows(const SeriesPyramid *pyramid, size_t i, size_t j, PyramidSummary *summary) {
+    summary->count = j - i;
+    summary->temperatureMin = summary->humidityMin = INFINITY;
+    summary->temperatureMax = summary->humidityMax = -INFINITY;
+    summary->temperatureSum = summary->humiditySum = 0;
+    while (i < j) {
+        int k = 0;
+        while (k + 1 < pyramid->levels && (i & (((size_t)2 << k) - 1)) == 0 && i + ((size_t)2 << k) <= j)
+            k++;
+        if (k == 0) {
+            double temperature = pyramid->rows.temperature[i], humidity = pyramid->rows.humidity[i];
+            summary->temperatureMin = fmin(summary->temperatureMin, temperature);
+            summary->temperatureMax = fmax(summary->temperatureMax, temperature);
+            summary->temperatureSum += temperature;
+            summary->humidityMin = fmin(summary->humidityMin, humidity);
+            summary->humidityMax = fmax(summary->humidityMax, humidity);
+            summary->humiditySum += humidity;
+        }
+        else {
+            const PyramidLevel *level = &pyramid->level[k];
+            size_t b = i >> k;
+            summary->temperatureMin = fmin(summary->temperatureMin, level->temperatureMin[b]);
+            summary->temperatureMax = fmax(summary->temperatureMax, level->temperatureMax[b]);
+            summary->temperatureSum += level->temperatureSum[b];
+            summary->humidityMin = fmin(summary->humidityMin, level->humidityMin[b]);
+            summary->humidityMax = fmax(summary->humidityMax, level->humidityMax[b]);
+            summary->humiditySum += level->humiditySum[b];
+        }
+        i += (size_t)1 << k;
+    }
+}
+
+// The rows of [fromKey, toKey] as at most `columns` points. A window with
+// fewer rows than that comes back as the raw rows, a longer one as an
+// aggregated series with one bucket per column of equal time (empty
+// columns are left out) stamped with the time of its first row.
+int queryPyramid(const SeriesPyramid *pyramid, uint64_t fromKey, uint64_t toKey, size_t columns, DataSeries *out) {
+    size_t first = pyramidLowerBound(pyramid, fromKey);
+    size_t last = pyramidLowerBound(pyramid, toKey + 1);
+    if (columns == 0) columns = 1;
+    if (last - first <= columns) {
+        initDataSeries(out);
+        if (!reserveDataSeries(out, (last > first ? last - first : 1))) return 0;
+        for (size_t i = first; i < last; i++) copyDataRow(out, out->count++, &pyramid->rows, i);
+        return 1;
+    }
+
+    initBucketSeries(out);
+    if (!reserveDataSeries(out, columns)) return 0;
+    uint64_t span = toKey - fromKey + 1;
+    size_t i = first;
+    for (size_t column = 0; column < columns && i < last; column++) {
+        uint64_t columnEnd = fromKey + (uint64_t)((double)span * (column + 1) / columns);
+        size_t j = (column == columns - 1 ? last : pyramidLowerBound(pyramid, columnEnd));
+        if (j > last) j = last;
+        if (j <= i) continue;
+        PyramidSummary summary;
+        summarizePyramidRows(pyramid, i, j, &summary);
+        DataBucket bucket;
+        bucket.time = pyramid->rows.time[i];
+        bucket.samples = (uint32_t)summary.count;
+        bucket.temperature = summary.temperatureSum / summary.count;
+        bucket.temperatureMin = summary.temperatureMin;
+        bucket.temperatureMax = summary.temperatureMax;
+        bucket.humidity = summary.humiditySum / summary.count;
+        bucket.humidityMin = summary.humidityMin;
+        bucket.humidityMax = summary.humidityMax;
+        appendDataBucket(out, &bucket);
+        i = j;
+    }
+    return 1;
+}
+
+#endif
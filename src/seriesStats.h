@@ -0,0 +1,401 @@
+#ifndef SERIES_STATS_H
+#define SERIES_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dataList.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Count, sum, min, max, mean and variance of the temperature and humidity
+// columns in one pass. The pass is vectorised (AVX2 when the CPU has it,
+// else SSE2 on x86, NEON on aarch64, scalar elsewhere) and large series are
+// split across cores, each core reducing its own slice.
+//
+// Each slice accumulates (x - shift) and (x - shift)^2 with the slice's
+// first value as the shift, which keeps the sum of squares from cancelling
+// on readings that barely move. Slices are then merged pairwise.
+
+// Below this many rows a single thread is faster than starting more
+#define STATS_PARALLEL_MIN_ROWS 262144
+#define STATS_MAX_THREADS 8
+
+struct seriesStats {
+    size_t count;
+    double sum;
+    double min;
+    double max;
+    double mean;
+    // Population variance
+    double variance;
+};
+typedef struct seriesStats SeriesStats;
+
+struct seriesSummary {
+    SeriesStats temperature;
+    SeriesStats humidity;
+};
+typedef struct seriesSummary SeriesSummary;
+
+// Shifted sums of one column over one slice
+struct statsPartial {
+    size_t count;
+    double shift;
+    double sum;
+    double sumSquares;
+    double min;
+    double max;
+};
+typedef struct statsPartial StatsPartial;
+
+void initStatsPartial(StatsPartial *partial, double shift) {
+    partial->count = 0;
+    partial->shift = shift;
+    partial->sum = 0;
+    partial->sumSquares = 0;
+    partial->min = INFINITY;
+    partial->max = -INFINITY;
+}
+
+void accumulateScalar(StatsPartial *partial, const double *values, size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+        double d = values[i] - partial->shift;
+        partial->sum += d;
+        partial->sumSquares += d * d;
+        if (values[i] < partial->min) partial->min = values[i];
+        if (values[i] > partial->max) partial->max = values[i];
+    }
+    partial->count += end - start;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+void statsKernelAVX2(const double *a, const double *b, size_t count, StatsPartial out[2]) {
+    __m256d shiftA = _mm256_set1_pd(out[0].shift), shiftB = _mm256_set1_pd(out[1].shift);
+    __m256d sumA = _mm256_setzero_pd(), sumB = _mm256_setzero_pd();
+    __m256d squaresA = _mm256_setzero_pd(), squaresB = _mm256_setzero_pd();
+    __m256d minA = _mm256_set1_pd(INFINITY), minB = minA;
+    __m256d maxA = _mm256_set1_pd(-INFINITY), maxB = maxA;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d valueA = _mm256_loadu_pd(a + i), valueB = _mm256_loadu_pd(b + i);
+        __m256d dA = _mm256_sub_pd(valueA, shiftA), dB = _mm256_sub_pd(valueB, shiftB);
+        sumA = _mm256_add_pd(sumA, dA);
+        sumB = _mm256_add_pd(sumB, dB);
+        squaresA = _mm256_add_pd(squaresA, _mm256_mul_pd(dA, dA));
+        squaresB = _mm256_add_pd(squaresB, _mm256_mul_pd(dB, dB));
+        minA = _mm256_min_pd(minA, valueA);
+        minB = _mm256_min_pd(minB, valueB);
+        maxA = _mm256_max_pd(maxA, valueA);
+        maxB = _mm256_max_pd(maxB, valueB);
+    }
+    double lanes[4][4];
+    _mm256_storeu_pd(lanes[0], sumA);
+    _mm256_storeu_pd(lanes[1], squaresA);
+    _mm256_storeu_pd(lanes[2], minA);
+    _mm256_storeu_pd(lanes[3], maxA);
+    for (int l = 0; l < 4; l++) {
+        out[0].sum += lanes[0][l];
+        out[0].sumSquares += lanes[1][l];
+        if (lanes[2][l] < out[0].min) out[0].min = lanes[2][l];
+        if (lanes[3][l] > out[0].max) out[0].max = lanes[3][l];
+    }
+    _mm256_storeu_pd(lanes[0], sumB);
+    _mm256_storeu_pd(lanes[1], squaresB);
+    _mm256_storeu_pd(lanes[2], minB);
+    _mm256_storeu_pd(lanes[3], maxB);
+    for (int l = 0; l < 4; l++) {
+        out[1].sum += lanes[0][l];
+        out[1].sumSquares += lanes[1][l];
+        if (lanes[2][l] < out[1].min) out[1].min = lanes[2][l];
+        if (lanes[3][l] > out[1].max) out[1].max = lanes[3][l];
+    }
+    out[0].count += i;
+    out[1].count += i;
+    accumulateScalar(&out[0], a, i, count);
+    accumulateScalar(&out[1], b, i, count);
+}
+#endif
+
+#if defined(__SSE2__)
+void statsKernelSSE2(const double *a, const double *b, size_t count, StatsPartial out[2]) {
+    __m128d shiftA = _mm_set1_pd(out[0].shift), shiftB = _mm_set1_pd(out[1].shift);
+    __m128d sumA = _mm_setzero_pd(), sumB = _mm_setzero_pd();
+    __m128d squaresA = _mm_setzero_pd(), squaresB = _mm_setzero_pd();
+    __m128d minA = _mm_set1_pd(INFINITY), minB = minA;
+    __m128d maxA = _mm_set1_pd(-INFINITY), maxB = maxA;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d valueA = _mm_loadu_pd(a + i), valueB = _mm_loadu_pd(b + i);
+        __m128d dA = _mm_sub_pd(valueA, shiftA), dB = _mm_sub_pd(valueB, shiftB);
+        sumA = _mm_add_pd(sumA, dA);
+        sumB = _mm_add_pd(sumB, dB);
+        squaresA = _mm_add_pd(squaresA, _mm_mul_pd(dA, dA));
+        squaresB = _mm_add_pd(squaresB, _mm_mul_pd(dB, dB));
+        minA = _mm_min_pd(minA, valueA);
+        minB = _mm_min_pd(minB, valueB);
+        maxA = _mm_max_pd(maxA, valueA);
+        maxB = _mm_max_pd(maxB, valueB);
+    }
+    double lanes[4][2];
+    _mm_storeu_pd(lanes[0], sumA);
+    _mm_storeu_pd(lanes[1], squaresA);
+    _mm_storeu_pd(lanes[2], minA);
+    _mm_storeu_pd(lanes[3], maxA);
+    for (int l = 0; l < 2; l++) {
+        out[0].sum += lanes[0][l];
+        out[0].sumSquares += lanes[1][l];
+        if (lanes[2][l] < out[0].min) out[0].min = lanes[2][l];
+        if (lanes[3][l] > out[0].max) out[0].max = lanes[3][l];
+    }
+    _mm_storeu_pd(lanes[0], sumB);
+    _mm_storeu_pd(lanes[1], squaresB);
+    _mm_storeu_pd(lanes[2], minB);
+    _mm_storeu_pd(lanes[3], maxB);
+    for (int l = 0; l < 2; l++) {
+        out[1].sum += lanes[0][l];
+        out[1].sumSquares += lanes[1][l];
+        if (lanes[2][l] < out[1].min) out[1].min = lanes[2][l];
+        if (lanes[3][l] > out[1].max) out[1].max = lanes[3][l];
+    }
+    out[0].count += i;
+    out[1].count += i;
+    accumulateScalar(&out[0], a, i, count);
+    accumulateScalar(&out[1], b, i, count);
+}
+#endif
+
+#if defined(__aarch64__)
+void statsKernelNEON(const double *a, const double *b, size_t count, StatsPartial out[2]) {
+    float64x2_t shiftA = vdupq_n_f64(out[0].shift), shiftB = vdupq_n_f64(out[1].shift);
+    float64x2_t sumA = vdupq_n_f64(0), sumB = vdupq_n_f64(0);
+    float64x2_t squaresA = vdupq_n_f64(0), squaresB = vdupq_n_f64(0);
+    float64x2_t minA = vdupq_n_f64(INFINITY), minB = minA;
+    float64x2_t maxA = vdupq_n_f64(-INFINITY), maxB = maxA;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        float64x2_t valueA = vld1q_f64(a + i), valueB = vld1q_f64(b + i);
+        float64x2_t dA = vsubq_f64(valueA, shiftA), dB = vsubq_f64(valueB, shiftB);
+        sumA = vaddq_f64(sumA, dA);
+        sumB = vaddq_f64(sumB, dB);
+        squaresA = vfmaq_f64(squaresA, dA, dA);
+        squaresB = vfmaq_f64(squaresB, dB, dB);
+        minA = vminq_f64(minA, valueA);
+        minB = vminq_f64(minB, valueB);
+        maxA = vmaxq_f64(maxA, valueA);
+        maxB = vmaxq_f64(maxB, valueB);
+    }
+    out[0].sum += vaddvq_f64(sumA);
+    out[0].sumSquares += vaddvq_f64(squaresA);
+    out[0].min = fmin(out[0].min, vminvq_f64(minA));
+    out[0].max = fmax(out[0].max, vmaxvq_f64(maxA));
+    out[1].sum += vaddvq_f64(sumB);
+    out[1].sumSquares += vaddvq_f64(squaresB);
+    out[1].min = fmin(out[1].min, vminvq_f64(minB));
+    out[1].max = fmax(out[1].max, vmaxvq_f64(maxB));
+    out[0].count += i;
+    out[1].count += i;
+    accumulateScalar(&out[0], a, i, count);
+    accumulateScalar(&out[1], b, i, count);
+}
+#endif
+
+// One slice of both columns
+void statsKernel(const double *a, const double *b, size_t count, StatsPartial out[2]) {
+    initStatsPartial(&out[0], (count ? a[0] : 0));
+    initStatsPartial(&out[1], (count ? b[0] : 0));
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        statsKernelAVX2(a, b, count, out);
+        return;
+    }
+#endif
+#if defined(__SSE2__)
+    statsKernelSSE2(a, b, count, out);
+#elif defined(__aarch64__)
+    statsKernelNEON(a, b, count, out);
+#else
+    accumulateScalar(&out[0], a, 0, count);
+    accumulateScalar(&out[1], b, 0, count);
+#endif
+}
+
+// Running mean and sum of squared deviations, merged with Chan's formula
+struct statsMoments {
+    size_t count;
+    double mean;
+    double m2;
+    double sum;
+    double min;
+    double max;
+};
+typedef struct statsMoments StatsMoments;
+
+void mergeStatsPartial(StatsMoments *total, const StatsPartial *partial) {
+    if (partial->count == 0) return;
+    double n = (double)partial->count;
+    double mean = partial->shift + partial->sum / n;
+    double m2 = partial->sumSquares - partial->sum * partial->sum / n;
+    if (m2 < 0) m2 = 0;
+
+    if (total->count == 0) {
+        total->mean = mean;
+        total->m2 = m2;
+    } else {
+        double combined = (double)total->count + n;
+        double delta = mean - total->mean;
+        total->mean += delta * n / combined;
+        total->m2 += m2 + delta * delta * (double)total->count * n / combined;
+    }
+    total->count += partial->count;
+    total->sum += partial->shift * n + partial->sum;
+    if (partial->min < total->min) total->min = partial->min;
+    if (partial->max > total->max) total->max = partial->max;
+}
+
+void finishStats(const StatsMoments *moments, SeriesStats *stats) {
+    stats->count = moments->count;
+    stats->sum = moments->sum;
+    stats->min = moments->min;
+    stats->max = moments->max;
+    stats->mean = (moments->count ? moments->mean : NAN);
+    stats->variance = (moments->count ? moments->m2 / moments->count : NAN);
+}
+
+struct statsSlice {
+    const double *a;
+    const double *b;
+    size_t count;
+    StatsPartial partial[2];
+};
+typedef struct statsSlice StatsSlice;
+
+void *statsSliceThread(void *arg) {
+    StatsSlice *slice = (StatsSlice*)arg;
+    statsKernel(slice->a, slice->b, slice->count, slice->partial);
+    return NULL;
+}
+
+int statsThreadCount(size_t count) {
+    if (count < STATS_PARALLEL_MIN_ROWS) return 1;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    if (cores > STATS_MAX_THREADS) cores = STATS_MAX_THREADS;
+    size_t useful = count / (STATS_PARALLEL_MIN_ROWS / 4);
+    return (int)((size_t)cores < useful ? (size_t)cores : useful);
+}
+
+// threads <= 0 picks a count from the row count and the core count
+void summarizeColumns(const double *a, const double *b, size_t count, int threads,
+    SeriesStats *statsA, SeriesStats *statsB) {
+    if (threads <= 0) threads = statsThreadCount(count);
+    if (threads > STATS_MAX_THREADS) threads = STATS_MAX_THREADS;
+    if ((size_t)threads > count) threads = (count ? (int)count : 1);
+
+    StatsSlice slices[STATS_MAX_THREADS];
+    pthread_t workers[STATS_MAX_THREADS];
+    int started[STATS_MAX_THREADS] = {0};
+    size_t per = count / threads;
+    size_t start = 0;
+    for (int t = 0; t < threads; t++) {
+        slices[t].a = a + start;
+        slices[t].b = b + start;
+        slices[t].count = (t == threads - 1 ? count - start : per);
+        start += slices[t].count;
+        // Slice 0 runs here; if a thread cannot start, run its slice here too
+        if (t > 0 && pthread_create(&workers[t], NULL, statsSliceThread, &slices[t]) == 0)
+            started[t] = 1;
+    }
+    for (int t = 0; t < threads; t++)
+        if (!started[t]) statsSliceThread(&slices[t]);
+
+    StatsMoments totalA = { 0, 0, 0, 0, INFINITY, -INFINITY };
+    StatsMoments totalB = totalA;
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(workers[t], NULL);
+        mergeStatsPartial(&totalA, &slices[t].partial[0]);
+        mergeStatsPartial(&totalB, &slices[t].partial[1]);
+    }
+    finishStats(&totalA, statsA);
+    finishStats(&totalB, statsB);
+}
+
+void summarizeSeries(DataSeries *series, int fahrenheit, SeriesSummary *summary) {
+    const double *temperature = (fahrenheit ? series->f_temperature : series->temperature);
+    summarizeColumns(temperature, series->humidity, series->count, 0,
+        &summary->temperature, &summary->humidity);
+}
+
+// Running totals over rows that arrive in batches, e.g. from
+// streamDataInRange. Each batch goes through the same kernel and is merged
+// in like one more slice, so the result matches summarizeSeries.
+struct summaryStream {
+    StatsMoments temperature;
+    StatsMoments humidity;
+};
+typedef struct summaryStream SummaryStream;
+
+void initSummaryStream(SummaryStream *stream) {
+    StatsMoments empty = { 0, 0, 0, 0, INFINITY, -INFINITY };
+    stream->temperature = empty;
+    stream->humidity = empty;
+}
+
+void addToSummaryStream(SummaryStream *stream, DataSeries *batch, int fahrenheit) {
+    StatsPartial partial[2];
+    statsKernel((fahrenheit ? batch->f_temperature : batch->temperature), batch->humidity, batch->count, partial);
+    mergeStatsPartial(&stream->temperature, &partial[0]);
+    mergeStatsPartial(&stream->humidity, &partial[1]);
+}
+
+void finishSummaryStream(const SummaryStream *stream, SeriesSummary *summary) {
+    finishStats(&stream->temperature, &summary->temperature);
+    finishStats(&stream->humidity, &summary->humidity);
+}
+
+// Totals of a bucketed series, weighted by each bucket's reading count.
+// The buckets carry no spread, so the variance is NAN.
+void summarizeBuckets(DataSeries *series, int fahrenheit, SeriesSummary *summary) {
+    SeriesStats *temperature = &summary->temperature, *humidity = &summary->humidity;
+    temperature->count = humidity->count = 0;
+    temperature->sum = humidity->sum = 0;
+    temperature->min = humidity->min = INFINITY;
+    temperature->max = humidity->max = -INFINITY;
+    for (size_t i = 0; i < series->count; i++) {
+        double n = series->samples[i];
+        temperature->count += series->samples[i];
+        temperature->sum += series->temperature[i] * n;
+        temperature->min = fmin(temperature->min, series->temperatureMin[i]);
+        temperature->max = fmax(temperature->max, series->temperatureMax[i]);
+        humidity->sum += series->humidity[i] * n;
+        humidity->min = fmin(humidity->min, series->humidityMin[i]);
+        humidity->max = fmax(humidity->max, series->humidityMax[i]);
+    }
+    humidity->count = temperature->count;
+    temperature->mean = (temperature->count ? temperature->sum / temperature->count : NAN);
+    humidity->mean = (humidity->count ? humidity->sum / humidity->count : NAN);
+    temperature->variance = humidity->variance = NAN;
+    if (fahrenheit && temperature->count) {
+        temperature->mean = celsiusToFahrenheit(temperature->mean);
+        temperature->min = celsiusToFahrenheit(temperature->min);
+        temperature->max = celsiusToFahrenheit(temperature->max);
+        temperature->sum = temperature->mean * temperature->count;
+    }
+}
+
+// Graph ranges, padded when every value is the same
+void padRange(double *min, double *max, double buffer) {
+    if (*min == *max) {
+        *min -= buffer;
+        *max += buffer;
+    }
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef SHARDED_FETCH_H
+#define SHARDED_FETCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include "sqlControl.h"
+#include "storeControl.h"
+#include "dataList.h"
+#include "DHT11Control.h"
+
+// Splits a long range into equal time shards and fetches them at the same
+// time, one thread and one connection per shard, each through its own
+// read-only cursor. Shards are disjoint and each comes back ORDER BY time,
+// so shard 0, then shard 1 and so on is time order without a sort.
+//
+// fetchShardedRange (the whole range in memory) lets every shard fill its
+// own series and joins them at the end. streamShardedRange hands batches to
+// a callback: every shard fills a ring of batches that the callback drains
+// shard by shard. The rings share SHARD_BUFFER_ROWS rows, so later shards
+// keep fetching while the earlier ones are drained, and memory stays
+// bounded however long the range is. Batches are only allocated once a
+// shard gets to them. Shard connections are made with buildConnection so a
+// long export never holds the pool slots the storage thread needs.
+
+#define MAX_SHARDS 16
+// Filled batches a shard may hold at least before it waits for the consumer
+#define SHARD_QUEUE_BATCHES 4
+// Rows all streaming shards may hold together (64 bytes a row)
+#define SHARD_BUFFER_ROWS 524288
+
+// Result binding shared by the single and sharded range fetches
+struct rangeRow {
+    int data[5];
+    MYSQL_TIME time;
+};
+typedef struct rangeRow RangeRow;
+
+void bindRangeRow(MYSQL_BIND bind[5], RangeRow *row) {
+    memset(bind, 0, 5 * sizeof(MYSQL_BIND));
+    for (int i = 0; i < 4; i++) {
+        bind[i].buffer_type = MYSQL_TYPE_LONG;
+        bind[i].buffer = &row->data[i];
+    }
+    bind[4].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[4].buffer = &row->time;
+}
+
+// Columns come back as TempLHS, TempRHS, HumLHS, HumRHS, time
+void appendRangeRow(DataSeries *series, RangeRow *row) {
+    DataValue data;
+    data.time = row->time;
+    convertData(row->data, &data.temperature, &data.humidity);
+    data.f_temperature = celsiusToFahrenheit(data.temperature);
+    appendDataValue(series, &data);
+}
+
+struct rangeShard {
+    SQLSetup *setup;
+    MYSQL_TIME start;
+    MYSQL_TIME end;
+    size_t batchRows;
+    unsigned long prefetchRows;
+    pthread_t thread;
+    int started;
+    // Set when the shard keeps every row here instead of in the ring
+    DataSeries *rows;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    DataSeries *batches;
+    size_t depth;
+    // Ring of filled batches. The consumer owns head, the producer fills
+    // batches[tail], and count is only changed under the lock.
+    size_t head;
+    size_t tail;
+    size_t count;
+    int done;
+    int failed;
+    volatile int *cancel;
+};
+typedef struct rangeShard RangeShard;
+
+// Hands the batch being filled to the consumer and waits for a free slot.
+// Returns 0 when the fetch was cancelled.
+int publishShardBatch(RangeShard *shard) {
+    pthread_mutex_lock(&shard->lock);
+    shard->count++;
+    pthread_cond_broadcast(&shard->changed);
+    while (shard->count == shard->depth && !*shard->cancel)
+        pthread_cond_wait(&shard->changed, &shard->lock);
+    int more = !*shard->cancel;
+    pthread_mutex_unlock(&shard->lock);
+    return more;
+}
+
+void finishShard(RangeShard *shard, int failed) {
+    pthread_mutex_lock(&shard->lock);
+    shard->done = 1;
+    shard->failed = failed;
+    pthread_cond_broadcast(&shard->changed);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void *rangeShardThread(void *arg) {
+    RangeShard *shard = (RangeShard*)arg;
+    mysql_thread_init();
+    MYSQL *conn = buildConnection(shard->setup);
+    MYSQL_STMT *stmt = (conn != NULL ? mysql_stmt_init(conn) : NULL);
+    if (stmt == NULL) {
+        if (conn != NULL) mysql_close(conn);
+        finishShard(shard, 1);
+        mysql_thread_end();
+        return NULL;
+    }
+
+    char query[1024];
+    buildStatementText(shard->setup, RANGE_CURSOR_STATEMENT, query, sizeof(query));
+    MYSQL_BIND bind[2];
+    memset(bind, 0, sizeof(bind));
+    bind[0].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[0].buffer = &shard->start;
+    bind[1].buffer_type = MYSQL_TYPE_TIMESTAMP;
+    bind[1].buffer = &shard->end;
+    RangeRow row;
+    MYSQL_BIND resultBind[5];
+    bindRangeRow(resultBind, &row);
+    unsigned long cursorType = CURSOR_TYPE_READ_ONLY;
+
+    int failed = 0;
+    if (mysql_stmt_prepare(stmt, query, strlen(query)) ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_CURSOR_TYPE, &cursorType) ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_PREFETCH_ROWS, &shard->prefetchRows) ||
+        mysql_stmt_bind_param(stmt, bind) ||
+        mysql_stmt_execute(stmt) ||
+        mysql_stmt_bind_result(stmt, resultBind)) {
+        fprintf(stderr, "Shard fetch failed: %s\n", mysql_stmt_error(stmt));
+        failed = 1;
+    }
+
+    int status = 0, more = !failed;
+    while (more && (status = mysql_stmt_fetch(stmt)) == 0) {
+        if (shard->rows != NULL) {
+            if (shard->rows->count == shard->rows->capacity &&
+                !reserveDataSeries(shard->rows, (shard->rows->capacity > 0 ? shard->rows->capacity * 2 : 4096))) {
+                failed = 1;
+                break;
+            }
+            appendRangeRow(shard->rows, &row);
+            more = !*shard->cancel;
+            continue;
+        }
+        DataSeries *batch = &shard->batches[shard->tail];
+        if (batch->capacity == 0 && !reserveDataSeries(batch, shard->batchRows)) {
+            failed = 1;
+            break;
+        }
+        appendRangeRow(batch, &row);
+        if (batch->count == shard->batchRows) {
+            shard->tail = (shard->tail + 1) % shard->depth;
+            more = publishShardBatch(shard);
+        }
+    }
+    if (more && status == 1) {
+        fprintf(stderr, "Shard fetch failed: %s\n", mysql_stmt_error(stmt));
+        failed = 1;
+    }
+    if (more && !failed && shard->rows == NULL) {
+        // The partly filled batch goes out too
+        pthread_mutex_lock(&shard->lock);
+        if (shard->batches[shard->tail].count > 0) shard->count++;
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    mysql_stmt_close(stmt);
+    mysql_close(conn);
+    finishShard(shard, failed);
+    mysql_thread_end();
+    return NULL;
+}
+
+// Local time in seconds of a range bound
+time_t mysqlTimeToTime(const MYSQL_TIME *value) {
+    struct tm local;
+    memset(&local, 0, sizeof(local));
+    local.tm_year = value->year - 1900;
+    local.tm_mon = value->month - 1;
+    local.tm_mday = value->day;
+    local.tm_hour = value->hour;
+    local.tm_min = value->minute;
+    local.tm_sec = value->second;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+// Splits [start, end] into `shards` back to back inclusive ranges
+void splitRange(const MYSQL_TIME *start, const MYSQL_TIME *end, unsigned int shards,
+    MYSQL_TIME *starts, MYSQL_TIME *ends) {
+    time_t from = mysqlTimeToTime(start), to = mysqlTimeToTime(end);
+    time_t span = (to - from + 1) / shards;
+    for (unsigned int i = 0; i < shards; i++) {
+        time_t shardStart = from + span * i;
+        time_t shardEnd = (i == shards - 1 ? to : shardStart + span - 1);
+        toMySQLTime(shardStart, &starts[i]);
+        toMySQLTime(shardEnd, &ends[i]);
+    }
+}
+
+// Starts one thread per shard. With series set every shard keeps its rows
+// in series[i], otherwise in a ring of `depth` batches.
+int startRangeShards(RangeShard *list, SQLSetup *setup, const MYSQL_TIME *start, const MYSQL_TIME *end,
+    unsigned int shards, size_t batchRows, size_t depth, unsigned long prefetchRows, DataSeries *series,
+    volatile int *cancel) {
+    MYSQL_TIME starts[MAX_SHARDS], ends[MAX_SHARDS];
+    splitRange(start, end, shards, starts, ends);
+    int result = 1;
+    for (unsigned int i = 0; i < shards; i++) {
+        RangeShard *shard = &list[i];
+        shard->setup = setup;
+        shard->start = starts[i];
+        shard->end = ends[i];
+        shard->batchRows = batchRows;
+        shard->prefetchRows = prefetchRows;
+        shard->cancel = cancel;
+        shard->rows = (series != NULL ? &series[i] : NULL);
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->changed, NULL);
+        if (series != NULL) continue;
+        shard->depth = depth;
+        shard->batches = calloc(depth, sizeof(DataSeries));
+        if (shard->batches == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            result = 0;
+        }
+    }
+    for (unsigned int i = 0; i < shards && result; i++) {
+        if (pthread_create(&list[i].thread, NULL, rangeShardThread, &list[i]) != 0) {
+            perror("Failed to create shard thread");
+            result = 0;
+        }
+        else list[i].started = 1;
+    }
+    return result;
+}
+
+void stopRangeShards(RangeShard *list, unsigned int shards, volatile int *cancel) {
+    // Wakes any producer still waiting on a full ring
+    *cancel = 1;
+    for (unsigned int i = 0; i < shards; i++) {
+        RangeShard *shard = &list[i];
+        pthread_mutex_lock(&shard->lock);
+        pthread_cond_broadcast(&shard->changed);
+        pthread_mutex_unlock(&shard->lock);
+        if (shard->started) pthread_join(shard->thread, NULL);
+        if (shard->batches != NULL)
+            for (size_t j = 0; j < shard->depth; j++) freeDataSeries(&shard->batches[j]);
+        free(shard->batches);
+        pthread_cond_destroy(&shard->changed);
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+unsigned int clampShards(unsigned int shards) {
+    if (shards < 1) return 1;
+    return (shards > MAX_SHARDS ? MAX_SHARDS : shards);
+}
+
+// Appends the whole range to series. Every shard fetches into its own
+// series at full speed and they are joined in shard order at the end.
+int fetchShardedRange(SQLSetup *setup, const MYSQL_TIME *start, const MYSQL_TIME *end, unsigned int shards,
+    unsigned long prefetchRows, DataSeries *series) {
+    shards = clampShards(shards);
+    if (prefetchRows == 0) prefetchRows = 1;
+    RangeShard *list = calloc(shards, sizeof(RangeShard));
+    DataSeries *parts = calloc(shards, sizeof(DataSeries));
+    if (list == NULL || parts == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(list);
+        free(parts);
+        return 0;
+    }
+    for (unsigned int i = 0; i < shards; i++) initDataSeries(&parts[i]);
+
+    volatile int cancel = 0;
+    int result = startRangeShards(list, setup, start, end, shards, 0, 0, prefetchRows, parts, &cancel);
+    for (unsigned int i = 0; i < shards && result; i++) {
+        pthread_join(list[i].thread, NULL);
+        list[i].started = 0;
+        if (list[i].failed) result = 0;
+    }
+    stopRangeShards(list, shards, &cancel);
+
+    size_t total = series->count;
+    for (unsigned int i = 0; i < shards; i++) total += parts[i].count;
+    if (result && !reserveDataSeries(series, total)) result = 0;
+    for (unsigned int i = 0; i < shards; i++) {
+        if (result && !appendDataSeries(series, &parts[i])) result = 0;
+        freeDataSeries(&parts[i]);
+    }
+    free(parts);
+    free(list);
+    return result;
+}
+
+// Returns 1 when every shard was fetched and handed over in full
+int streamShardedRange(SQLSetup *setup, const MYSQL_TIME *start, const MYSQL_TIME *end, unsigned int shards,
+    size_t batchRows, unsigned long prefetchRows, DataBatchCallback callback, void *context) {
+    shards = clampShards(shards);
+    if (batchRows == 0) batchRows = 1;
+    if (prefetchRows == 0) prefetchRows = 1;
+    size_t depth = SHARD_BUFFER_ROWS / batchRows / shards;
+    if (depth < SHARD_QUEUE_BATCHES) depth = SHARD_QUEUE_BATCHES;
+
+    RangeShard *list = calloc(shards, sizeof(RangeShard));
+    if (list == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    volatile int cancel = 0;
+    int result = startRangeShards(list, setup, start, end, shards, batchRows, depth, prefetchRows, NULL, &cancel);
+
+    // Shard by shard, batch by batch
+    for (unsigned int i = 0; i < shards && result; i++) {
+        RangeShard *shard = &list[i];
+        while (result) {
+            pthread_mutex_lock(&shard->lock);
+            while (shard->count == 0 && !shard->done)
+                pthread_cond_wait(&shard->changed, &shard->lock);
+            int empty = (shard->count == 0), finished = shard->done;
+            if (empty && shard->failed) result = 0;
+            pthread_mutex_unlock(&shard->lock);
+            if (empty) break;
+
+            DataSeries *batch = &shard->batches[shard->head];
+            if (!callback(batch, context)) result = 0;
+            // A finished shard never touches its ring again, so what was
+            // drained goes back to the shards still running
+            if (finished) freeDataSeries(batch);
+            else batch->count = 0;
+            pthread_mutex_lock(&shard->lock);
+            shard->head = (shard->head + 1) % shard->depth;
+            shard->count--;
+            pthread_cond_broadcast(&shard->changed);
+            pthread_mutex_unlock(&shard->lock);
+        }
+    }
+
+    stopRangeShards(list, shards, &cancel);
+    free(list);
+    return result;
+}
+
+#endif
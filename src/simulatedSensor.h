@@ -0,0 +1,189 @@
+#ifndef SIMULATED_SENSOR_H
+#define SIMULATED_SENSOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "sensorDriver.h"
+#include "sqlControl.h"
+
+// Sensor driver that needs no hardware. Produces a synthetic daily cycle,
+// or replays frames from a CSV file or an existing table, with an optional
+// checksum failure rate and read latency so the rest of the pipeline can be
+// load tested on any Linux box.
+
+// Synthetic samples per simulated day (one day of 10 second readings)
+#define SIMULATED_DAY_SAMPLES 8640
+
+struct simulatedSensor {
+    const char *csvPath;
+    const char *table;
+    SQLSetup *setup;
+    // Replayed frames (HumLHS, HumRHS, TempLHS, TempRHS); NULL for synthetic
+    int (*frames)[4];
+    size_t frameCount;
+    size_t frameCapacity;
+    size_t next;
+    unsigned int failPercent;
+    unsigned int latencyUs;
+    unsigned int jitterUs;
+    unsigned int seed;
+    uint64_t reads;
+    uint64_t failures;
+};
+typedef struct simulatedSensor SimulatedSensor;
+
+void initSimulatedSensor(SimulatedSensor *sensor) {
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->seed = (unsigned int)time(NULL);
+}
+
+int addSimulatedFrame(SimulatedSensor *sensor, int humLHS, int humRHS, int tempLHS, int tempRHS) {
+    if (sensor->frameCount == sensor->frameCapacity) {
+        size_t capacity = (sensor->frameCapacity == 0 ? 1024 : sensor->frameCapacity * 2);
+        void *grown = realloc(sensor->frames, capacity * sizeof(*sensor->frames));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        sensor->frames = grown;
+        sensor->frameCapacity = capacity;
+    }
+    int *frame = sensor->frames[sensor->frameCount++];
+    frame[0] = humLHS;
+    frame[1] = humRHS;
+    frame[2] = tempLHS;
+    frame[3] = tempRHS;
+    return 1;
+}
+
+// Whole part and first decimal digit, matching what convertData decodes
+void splitReading(double value, int *whole, int *decimal) {
+    if (value < 0) value = 0;
+    *whole = (int)value;
+    *decimal = (int)((value - *whole) * 10);
+}
+
+// Each line is either "temperature,humidity" or the raw
+// "HumLHS,HumRHS,TempLHS,TempRHS" columns. Other lines are skipped.
+int loadSimulatedCSV(SimulatedSensor *sensor, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Failed to open simulation CSV");
+        return 0;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        double values[4];
+        int fields = sscanf(line, "%lf,%lf,%lf,%lf", &values[0], &values[1], &values[2], &values[3]);
+        if (fields == 4) {
+            addSimulatedFrame(sensor, (int)values[0], (int)values[1], (int)values[2], (int)values[3]);
+        } else if (fields == 2) {
+            int tempWhole, tempDecimal, humWhole, humDecimal;
+            splitReading(values[0], &tempWhole, &tempDecimal);
+            splitReading(values[1], &humWhole, &humDecimal);
+            addSimulatedFrame(sensor, humWhole, humDecimal, tempWhole, tempDecimal);
+        }
+    }
+    fclose(file);
+    if (sensor->frameCount == 0) {
+        fprintf(stderr, "No readings found in \"%s\"\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+int loadSimulatedTable(SimulatedSensor *sensor, SQLSetup *setup, const char *table) {
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
+
+    char query[256];
+    snprintf(query, sizeof(query), "SELECT HumLHS, HumRHS, TempLHS, TempRHS FROM %s ORDER BY time", table);
+    if (mysql_query(connection->conn, query)) {
+        fprintf(stderr, "%s\n", mysql_error(connection->conn));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    MYSQL_RES *res = mysql_use_result(connection->conn);
+    if (res == NULL) {
+        fprintf(stderr, "Failed to read result: %s\n", mysql_error(connection->conn));
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(res)) != NULL) {
+        if (row[0] == NULL || row[1] == NULL || row[2] == NULL || row[3] == NULL) continue;
+        addSimulatedFrame(sensor, atoi(row[0]), atoi(row[1]), atoi(row[2]), atoi(row[3]));
+    }
+    mysql_free_result(res);
+    releaseConnection(setup, connection, 1);
+    if (sensor->frameCount == 0) {
+        fprintf(stderr, "No readings found in table \"%s\"\n", table);
+        return 0;
+    }
+    return 1;
+}
+
+bool simulatedDriverInit(SensorDriver *driver) {
+    SimulatedSensor *sensor = (SimulatedSensor*)driver->context;
+    if (sensor->csvPath != NULL) return loadSimulatedCSV(sensor, sensor->csvPath);
+    if (sensor->table != NULL) return loadSimulatedTable(sensor, sensor->setup, sensor->table);
+    return true;
+}
+
+void simulatedDriverClose(SensorDriver *driver) {
+    SimulatedSensor *sensor = (SimulatedSensor*)driver->context;
+    free(sensor->frames);
+    sensor->frames = NULL;
+    sensor->frameCount = 0;
+    sensor->frameCapacity = 0;
+}
+
+void simulateLatency(SimulatedSensor *sensor) {
+    unsigned int latency = sensor->latencyUs;
+    if (sensor->jitterUs > 0) latency += rand_r(&sensor->seed) % (sensor->jitterUs + 1);
+    if (latency == 0) return;
+    struct timespec pause = { latency / 1000000, (long)(latency % 1000000) * 1000 };
+    nanosleep(&pause, NULL);
+}
+
+bool simulatedDriverRead(SensorDriver *driver, int data[5]) {
+    SimulatedSensor *sensor = (SimulatedSensor*)driver->context;
+    simulateLatency(sensor);
+    sensor->reads++;
+
+    if (sensor->frames != NULL) {
+        int *frame = sensor->frames[sensor->next];
+        sensor->next = (sensor->next + 1) % sensor->frameCount;
+        for (int i = 0; i < 4; i++) data[i] = frame[i];
+    } else {
+        double phase = 2 * M_PI * (double)(sensor->reads % SIMULATED_DAY_SAMPLES) / SIMULATED_DAY_SAMPLES;
+        double noise = (rand_r(&sensor->seed) % 1000) / 1000.0 - 0.5;
+        double temperature = 21 + 4 * sin(phase) + noise;
+        double humidity = 55 - 10 * sin(phase) + 2 * noise;
+        splitReading(humidity, &data[0], &data[1]);
+        splitReading(temperature, &data[2], &data[3]);
+    }
+    setChecksum(data);
+
+    // Behave like a corrupted transfer: the frame arrives but does not verify
+    if (sensor->failPercent > 0 && (unsigned int)(rand_r(&sensor->seed) % 100) < sensor->failPercent) {
+        sensor->failures++;
+        data[4] = (data[4] + 1) & 0xFF;
+        return false;
+    }
+    return true;
+}
+
+void createSimulatedDriver(SensorDriver *driver, SimulatedSensor *sensor) {
+    driver->name = "simulated";
+    driver->init = simulatedDriverInit;
+    driver->read = simulatedDriverRead;
+    driver->close = simulatedDriverClose;
+    driver->context = sensor;
+}
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "storeControl.h"
+
+// Append-only, memory-mapped write-ahead log of readings.
+//
+// The sampler appends every reading here first (a memcpy into the mapping),
+// and the drainer thread replays records past the checkpoint into MySQL.
+// Only the checkpoint is kept in the header; the write position is recovered
+// on open by scanning forward from the checkpoint until the first record
+// whose checksum or generation does not match.
+
+#define SPOOL_MAGIC "ENVSPOOL"
+#define SPOOL_VERSION 1
+#define SPOOL_HEADER_SIZE 4096
+#define SPOOL_GROW_RECORDS 16384
+// fsync after this many unsynced records or this many seconds
+#define SPOOL_SYNC_RECORDS 64
+#define SPOOL_SYNC_SECONDS 1
+
+struct spoolHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    // Bumped every time the file is rewound so stale records read as invalid
+    uint32_t generation;
+    uint32_t reserved;
+    uint64_t checkpoint;
+};
+typedef struct spoolHeader SpoolHeader;
+
+struct spoolRecord {
+    int64_t time;
+    int32_t data[5];
+    uint32_t generation;
+    uint32_t reserved;
+    uint32_t checksum;
+};
+typedef struct spoolRecord SpoolRecord;
+
+struct spool {
+    int fd;
+    char *path;
+    unsigned char *map;
+    size_t mapSize;
+    size_t capacity;
+    uint64_t head;
+    uint64_t synced;
+    time_t lastSync;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+typedef struct spool Spool;
+
+uint32_t spoolChecksum(const SpoolRecord *record) {
+    // FNV-1a over everything but the checksum itself
+    const unsigned char *bytes = (const unsigned char*)record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(SpoolRecord, checksum); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+SpoolHeader *spoolHeader(Spool *spool) { return (SpoolHeader*)spool->map; }
+SpoolRecord *spoolRecords(Spool *spool) { return (SpoolRecord*)(spool->map + SPOOL_HEADER_SIZE); }
+
+int spoolRecordValid(Spool *spool, uint64_t index) {
+    SpoolRecord *record = &spoolRecords(spool)[index];
+    return record->generation == spoolHeader(spool)->generation && record->checksum == spoolChecksum(record);
+}
+
+// The old mapping is only dropped once the new one is in place, so a grow
+// that fails (e.g. a full disk) leaves the spool as it was
+int mapSpool(Spool *spool, size_t capacity) {
+    size_t size = SPOOL_HEADER_SIZE + capacity * sizeof(SpoolRecord);
+    if (ftruncate(spool->fd, size) != 0) {
+        perror("Failed to size spool file");
+        return 0;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, spool->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to map spool file");
+        return 0;
+    }
+    if (spool->map != NULL) munmap(spool->map, spool->mapSize);
+    spool->map = map;
+    spool->mapSize = size;
+    spool->capacity = capacity;
+    return 1;
+}
+
+int openSpool(Spool *spool, const char *path) {
+    memset(spool, 0, sizeof(*spool));
+    spool->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (spool->fd < 0) {
+        fprintf(stderr, "Failed to open spool \"%s\": %s\n", path, strerror(errno));
+        return 0;
+    }
+    spool->path = strdup(path);
+
+    struct stat info;
+    fstat(spool->fd, &info);
+    size_t capacity = SPOOL_GROW_RECORDS;
+    if ((size_t)info.st_size > SPOOL_HEADER_SIZE)
+        capacity = (info.st_size - SPOOL_HEADER_SIZE) / sizeof(SpoolRecord);
+    if (!mapSpool(spool, capacity)) {
+        close(spool->fd);
+        free(spool->path);
+        return 0;
+    }
+
+    SpoolHeader *header = spoolHeader(spool);
+    if (memcmp(header->magic, SPOOL_MAGIC, 8) != 0 || header->version != SPOOL_VERSION ||
+        header->recordSize != sizeof(SpoolRecord)) {
+        if ((size_t)info.st_size > 0 && header->magic[0] != '\0')
+            fprintf(stderr, "Spool \"%s\" has an unknown format, starting a new one\n", path);
+        memset(spool->map, 0, spool->mapSize);
+        memcpy(header->magic, SPOOL_MAGIC, 8);
+        header->version = SPOOL_VERSION;
+        header->recordSize = sizeof(SpoolRecord);
+        header->generation = 1;
+        header->checkpoint = 0;
+        fdatasync(spool->fd);
+    }
+
+    // Recover the write position
+    uint64_t head = header->checkpoint;
+    while (head < spool->capacity && spoolRecordValid(spool, head))
+        head++;
+    spool->head = head;
+    spool->synced = head;
+    spool->lastSync = time(NULL);
+
+    pthread_mutex_init(&spool->lock, NULL);
+    pthread_cond_init(&spool->wake, NULL);
+    return 1;
+}
+
+// Called by the drainer with the lock held once everything is stored.
+// Starts writing from the front of the file again.
+void rewindSpool(Spool *spool) {
+    SpoolHeader *header = spoolHeader(spool);
+    header->generation++;
+    header->checkpoint = 0;
+    spool->head = 0;
+    spool->synced = 0;
+}
+
+// Constant time unless the file has to grow. Never touches the database.
+int appendSpool(Spool *spool, int data[5], time_t time) {
+    pthread_mutex_lock(&spool->lock);
+    if (spool->head == spool->capacity && !mapSpool(spool, spool->capacity + SPOOL_GROW_RECORDS)) {
+        pthread_mutex_unlock(&spool->lock);
+        return 0;
+    }
+    SpoolRecord record;
+    memset(&record, 0, sizeof(record));
+    record.time = time;
+    for (int i = 0; i < 5; i++) record.data[i] = data[i];
+    record.generation = spoolHeader(spool)->generation;
+    record.checksum = spoolChecksum(&record);
+    spoolRecords(spool)[spool->head++] = record;
+    pthread_cond_signal(&spool->wake);
+    pthread_mutex_unlock(&spool->lock);
+    return 1;
+}
+
+// Flushes appended records to disk in batches. Runs on the drainer thread.
+// fdatasync goes through the file descriptor, so the sampler can keep
+// appending (and even remap the file) while the flush is in progress.
+void syncSpool(Spool *spool, int force) {
+    pthread_mutex_lock(&spool->lock);
+    uint64_t head = spool->head;
+    uint64_t pending = head - spool->synced;
+    time_t now = time(NULL);
+    int due = pending > 0 && (force || pending >= SPOOL_SYNC_RECORDS || now - spool->lastSync >= SPOOL_SYNC_SECONDS);
+    pthread_mutex_unlock(&spool->lock);
+    if (!due) return;
+
+    fdatasync(spool->fd);
+
+    pthread_mutex_lock(&spool->lock);
+    // A rewind in between means head went back to 0; nothing to record
+    if (spool->synced < head && head <= spool->head) spool->synced = head;
+    spool->lastSync = now;
+    pthread_mutex_unlock(&spool->lock);
+}
+
+uint64_t pendingSpool(Spool *spool) {
+    pthread_mutex_lock(&spool->lock);
+    uint64_t pending = spool->head - spoolHeader(spool)->checkpoint;
+    pthread_mutex_unlock(&spool->lock);
+    return pending;
+}
+
+// Copies up to `max` undrained records. Returns the count copied.
+size_t peekSpool(Spool *spool, Reading *readings, size_t max) {
+    pthread_mutex_lock(&spool->lock);
+    uint64_t checkpoint = spoolHeader(spool)->checkpoint;
+    size_t count = spool->head - checkpoint;
+    if (count > max) count = max;
+    for (size_t i = 0; i < count; i++) {
+        SpoolRecord *record = &spoolRecords(spool)[checkpoint + i];
+        for (int j = 0; j < 5; j++) readings[i].data[j] = record->data[j];
+        readings[i].time = (time_t)record->time;
+    }
+    pthread_mutex_unlock(&spool->lock);
+    return count;
+}
+
+// Marks `count` records as stored in MySQL
+void advanceSpool(Spool *spool, size_t count) {
+    pthread_mutex_lock(&spool->lock);
+    SpoolHeader *header = spoolHeader(spool);
+    header->checkpoint += count;
+    if (header->checkpoint == spool->head && spool->synced == spool->head)
+        rewindSpool(spool);
+    pthread_mutex_unlock(&spool->lock);
+    fdatasync(spool->fd);
+}
+
+// Sleeps until a record is appended, wakeSpool is called or the timeout passes
+void waitSpool(Spool *spool, unsigned int seconds) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += seconds;
+    pthread_mutex_lock(&spool->lock);
+    pthread_cond_timedwait(&spool->wake, &spool->lock, &deadline);
+    pthread_mutex_unlock(&spool->lock);
+}
+
+void wakeSpool(Spool *spool) {
+    pthread_mutex_lock(&spool->lock);
+    pthread_cond_broadcast(&spool->wake);
+    pthread_mutex_unlock(&spool->lock);
+}
+
+// Replays spooled readings into MySQL in batches of up to batchSize. A
+// partial batch is only sent once its oldest reading is flushSeconds old,
+// unless force is set. Returns 0 if a store failed; the records stay
+// spooled and are retried on the next call.
+int drainSpool(Spool *spool, SQLSetup *setup, Reading *batch, size_t batchSize, size_t flushSeconds, int force) {
+    while (1) {
+        size_t count = peekSpool(spool, batch, batchSize);
+        if (count == 0) return 1;
+        if (!force && count < batchSize && (size_t)(time(NULL) - batch[0].time) < flushSeconds) return 1;
+        if (!storeReadings(setup, batch, count)) return 0;
+        advanceSpool(spool, count);
+    }
+}
+
+void closeSpool(Spool *spool) {
+    if (spool->map != NULL) {
+        fdatasync(spool->fd);
+        munmap(spool->map, spool->mapSize);
+    }
+    if (spool->fd >= 0) close(spool->fd);
+    free(spool->path);
+    pthread_cond_destroy(&spool->wake);
+    pthread_mutex_destroy(&spool->lock);
+    spool->map = NULL;
+    spool->fd = -1;
+    spool->path = NULL;
+}
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef SQL_CONTROL_H
+#define SQL_CONTROL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+
+#define SQL_POOL_SIZE 4
+// Idle connections older than this are pinged before they are handed out
+#define SQL_PING_IDLE_SECONDS 30
+#define SQL_CONNECT_TIMEOUT_SECONDS 5
+#define SQL_MAX_BACKOFF_SECONDS 60
+
+// Statements prepared once per connection and kept for its lifetime
+enum SQLStatement {
+    RANGE_STATEMENT = 0,
+    // Same query, executed with a read-only cursor (see streamDataInRange)
+    RANGE_CURSOR_STATEMENT,
+    AGGREGATE_STATEMENT,
+    HOURLY_RANGE_STATEMENT,
+    DAILY_RANGE_STATEMENT,
+    HOURLY_UPSERT_STATEMENT,
+    DAILY_UPSERT_STATEMENT,
+    STATEMENT_COUNT
+};
+
+struct sqlConnection {
+    MYSQL *conn;
+    MYSQL_STMT *statements[STATEMENT_COUNT];
+    // Multi-row insert, prepared for batchRows rows (see storeControl.h)
+    MYSQL_STMT *batchStatement;
+    size_t batchRows;
+    time_t lastUsed;
+    int inUse;
+};
+typedef struct sqlConnection SQLConnection;
+
+struct sqlPool {
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    SQLConnection connections[SQL_POOL_SIZE];
+    // Consecutive failed connects and the time the next attempt is allowed
+    unsigned int failures;
+    time_t retryAt;
+};
+typedef struct sqlPool SQLPool;
+
+struct sqlSetup {
+    char *server;
+    char *user;
+    char *password;
+    char *database;
+    char *table;
+    SQLPool pool;
+    // Set once the rollup tables are known to exist (see rollup.h)
+    int rollupsReady;
+    // Set once the raw table was checked and migrated (see schema.h)
+    int schemaReady;
+};
+typedef struct sqlSetup SQLSetup;
+
+void initPool(SQLPool *pool) {
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    memset(pool->connections, 0, sizeof(pool->connections));
+    pool->failures = 0;
+    pool->retryAt = 0;
+}
+
+void closeConnection(SQLConnection *connection) {
+    for (int i = 0; i < STATEMENT_COUNT; i++) {
+        if (connection->statements[i] != NULL) mysql_stmt_close(connection->statements[i]);
+        connection->statements[i] = NULL;
+    }
+    if (connection->batchStatement != NULL) mysql_stmt_close(connection->batchStatement);
+    connection->batchStatement = NULL;
+    connection->batchRows = 0;
+    if (connection->conn != NULL) mysql_close(connection->conn);
+    connection->conn = NULL;
+}
+
+void freePool(SQLPool *pool) {
+    for (int i = 0; i < SQL_POOL_SIZE; i++)
+        closeConnection(&pool->connections[i]);
+    pthread_cond_destroy(&pool->available);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void initSetup(SQLSetup *setup) {
+    setup->server = NULL;
+    setup->user = NULL;
+    setup->password = NULL;
+    setup->database = NULL;
+    setup->table = NULL;
+    setup->rollupsReady = 0;
+    setup->schemaReady = 0;
+    initPool(&setup->pool);
+}
+void freeSetup(SQLSetup *setup) {
+    freePool(&setup->pool);
+    if (setup->server != NULL) free(setup->server);
+    if (setup->user != NULL) free(setup->user);
+    if (setup->password != NULL) free(setup->password);
+    if (setup->database != NULL) free(setup->database);
+    if (setup->table != NULL) free(setup->table);
+    setup->server = NULL;
+    setup->user = NULL;
+    setup->password = NULL;
+    setup->database = NULL;
+    setup->table = NULL;
+}
+
+// Leaves the reason in error when the connection fails
+MYSQL *tryConnection(SQLSetup *setup, char *error, size_t size) {
+    MYSQL *conn;
+    conn = mysql_init(NULL);
+    if (conn == NULL) {
+        snprintf(error, size, "mysql_init() failed");
+        return NULL;
+    }
+    unsigned int timeout = SQL_CONNECT_TIMEOUT_SECONDS;
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    if (!mysql_real_connect(conn, setup->server, setup->user, setup->password, setup->database, 0, NULL, 0)) {
+        snprintf(error, size, "%s", mysql_error(conn));
+        mysql_close(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+MYSQL *buildConnection(SQLSetup *setup) {
+    char error[512];
+    MYSQL *conn = tryConnection(setup, error, sizeof(error));
+    if (conn == NULL) fprintf(stderr, "%s\n", error);
+    return conn;
+}
+
+// Connects an empty slot unless the pool is still backing off from earlier
+// failures. Failing fast keeps the sampler thread from stacking up connect
+// timeouts while the server is down. An outage is logged once when it
+// starts and once when the server is back, not on every refused attempt.
+int openConnection(SQLSetup *setup, SQLConnection *connection) {
+    SQLPool *pool = &setup->pool;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    time_t retryAt = pool->retryAt;
+    pthread_mutex_unlock(&pool->lock);
+    if (now < retryAt) return 0;
+
+    char error[512];
+    connection->conn = tryConnection(setup, error, sizeof(error));
+
+    pthread_mutex_lock(&pool->lock);
+    unsigned int failures = pool->failures;
+    if (connection->conn == NULL) {
+        unsigned int shift = (pool->failures < 6 ? pool->failures : 6);
+        long backoff = 1L << shift;
+        if (backoff > SQL_MAX_BACKOFF_SECONDS) backoff = SQL_MAX_BACKOFF_SECONDS;
+        pool->failures++;
+        pool->retryAt = time(NULL) + backoff;
+    } else {
+        pool->failures = 0;
+        pool->retryAt = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (connection->conn == NULL && failures == 0)
+        fprintf(stderr, "Database unreachable (%s), retrying with a backoff of up to %d seconds\n",
+            error, SQL_MAX_BACKOFF_SECONDS);
+    else if (connection->conn != NULL && failures > 0)
+        fprintf(stderr, "Database reachable again after %u failed connects\n", failures);
+
+    connection->lastUsed = time(NULL);
+    return connection->conn != NULL;
+}
+
+// Hands out a connection for the calling thread's exclusive use. Blocks
+// while every slot is taken. Returns NULL if no live connection could be
+// made; the slot is returned to the pool in that case.
+SQLConnection *acquireConnection(SQLSetup *setup) {
+    SQLPool *pool = &setup->pool;
+    SQLConnection *connection = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    while (connection == NULL) {
+        // Prefer a slot that is already connected
+        for (int i = 0; i < SQL_POOL_SIZE && connection == NULL; i++)
+            if (!pool->connections[i].inUse && pool->connections[i].conn != NULL)
+                connection = &pool->connections[i];
+        for (int i = 0; i < SQL_POOL_SIZE && connection == NULL; i++)
+            if (!pool->connections[i].inUse)
+                connection = &pool->connections[i];
+        if (connection == NULL)
+            pthread_cond_wait(&pool->available, &pool->lock);
+    }
+    connection->inUse = 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (connection->conn != NULL && time(NULL) - connection->lastUsed >= SQL_PING_IDLE_SECONDS) {
+        if (mysql_ping(connection->conn) != 0)
+            closeConnection(connection);
+    }
+    if (connection->conn == NULL && !openConnection(setup, connection)) {
+        pthread_mutex_lock(&pool->lock);
+        connection->inUse = 0;
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    return connection;
+}
+
+// Returns a connection to the pool. Pass healthy = 0 after an error so the
+// connection and its statements are dropped and rebuilt on next use.
+void releaseConnection(SQLSetup *setup, SQLConnection *connection, int healthy) {
+    if (connection == NULL) return;
+    if (!healthy) closeConnection(connection);
+    connection->lastUsed = time(NULL);
+
+    pthread_mutex_lock(&setup->pool.lock);
+    connection->inUse = 0;
+    pthread_cond_signal(&setup->pool.available);
+    pthread_mutex_unlock(&setup->pool.lock);
+}
+
+// First column of the first row as text. Returns 0 on error; *found is 0
+// when the result was empty or NULL.
+int queryText(MYSQL *conn, const char *query, char *out, size_t size, int *found) {
+    *found = 0;
+    if (mysql_query(conn, query)) {
+        fprintf(stderr, "Query failed: %s\n", mysql_error(conn));
+        return 0;
+    }
+    MYSQL_RES *result = mysql_store_result(conn);
+    if (result == NULL) {
+        fprintf(stderr, "Failed to store result: %s\n", mysql_error(conn));
+        return 0;
+    }
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row != NULL && row[0] != NULL) {
+        snprintf(out, size, "%s", row[0]);
+        *found = 1;
+    }
+    mysql_free_result(result);
+    return 1;
+}
+
+// Reading value as convertData decodes it: the RHS column holds the digits
+// after the decimal point
+#define SQL_TEMPERATURE "(TempLHS + TempRHS / POW(10, CHAR_LENGTH(TempRHS)))"
+#define SQL_HUMIDITY "(HumLHS + HumRHS / POW(10, CHAR_LENGTH(HumRHS)))"
+
+void buildStatementText(SQLSetup *setup, enum SQLStatement statement, char *buffer, size_t size) {
+    switch (statement) {
+        case RANGE_STATEMENT:
+        case RANGE_CURSOR_STATEMENT:
+            snprintf(buffer, size, "SELECT TempLHS, TempRHS, HumLHS, HumRHS, time FROM %s WHERE time BETWEEN ? AND ? ORDER BY time", setup->table);
+            break;
+        // Buckets are counted in local wall clock seconds from 1970-01-01, like
+        // the time column and the rollups, so day buckets start at local
+        // midnight whatever the UTC offset.
+        // Parameters: bucket seconds (twice), range start, range end
+        case AGGREGATE_STATEMENT:
+            snprintf(buffer, size,
+                "SELECT TIMESTAMP('1970-01-01') + INTERVAL FLOOR(TIMESTAMPDIFF(SECOND, '1970-01-01', time) / ?) * ? SECOND "
+                "AS bucket, COUNT(*), "
+                "AVG(" SQL_TEMPERATURE "), MIN(" SQL_TEMPERATURE "), MAX(" SQL_TEMPERATURE "), "
+                "AVG(" SQL_HUMIDITY "), MIN(" SQL_HUMIDITY "), MAX(" SQL_HUMIDITY ") "
+                "FROM %s WHERE time BETWEEN ? AND ? GROUP BY bucket ORDER BY bucket", setup->table);
+            break;
+        // Same result columns as AGGREGATE_STATEMENT, read from a rollup table
+        case HOURLY_RANGE_STATEMENT:
+        case DAILY_RANGE_STATEMENT:
+            snprintf(buffer, size,
+                "SELECT TIMESTAMP('1970-01-01') + INTERVAL FLOOR(TIMESTAMPDIFF(SECOND, '1970-01-01', bucket) / ?) * ? SECOND "
+                "AS period, SUM(samples), "
+                "SUM(temp_sum) / SUM(samples), MIN(temp_min), MAX(temp_max), "
+                "SUM(hum_sum) / SUM(samples), MIN(hum_min), MAX(hum_max) "
+                "FROM %s_%s WHERE bucket BETWEEN ? AND ? GROUP BY period ORDER BY period",
+                setup->table, (statement == HOURLY_RANGE_STATEMENT ? "hourly" : "daily"));
+            break;
+        // Parameters: bucket, samples, temperature sum / min / max, humidity sum / min / max
+        case HOURLY_UPSERT_STATEMENT:
+        case DAILY_UPSERT_STATEMENT:
+            snprintf(buffer, size,
+                "INSERT INTO %s_%s (bucket, samples, temp_sum, temp_min, temp_max, hum_sum, hum_min, hum_max) "
+                "VALUES (?, ?, ?, ?, ?, ?, ?, ?) ON DUPLICATE KEY UPDATE "
+                "samples = samples + VALUES(samples), temp_sum = temp_sum + VALUES(temp_sum), "
+                "temp_min = LEAST(temp_min, VALUES(temp_min)), temp_max = GREATEST(temp_max, VALUES(temp_max)), "
+                "hum_sum = hum_sum + VALUES(hum_sum), "
+                "hum_min = LEAST(hum_min, VALUES(hum_min)), hum_max = GREATEST(hum_max, VALUES(hum_max))",
+                setup->table, (statement == HOURLY_UPSERT_STATEMENT ? "hourly" : "daily"));
+            break;
+        default:
+            buffer[0] = '\0';
+    }
+}
+
+// Prepared statement cached on the connection. Prepared on first use.
+MYSQL_STMT *getStatement(SQLSetup *setup, SQLConnection *connection, enum SQLStatement statement) {
+    if (connection->statements[statement] != NULL)
+        return connection->statements[statement];
+
+    char query[1024];
+    buildStatementText(setup, statement, query, sizeof(query));
+    MYSQL_STMT *stmt = mysql_stmt_init(connection->conn);
+    if (stmt == NULL) {
+        fprintf(stderr, "mysql_stmt_init() failed\n");
+        return NULL;
+    }
+    if (mysql_stmt_prepare(stmt, query, strlen(query))) {
+        fprintf(stderr, "mysql_stmt_prepare() failed: %s\n", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    connection->statements[statement] = stmt;
+    return stmt;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef STORE_CONTROL_H
+#define STORE_CONTROL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "sqlControl.h"
+#include "rollup.h"
+
+// MySQL allows 65535 placeholders per statement, 5 per row
+#define MAX_FLUSH_COUNT 4096
+#define READING_COLUMNS 5
+
+// One raw DHT11 sample. data[] is in sensor order
+// (HumLHS, HumRHS, TempLHS, TempRHS, checksum).
+struct reading {
+    int data[5];
+    time_t time;
+};
+typedef struct reading Reading;
+
+void toMySQLTime(time_t time, MYSQL_TIME *out) {
+    struct tm local;
+    localtime_r(&time, &local);
+    memset(out, 0, sizeof(*out));
+    out->year = local.tm_year + 1900;
+    out->month = local.tm_mon + 1;
+    out->day = local.tm_mday;
+    out->hour = local.tm_hour;
+    out->minute = local.tm_min;
+    out->second = local.tm_sec;
+    out->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+// Multi-row INSERT for `rows` readings. The statement for the configured
+// batch size stays cached on the connection; other sizes replace it.
+MYSQL_STMT *getBatchStatement(SQLSetup *setup, SQLConnection *connection, size_t rows) {
+    if (connection->batchStatement != NULL && connection->batchRows == rows)
+        return connection->batchStatement;
+    if (connection->batchStatement != NULL) {
+        mysql_stmt_close(connection->batchStatement);
+        connection->batchStatement = NULL;
+    }
+
+    const char *row = "(?, ?, ?, ?, ?)";
+    size_t size = 128 + strlen(setup->table) + rows * (strlen(row) + 2);
+    char *query = malloc(size);
+    if (query == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    size_t length = snprintf(query, size, "INSERT INTO %s (HumLHS, HumRHS, TempLHS, TempRHS, time) VALUES ",
+        setup->table);
+    for (size_t i = 0; i < rows; i++)
+        length += snprintf(query + length, size - length, "%s%s", (i == 0 ? "" : ", "), row);
+
+    MYSQL_STMT *stmt = mysql_stmt_init(connection->conn);
+    if (stmt == NULL) {
+        fprintf(stderr, "mysql_stmt_init() failed\n");
+        free(query);
+        return NULL;
+    }
+    if (mysql_stmt_prepare(stmt, query, length)) {
+        fprintf(stderr, "mysql_stmt_prepare() failed: %s\n", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        free(query);
+        return NULL;
+    }
+    free(query);
+    connection->batchStatement = stmt;
+    connection->batchRows = rows;
+    return stmt;
+}
+
+// Folds the readings into each rollup, one upsert per bucket they touch
+int updateRollups(SQLSetup *setup, SQLConnection *connection, const Reading *readings, size_t count) {
+    for (int level = 0; level < ROLLUP_COUNT; level++) {
+        RollupBucket bucket;
+        MYSQL_TIME time;
+        rollupBucketTime(readings[0].time, level, &time);
+        startRollupBucket(&bucket, &time);
+        for (size_t i = 0; i < count; i++) {
+            rollupBucketTime(readings[i].time, level, &time);
+            if (!sameRollupBucket(&time, &bucket.bucket)) {
+                if (!upsertRollupBucket(setup, connection, level, &bucket)) return 0;
+                startRollupBucket(&bucket, &time);
+            }
+            addToRollupBucket(&bucket, readings[i].data);
+        }
+        if (!upsertRollupBucket(setup, connection, level, &bucket)) return 0;
+    }
+    return 1;
+}
+
+// Inserts all readings with one statement and updates the rollups in the
+// same transaction. Returns 1 when every row was written.
+int storeReadings(SQLSetup *setup, const Reading *readings, size_t count) {
+    if (count == 0) return 1;
+    SQLConnection *connection = acquireConnection(setup);
+    if (connection == NULL) return 0;
+    if (!createRollupTables(setup, connection->conn)) {
+        releaseConnection(setup, connection, 0);
+        return 0;
+    }
+
+    MYSQL_STMT *stmt = getBatchStatement(setup, connection, count);
+    MYSQL_BIND *bind = calloc(count * READING_COLUMNS, sizeof(MYSQL_BIND));
+    MYSQL_TIME *times = calloc(count, sizeof(MYSQL_TIME));
+    if (stmt == NULL || bind == NULL || times == NULL) {
+        if (bind == NULL || times == NULL) fprintf(stderr, "Memory allocation failed\n");
+        free(bind);
+        free(times);
+        releaseConnection(setup, connection, stmt != NULL);
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        MYSQL_BIND *row = &bind[i * READING_COLUMNS];
+        for (int j = 0; j < 4; j++) {
+            row[j].buffer_type = MYSQL_TYPE_LONG;
+            row[j].buffer = (void*)&readings[i].data[j];
+        }
+        toMySQLTime(readings[i].time, &times[i]);
+        row[4].buffer_type = MYSQL_TYPE_TIMESTAMP;
+        row[4].buffer = &times[i];
+    }
+
+    int result = 1;
+    if (mysql_query(connection->conn, "START TRANSACTION")) {
+        fprintf(stderr, "%s\n", mysql_error(connection->conn));
+        result = 0;
+    }
+    else if (mysql_stmt_bind_param(stmt, bind) || mysql_stmt_execute(stmt)) {
+        fprintf(stderr, "%s\n", mysql_stmt_error(stmt));
+        result = 0;
+    }
+    else if (!updateRollups(setup, connection, readings, count)) result = 0;
+    else if (mysql_commit(connection->conn)) {
+        fprintf(stderr, "Commit failed: %s\n", mysql_error(connection->conn));
+        result = 0;
+    }
+    if (!result) mysql_rollback(connection->conn);
+    free(bind);
+    free(times);
+    releaseConnection(setup, connection, result);
+    return result;
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Fixed set of threads running jobs from a bounded queue. submitWorkerJob
+// waits while the queue is full, so a producer that is faster than the
+// workers (e.g. a range fetch feeding chart renders) holds at most
+// `capacity` jobs in memory besides the ones being run.
+
+#define WORKER_POOL_MAX_THREADS 64
+
+typedef void (*WorkerJob)(void *job);
+
+struct workerPool {
+    pthread_t threads[WORKER_POOL_MAX_THREADS];
+    size_t threadCount;
+    WorkerJob run;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    void **queue;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    int stopping;
+};
+typedef struct workerPool WorkerPool;
+
+// One per online core
+size_t workerPoolDefaultThreads() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0 ? (size_t)cores : 1);
+}
+
+void *workerPoolThread(void *arg) {
+    WorkerPool *pool = (WorkerPool*)arg;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->count == 0 && !pool->stopping) pthread_cond_wait(&pool->changed, &pool->lock);
+        if (pool->count == 0) break;
+        void *job = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+        pool->run(job);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int startWorkerPool(WorkerPool *pool, size_t threads, WorkerJob run) {
+    memset(pool, 0, sizeof(*pool));
+    if (threads == 0) threads = 1;
+    if (threads > WORKER_POOL_MAX_THREADS) threads = WORKER_POOL_MAX_THREADS;
+    pool->run = run;
+    pool->capacity = 2 * threads;
+    pool->queue = malloc(pool->capacity * sizeof(void*));
+    if (pool->queue == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    for (size_t i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, workerPoolThread, pool) != 0) {
+            perror("Failed to create worker thread");
+            break;
+        }
+        pool->threadCount++;
+    }
+    // Fewer threads are fine, none is not
+    if (pool->threadCount == 0) {
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->changed);
+        free(pool->queue);
+        return 0;
+    }
+    return 1;
+}
+
+void submitWorkerJob(WorkerPool *pool, void *job) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == pool->capacity) pthread_cond_wait(&pool->changed, &pool->lock);
+    pool->queue[(pool->head + pool->count) % pool->capacity] = job;
+    pool->count++;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Runs what is queued, then stops and joins the threads
+void finishWorkerPool(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->threadCount; i++) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->changed);
+    free(pool->queue);
+}
+
+#endif